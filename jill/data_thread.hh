@@ -49,9 +49,11 @@ public:
          * @param id    a string giving the id (channel) of the block
          * @param size  the number of bytes in the data array
          * @param data  an array of data to write
+         * @param decimation  for sampled data, the number of frames between
+         *                    samples, if the data have been decimated
          */
         virtual void push(nframes_t time, dtype_t dtype, char const * id,
-                          std::size_t size, void const * data) = 0;
+                          std::size_t size, void const * data, nframes_t decimation=1) = 0;
 
         /** Signal the handler that data is ready. Must be wait-free. */
         virtual void data_ready() = 0;
@@ -70,6 +70,10 @@ public:
          * @param data  pointer to header and data for period
          * @param start if nonzero, only write frames >= start
          * @param stop  if nonzero, only write frames < stop. okay if stop > info->nframes
+         *
+         * start and stop are offsets from data->time, in frames at the
+         * server's sampling rate. For decimated data, only samples that fall
+         * in this range are written.
          */
         virtual void write(data_block_t const * data, nframes_t start, nframes_t stop) = 0;
 
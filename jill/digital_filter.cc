@@ -1,13 +1,15 @@
 #include <iostream>
 #include <complex>
-#include <map>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lambda/lambda.hpp>
 
 #include "program_options.hh"
 #include "digital_filter.hh"
+#include "dsp/fft_convolver.hh"
 #include "logging.hh"
+#include "rt_logger.hh"
 #include "logger.hh"
 
 
@@ -18,83 +20,283 @@ using namespace jill;
   
 digital_filter::digital_filter(): _coef_in(std::vector<COEF_t>(1,0)),
   _coef_out(),
-  _pads_out(),
-  _pads_in()
-{}
+  _nchannels(0),
+  _period_size(0),
+  _fft_threshold(64),
+  _hot_swap(false),
+  _crossfade(0),
+  _pending(0),
+  _retired(0),
+  _fading(0)
+{
+        _init_state();
+}
 
+digital_filter::~digital_filter()
+{
+        delete _pending;
+        delete _fading;
+        collect();
+}
+
+/* atomically replace the value of a pointer shared between threads */
+template <typename T>
+static T *
+exchange(T * volatile * ptr, T * value)
+{
+        T * old;
+        do {
+                old = *ptr;
+        } while (!__sync_bool_compare_and_swap(ptr, old, value));
+        return old;
+}
 
-void
-digital_filter::filter_buf(sample_t const * const in, sample_t * const out, 
-                           std::string port_name, nframes_t nframes) {
 
+digital_filter::channel_t
+digital_filter::add_channel() {
+        _current.state.resize((_nchannels + 1) * _current.state_len, 0);
+        _current.faded.push_back(0);
+        _current.fallback.push_back(0);
+        if (_current.convolver) _current.convolver->add_channel();
+        return _nchannels++;
+}
 
 
-        
-        memset(out, 0, nframes * sizeof(sample_t));
-        
-        if (!_pads_in.count(port_name)) {
-                _pads_in[port_name].assign(pad_len(), 0);
+void
+digital_filter::filter_buf(sample_t const * in, sample_t * out,
+                           channel_t channel, nframes_t nframes) {
+        realization * old = _fading;
+        if (old == 0 || old->faded[channel] >= _crossfade) {
+                _current.filter(in, out, channel, nframes);
+                return;
         }
- 
-        if (is_iir() && !_pads_out.count(port_name)) {
-                _pads_out[port_name].assign(pad_len(), 0);
+        // run the outgoing filter alongside the new one and ramp between them
+        nframes_t & pos = old->faded[channel];
+        sample_t * tmp = &old->scratch[0];
+        const nframes_t chunk = old->scratch.size();
+        for (nframes_t start = 0; start < nframes; start += chunk) {
+                const nframes_t n = std::min(chunk, nframes - start);
+                old->filter(in + start, tmp, channel, n);
+                _current.filter(in + start, out + start, channel, n);
+                for (nframes_t i = 0; i < n && pos < _crossfade; ++i, ++pos) {
+                        const COEF_t g = COEF_t(pos) / _crossfade;
+                        out[start + i] = g * out[start + i] + (1 - g) * tmp[i];
+                }
         }
+}
 
-        if (is_iir()) {
-                
-                //double precision output buffer so filter remains stable
-                static const nframes_t MaxNFrames = 10000;
-                COEF_t precise_out[MaxNFrames] = {0};
-
-                // ensure coefficient vectors are same size so index
-                // doesn't go out of range
-                if (_coef_in.size() < _coef_out.size()) {
-                        _coef_in.resize(_coef_out.size());       
-                }
-                else if (_coef_in.size() > _coef_out.size() ) {
-                        _coef_out.resize(_coef_in.size());
-                } 
- 
-                for (nframes_t n = 0; n < nframes; n++) {
-
-                        for (nframes_t i = 0; i <= pad_len(); i++) {                           
-                                if (i == 0) {
-                                        precise_out[n] = _coef_in[i] * in[n-i];
-                                }
-                                else if (i <= n) {
-                                        precise_out[n] += _coef_in[i]*in[n-i] - _coef_out[i] * precise_out[n-i];      
-                                }
-                                else {
-                                        precise_out[n] += _coef_in[i] * _pads_in[port_name][n-i + pad_len()] -      
-                                                _coef_out[i] * _pads_out[port_name][n-i + pad_len()];
-                                }       
+void
+digital_filter::realization::filter(sample_t const * in, sample_t * out,
+                                    channel_t channel, nframes_t nframes) {
+        COEF_t * z = (state_len > 0) ? &state[channel * state_len] : 0;
+        if (convolver) {
+                // the convolver and the direct form don't keep each other's
+                // state, so the state is reset when switching between them
+                const bool partial = (nframes % period_size != 0);
+                if (partial != bool(fallback[channel])) {
+                        if (partial) {
+                                RTLOG("filter block of {} frames is not a multiple of {}; "
+                                      "using direct convolution", nframes, period_size);
+                                std::fill(z, z + state_len, 0);
                         }
-                        precise_out[n] /= _coef_out[0];
+                        else
+                                convolver->reset(channel);
+                        fallback[channel] = partial;
+                }
+                if (!partial) {
+                        convolver->process(in, out, channel, nframes);
+                        return;
+                }
+        }
+        if (!sections.empty())
+                filter_sos(in, out, z, nframes);
+        else
+                filter_direct(in, out, z, nframes);
+}
 
+/*
+ * Transposed direct form II, with the state in double precision so the filter
+ * remains stable. The coefficients are normalized so that a[0] == 1.
+ */
+void
+digital_filter::realization::filter_direct(sample_t const * in, sample_t * out,
+                                           COEF_t * z, nframes_t nframes) const
+{
+        const size_t order = state_len;
+        const COEF_t * b = &this->b[0];
+        const COEF_t * a = &this->a[0];
+        for (nframes_t n = 0; n < nframes; ++n) {
+                COEF_t x = in[n];
+                COEF_t y = b[0] * x + ((order > 0) ? z[0] : 0);
+                for (size_t i = 1; i < order; ++i)
+                        z[i-1] = b[i] * x - a[i] * y + z[i];
+                if (order > 0)
+                        z[order-1] = b[order] * x - a[order] * y;
+                out[n] = y;
+        }
+}
+
+/*
+ * Transposed direct form II. Each section has two state variables, and the
+ * output of each section is the input to the next. Calculations are in double
+ * precision.
+ */
+void
+digital_filter::realization::filter_sos(sample_t const * in, sample_t * out,
+                                        COEF_t * s, nframes_t nframes) const
+{
+        const size_t nsections = sections.size();
+        const biquad_t * sec = &sections[0];
+        for (nframes_t n = 0; n < nframes; ++n) {
+                COEF_t x = in[n];
+                for (size_t i = 0; i < nsections; ++i) {
+                        const biquad_t & b = sec[i];
+                        COEF_t y = b.b0 * x + s[2*i];
+                        s[2*i] = b.b1 * x - b.a1 * y + s[2*i+1];
+                        s[2*i+1] = b.b2 * x - b.a2 * y;
+                        x = y;
                 }
-                std::copy(precise_out + nframes-pad_len(), precise_out + nframes, _pads_out[port_name].begin());
-                std::copy(precise_out, precise_out + nframes, out);
-                std::copy(in + nframes-pad_len(), in + nframes, _pads_in[port_name].begin());
-                
+                out[n] = x;
         }
-        else {
-                for (nframes_t n = 0; n < nframes; n++) {
-                        for (nframes_t i = 0; i <= pad_len(); i++) {
-                                if (i <= n) {
-                                        out[n] += _coef_in[i] * in[n-i];    
-                                }
-                                else {
-                                        out[n] += _coef_in[i] *
-                                                _pads_in[port_name][n-i + pad_len()];
-                                }
-                        }
-                        if (_coef_out.size() > 0) {
-                                out[n] /= _coef_out[0];
-                        }
+}
+
+/* true if the state of one filter can be used by the other */
+bool
+digital_filter::realization::same_structure(realization const & other) const
+{
+        return (state_len == other.state_len && state.size() == other.state.size() &&
+                sections.size() == other.sections.size() && !convolver && !other.convolver);
+}
+
+void
+digital_filter::realization::swap(realization & other)
+{
+        b.swap(other.b);
+        a.swap(other.a);
+        sections.swap(other.sections);
+        std::swap(state_len, other.state_len);
+        state.swap(other.state);
+        std::swap(period_size, other.period_size);
+        convolver.swap(other.convolver);
+        fallback.swap(other.fallback);
+}
+
+void
+digital_filter::_init_state() {
+        realization * r = new realization;
+        // pad the coefficients to the same length and normalize by a[0]
+        size_t len = std::max(std::max(_coef_in.size(), _coef_out.size()), size_t(1));
+        r->b.assign(len, 0);
+        r->a.assign(len, 0);
+        std::copy(_coef_in.begin(), _coef_in.end(), r->b.begin());
+        std::copy(_coef_out.begin(), _coef_out.end(), r->a.begin());
+        COEF_t a0 = (_coef_out.empty()) ? 1.0 : _coef_out[0];
+        for (size_t i = 0; i < len; ++i) {
+                r->b[i] /= a0;
+                r->a[i] /= a0;
+        }
+        r->sections = _sections;
+        r->state_len = (is_sos()) ? 2 * _sections.size() : len - 1;
+        r->state.assign(_nchannels * r->state_len, 0);
+        r->period_size = _period_size;
+        r->fallback.assign(_nchannels, 0);
+        r->faded.assign(_nchannels, 0);
+        r->scratch.resize(std::max<nframes_t>(_period_size, 256));
+
+        // long FIR filters use FFT convolution, if the period size is known
+        bool fir = !is_sos() && _coef_out.size() <= 1;
+        if (fir && _fft_threshold > 0 && _coef_in.size() >= _fft_threshold && _period_size > 0) {
+                if (_period_size & (_period_size - 1)) {
+                        LOG << "period size is not a power of two; not using FFT convolution";
                 }
-                std::copy(in + nframes-pad_len(), in + nframes, _pads_in[port_name].begin());
-        }     
+                else {
+                        r->convolver.reset(new dsp::fft_convolver(r->b, _period_size));
+                        for (size_t c = 0; c < _nchannels; ++c)
+                                r->convolver->add_channel();
+                        LOG << "using FFT convolution: " << r->b.size() << " taps, "
+                            << r->convolver->npartitions() << " partitions of "
+                            << _period_size << " samples";
+                }
+        }
+        _publish(r);
+}
+
+void
+digital_filter::_publish(realization * r) {
+        if (!_hot_swap) {
+                _current.swap(*r);
+                delete r;
+                return;
+        }
+        // a set that was published but never picked up can be freed here
+        delete exchange(&_pending, r);
+        collect();
+}
+
+void
+digital_filter::_retire(realization * r) {
+        realization * head;
+        do {
+                head = _retired;
+                r->next = head;
+        } while (!__sync_bool_compare_and_swap(&_retired, head, r));
+}
+
+void
+digital_filter::enable_hot_swap(nframes_t crossfade) {
+        _hot_swap = true;
+        _crossfade = crossfade;
+}
+
+bool
+digital_filter::update() {
+        if (_fading) {
+                bool done = true;
+                for (size_t c = 0; c < _nchannels; ++c)
+                        done = done && _fading->faded[c] >= _crossfade;
+                if (done) {
+                        _retire(_fading);
+                        _fading = 0;
+                }
+        }
+        realization * r = exchange(&_pending, (realization *)0);
+        if (r == 0) return false;
+        if (r->same_structure(_current))
+                std::copy(_current.state.begin(), _current.state.end(), r->state.begin());
+        // r holds the outgoing filter after the swap
+        _current.swap(*r);
+        if (_crossfade > 0) {
+                // a crossfade still in progress is cut short
+                if (_fading) _retire(_fading);
+                std::fill(r->faded.begin(), r->faded.end(), 0);
+                _fading = r;
+        }
+        else
+                _retire(r);
+        return true;
+}
+
+void
+digital_filter::collect() {
+        realization * r = exchange(&_retired, (realization *)0);
+        while (r) {
+                realization * next = r->next;
+                delete r;
+                r = next;
+        }
+}
 
+void
+digital_filter::set_period_size(nframes_t nframes) {
+        if (nframes == _period_size) return;
+        _period_size = nframes;
+        _init_state();
+}
+
+void
+digital_filter::set_fft_threshold(size_t ntaps) {
+        _fft_threshold = ntaps;
+        _init_state();
 }
 
 void 
@@ -102,22 +304,24 @@ digital_filter::custom_coef(std::vector<COEF_t> b,
                             std::vector<COEF_t> a) {
         _coef_in = b;
         _coef_out = a;
+        _sections.clear();
+        _init_state();
         log_coefs();
 }
 
 
 void 
-digital_filter::reset_pads() {
-        std::map<std::string, std::vector<COEF_t> >::iterator it_in, it_out;
-        if (is_iir()) {
-                it_out = _pads_out.begin();
-        }
-        for (it_in = _pads_in.begin(); it_in != _pads_out.end(); it_in++) {
-                it_in->second.assign(it_in->second.size(), 0);
-                if (is_iir()) {
-                        it_out->second.assign(it_out->second.size(), 0);
-                }
-        }
+digital_filter::reset() {
+        std::fill(_current.state.begin(), _current.state.end(), 0);
+        if (_current.convolver) _current.convolver->reset();
+}
+
+void
+digital_filter::reset(channel_t channel) {
+        const size_t len = _current.state_len;
+        std::fill(_current.state.begin() + channel * len,
+                  _current.state.begin() + (channel + 1) * len, 0);
+        if (_current.convolver) _current.convolver->reset(channel);
 }
        
 digital_filter::COEF_t
@@ -182,11 +386,53 @@ digital_filter::butter(int N, std::vector<COEF_t> Wc, std::string filter_type, n
 
         H.bilinear();
      
-        _tf2coefficients(H);       
+        _tf2coefficients(H);
+        _sections = H.sos();
+        _init_state();
 
         log_filter(N, Wc, filter_type, "butterworth");
 }
 
+void
+digital_filter::firwin(int ntaps, COEF_t cutoff, nframes_t fs, std::string window) {
+
+        const COEF_t pi = arg(complex_t(-1,0));
+        const COEF_t fc = cutoff / fs;
+        const COEF_t center = (ntaps - 1) / 2.0;
+        const COEF_t denom = std::max(ntaps - 1, 1);
+        std::vector<COEF_t> h(ntaps);
+        COEF_t sum = 0;
+        for (int n = 0; n < ntaps; n++) {
+                COEF_t t = n - center;
+                COEF_t x = (t == 0) ? 2 * fc : std::sin(2 * pi * fc * t) / (pi * t);
+                COEF_t w;
+                if (window == "hamming")
+                        w = 0.54 - 0.46 * std::cos(2 * pi * n / denom);
+                else if (window == "hann")
+                        w = 0.5 - 0.5 * std::cos(2 * pi * n / denom);
+                else if (window == "blackman")
+                        w = 0.42 - 0.5 * std::cos(2 * pi * n / denom) + 0.08 * std::cos(4 * pi * n / denom);
+                else if (window == "rectangular")
+                        w = 1;
+                else {
+                        LOG << "ERROR: unknown window type: " << window;
+                        throw Exit(-1);
+                }
+                h[n] = x * w;
+                sum += h[n];
+        }
+        // unit gain at DC
+        for (int n = 0; n < ntaps; n++)
+                h[n] /= sum;
+
+        _coef_in = h;
+        _coef_out.clear();
+        _sections.clear();
+        _init_state();
+
+        log_filter(ntaps - 1, std::vector<COEF_t>(1, cutoff), "low-pass", "FIR (" + window + " window)");
+}
+
 void
 digital_filter::log_filter(int N, std::vector<COEF_t> Wc, std::string filter_type, std::string filter_class){
         
@@ -202,11 +448,21 @@ digital_filter::log_filter(int N, std::vector<COEF_t> Wc, std::string filter_typ
 void
 digital_filter::log_coefs() {
 
-        //printing polynomials for convenience
-        LOG << "Numerator filter coefficients set to " 
-            << poly(&_coef_in[0], _coef_in.size()-1); 
-        LOG << "Denominator filter coefficients set to " 
-            << poly(&_coef_out[0],_coef_out.size()-1);
+        //printing polynomials for convenience; long FIR filters are summarized
+        static const size_t max_logged = 32;
+        if (_coef_in.size() > max_logged)
+                LOG << "Numerator filter coefficients set to " << _coef_in.size() << " taps";
+        else
+                LOG << "Numerator filter coefficients set to " 
+                    << poly(&_coef_in[0], _coef_in.size()-1); 
+        if (!_coef_out.empty())
+                LOG << "Denominator filter coefficients set to " 
+                    << poly(&_coef_out[0],_coef_out.size()-1);
+        for (size_t i = 0; i < _sections.size(); ++i) {
+                biquad_t const & s = _sections[i];
+                LOG << "Second-order section " << i << ": b=[" << s.b0 << ", " << s.b1
+                    << ", " << s.b2 << "], a=[1, " << s.a1 << ", " << s.a2 << "]";
+        }
 }        
                 
  
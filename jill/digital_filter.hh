@@ -3,14 +3,16 @@
 
 #include "transfer_function.hh"
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/math/tools/polynomial.hpp>
 #include <jack/jack.h>
 #include <string>
-#include <map>
 #include <vector>
 #include <algorithm>
 
 namespace jill {
+
+namespace dsp { class fft_convolver; }
         
 
 class digital_filter : boost::noncopyable {
@@ -26,18 +28,90 @@ public:
         typedef boost::math::tools::polynomial<COEF_t> poly;
 
 
+        /** a handle for the filter state of a single channel */
+        typedef std::size_t channel_t;
+
         digital_filter();
-        ~digital_filter(){}
-       
-        // filters single buffer from a port and stores pad for that port 
-        void 
-        filter_buf(sample_t const * const in, sample_t * const out, 
-                        std::string port_name, nframes_t nframes);
-
-        void reset_pads(); 
+        ~digital_filter();
+
+        /**
+         * Allocate the filter state for a new channel. Call this when the
+         * port is registered, not in the process callback, and before
+         * enabling hot swaps.
+         *
+         * @return a handle used to refer to the channel in filter_buf()
+         */
+        channel_t add_channel();
+        std::size_t nchannels() const {return _nchannels;}
+
+        /**
+         * Filter a single buffer from a channel. Only touches preallocated
+         * state, so it's safe to call in the process callback. There's no
+         * limit on the number of frames, but with FFT convolution, a block
+         * that isn't a multiple of the period size is filtered in the direct
+         * form, which is much slower. The state of the channel is reset when
+         * it switches between the two, so there will be a discontinuity, and
+         * a message is logged.
+         */
+        void
+        filter_buf(sample_t const * in, sample_t * out, channel_t channel, nframes_t nframes);
+
+        /**
+         * Set the number of samples passed to each call of filter_buf. FIR
+         * filters with at least fft_threshold() taps are implemented with FFT
+         * convolution using this block size, which must be a power of two.
+         * Resets the filter state; not safe to call in the process callback.
+         * Like the design calls (butter, firwin, custom_coef) and
+         * set_fft_threshold, this reads the coefficients without locking, so
+         * all of them must be called from the same thread. In a JACK buffer
+         * size callback, pass the new size to that thread instead of calling
+         * this directly.
+         */
+        void set_period_size(nframes_t nframes);
+        /** set the minimum number of taps for FFT convolution (0 to disable) */
+        void set_fft_threshold(std::size_t ntaps);
+        std::size_t fft_threshold() const {return _fft_threshold;}
+        /** true if the filter is implemented by FFT convolution */
+        bool is_fft() const {return _current.convolver.get() != 0;}
+
+        /**
+         * Hand later coefficient changes (butter, firwin, custom_coef,
+         * set_period_size) to the process callback instead of applying them
+         * immediately, so they can be made while the client is running. Call
+         * from the control thread before the client is activated.
+         *
+         * When the new filter has the same structure as the old one, its
+         * state is carried over so the output stays continuous.
+         *
+         * @param crossfade  if nonzero, run both filters and crossfade the
+         *                   output over this many frames
+         */
+        void enable_hot_swap(nframes_t crossfade=0);
+
+        /**
+         * Pick up coefficients published by the control thread. Call at the
+         * start of each period, before filter_buf(), so that all channels
+         * switch at the same frame. Doesn't lock or allocate memory.
+         *
+         * @return true if new coefficients took effect
+         */
+        bool update();
+        /** true if coefficients have been published but not picked up */
+        bool swap_pending() const {return _pending != 0;}
+        /** free coefficients retired by update(). Not safe in the process callback. */
+        void collect();
+
+        /** reset the state of all channels to zero */
+        void reset();
+        /** reset the state of one channel to zero */
+        void reset(channel_t channel);
         
         bool is_iir() {return _coef_out.size() >= 1;}
-        nframes_t pad_len() {return std::max(_coef_in.size(), _coef_out.size()) - 1;}
+        /** true if the filter is implemented as cascaded second-order sections */
+        bool is_sos() const {return !_sections.empty();}
+        std::vector<biquad_t> const & sections() const {return _sections;}
+        /** the number of state variables for each channel */
+        std::size_t state_len() const {return _current.state_len;}
         
         std::vector<COEF_t> coef_in() {return _coef_in;}
         std::vector<COEF_t> coef_out() {return _coef_out;}
@@ -47,6 +121,15 @@ public:
                         std::string filter_type, std::string filter_class);
         void custom_coef(std::vector<COEF_t>, std::vector<COEF_t>);       
         void butter(int N, std::vector<COEF_t> Wn, std::string filter_type, nframes_t fs);
+        /**
+         * Design a linear-phase low-pass FIR filter by the window method.
+         *
+         * @param ntaps   the number of taps (odd numbers give an integer delay)
+         * @param cutoff  the cutoff frequency (Hz)
+         * @param fs      the sampling rate (Hz)
+         * @param window  the window: hamming, hann, blackman, or rectangular
+         */
+        void firwin(int ntaps, COEF_t cutoff, nframes_t fs, std::string window="hamming");
 
 
 protected:
@@ -54,8 +137,65 @@ protected:
         std::vector<COEF_t> _coef_in;
         std::vector<COEF_t> _coef_out;
         
-        std::map<std::string, std::vector<COEF_t> > _pads_out;
-        std::map<std::string, std::vector<COEF_t> > _pads_in;
+        // second-order sections
+        std::vector<biquad_t> _sections;
+
+        /*
+         * Everything filter_buf() uses, built from the coefficients above.
+         * Hot swaps exchange the contents of these objects, which only swaps
+         * pointers.
+         */
+        struct realization : boost::noncopyable {
+                realization() : state_len(0), period_size(0), next(0) {}
+
+                // normalized coefficients for the direct form, padded to the same length
+                std::vector<COEF_t> b;
+                std::vector<COEF_t> a;
+                // second-order sections
+                std::vector<biquad_t> sections;
+                // filter state for all channels, with state_len variables per channel
+                std::size_t state_len;
+                std::vector<COEF_t> state;
+                // FFT convolution for long FIR filters
+                nframes_t period_size;
+                boost::shared_ptr<dsp::fft_convolver> convolver;
+                // nonzero for channels whose last block wasn't a multiple of
+                // period_size, and was filtered in the direct form instead
+                std::vector<char> fallback;
+
+                // not exchanged by swap(): crossfade progress for each channel,
+                // scratch space for the outgoing filter, and the retired list
+                std::vector<nframes_t> faded;
+                std::vector<sample_t> scratch;
+                realization * next;
+
+                void filter(sample_t const * in, sample_t * out, channel_t channel,
+                            nframes_t nframes);
+                void filter_direct(sample_t const * in, sample_t * out,
+                                   COEF_t * state, nframes_t nframes) const;
+                void filter_sos(sample_t const * in, sample_t * out,
+                                COEF_t * state, nframes_t nframes) const;
+                bool same_structure(realization const & other) const;
+                void swap(realization & other);
+        };
+
+        std::size_t _nchannels;
+        nframes_t _period_size;
+        std::size_t _fft_threshold;
+
+        realization _current;
+        // hot swaps: published by the control thread, retired by the process thread
+        bool _hot_swap;
+        nframes_t _crossfade;
+        realization * volatile _pending;
+        realization * volatile _retired;
+        // the outgoing filter during a crossfade; process thread only
+        realization * _fading;
+
+        /* called when the coefficients change */
+        void _init_state();
+        void _publish(realization * r);
+        void _retire(realization * r);
 
         void _tf2coefficients(transfer_function H);
         COEF_t _prewarp(COEF_t Wn);
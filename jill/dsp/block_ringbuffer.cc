@@ -12,6 +12,7 @@
 
 #include "block_ringbuffer.hh"
 #include "../logging.hh"
+#include "../rt_logger.hh"
 
 using namespace jill::dsp;
 using jill::data_block_t;
@@ -26,13 +27,13 @@ block_ringbuffer::~block_ringbuffer()
 
 size_t
 block_ringbuffer::push(nframes_t time, dtype_t dtype, char const * id,
-                       size_t size, void const * data)
+                       size_t size, void const * data, nframes_t decimation)
 {
         // serialize the data in the buffer such that the header is followed by
         // the two data arrays
-        data_block_t header = { time, dtype, strlen(id), size};
+        data_block_t header = { time, dtype, strlen(id), size, decimation };
         if (header.size() > write_space()) {
-                DBG << "ringbuffer full (req=" << header.size() << "; avail=" << write_space() << ")";
+                RTDBG("ringbuffer full (req={}; avail={})", header.size(), write_space());
                 return 0;
         }
         char * dst = buffer() + write_offset();
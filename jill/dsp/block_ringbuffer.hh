@@ -75,12 +75,15 @@ public:
          * @param id    a string giving the id (channel) of the block
          * @param size  the number of bytes in the data array
          * @param data  an array of data to write
+         * @param decimation  for sampled data, the number of frames between
+         *                    samples (i.e., the ratio of the server's sampling
+         *                    rate to the data's sampling rate)
          *
          * @returns the number of bytes written, or 0 if there wasn't enough
          *          room for all of them. Will not write partial blocks.
          */
 	std::size_t push(nframes_t time, dtype_t dtype, char const * id,
-                         std::size_t size, void const * data);
+                         std::size_t size, void const * data, nframes_t decimation=1);
 
         /**
          * Read-ahead access to the buffer. If a block is available, returns a
@@ -70,10 +70,10 @@ buffered_data_writer::~buffered_data_writer()
 
 void
 buffered_data_writer::push(nframes_t time, dtype_t dtype, char const * id,
-                           size_t size, void const * data)
+                           size_t size, void const * data, nframes_t decimation)
 {
         if (_state != Stopping) {
-                if (_buffer->push(time, dtype, id, size, data) == 0) {
+                if (_buffer->push(time, dtype, id, size, data, decimation) == 0) {
                         xrun();
                 }
         }
@@ -144,6 +144,18 @@ buffered_data_writer::request_buffer_size(size_t bytes)
         return _buffer->size();
 }
 
+size_t
+buffered_data_writer::buffer_fill() const
+{
+        return _buffer->read_space();
+}
+
+size_t
+buffered_data_writer::buffer_capacity() const
+{
+        return _buffer->size();
+}
+
 void *
 buffered_data_writer::thread(void * arg)
 {
@@ -205,7 +217,7 @@ buffered_data_writer::write_messages()
         static const int max_messages = 100;
         if (!_logger_bound) return;
         for (int i = 0; i < max_messages; ++i) {
-                // expect a three-part message: source, timestamp, message
+                // expect one or more three-part entries: source, timestamp, message
                 int64_t more = 1;
                 size_t more_size = sizeof(more);
                 std::vector<zmq::msg_ptr_t> messages;
@@ -216,10 +228,10 @@ buffered_data_writer::write_messages()
                         messages.push_back(message);
                         zmq_getsockopt (_socket, ZMQ_RCVMORE, &more, &more_size);
                 }
-                if (messages.size() >= 3) {
-                        _writer->log(from_iso_string(zmq::msg_str(messages[1])),
-                                     zmq::msg_str(messages[0]),
-                                     zmq::msg_str(messages[2]));
+                for (size_t j = 0; j + 2 < messages.size(); j += 3) {
+                        _writer->log(from_iso_string(zmq::msg_str(messages[j+1])),
+                                     zmq::msg_str(messages[j]),
+                                     zmq::msg_str(messages[j+2]));
                 }
         }
 }
@@ -46,7 +46,7 @@ public:
         /* implementations of data_thread methods */
 
         void push(nframes_t time, dtype_t dtype, char const * id,
-                  std::size_t size, void const * data);
+                  std::size_t size, void const * data, nframes_t decimation=1);
         void data_ready();
         void xrun();
         void reset();
@@ -65,6 +65,12 @@ public:
          */
         virtual std::size_t request_buffer_size(std::size_t bytes);
 
+        /** The number of bytes waiting to be written. Wait-free. */
+        std::size_t buffer_fill() const;
+
+        /** The size of the ringbuffer (in bytes) */
+        std::size_t buffer_capacity() const;
+
         /**
          * Bind the logger to a zeromq socket. Messages may be sent to this
          * socket by other programs.
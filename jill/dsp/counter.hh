@@ -12,11 +12,28 @@
 #define _COUNTER_HH
 
 #include <iosfwd>
+#include <algorithm>
+#include <vector>
 #include <boost/noncopyable.hpp>
-#include <boost/circular_buffer.hpp>
+#include <boost/array.hpp>
+#include <boost/static_assert.hpp>
 
 namespace jill { namespace dsp {
 
+namespace detail {
+
+/** the smallest power of two not less than n (and at least 1) */
+inline std::size_t
+next_pow2(std::size_t n)
+{
+        std::size_t ret = 1;
+        while (ret < n)
+                ret <<= 1;
+        return ret;
+}
+
+}
+
 /**
  * @ingroup miscgroup
  * @brief calculate running sum
@@ -27,12 +44,16 @@ namespace jill { namespace dsp {
  * new value and subtracting the last value in the queue, which is
  * then dropped. A comparison is made between the running total and a
  * threshold.
+ *
+ * The queue is stored in a ring whose size is rounded up to a power of two,
+ * so positions are found with a mask instead of a comparison or division.
+ * If the window is known at compile time, use static_running_counter.
  */
 template <class T>
 class running_counter : boost::noncopyable {
 
         /// the storage type
-        typedef boost::circular_buffer<T> storage_type;
+        typedef std::vector<T> storage_type;
 
 public:
 	/** the data type stored in the counter */
@@ -40,9 +61,10 @@ public:
 	/** the data type for size information */
         typedef typename storage_type::size_type size_type;
 
-	/** Initialize the counter. @param size  the size of the running sum window */
+	/** Initialize the counter. @param size  the size of the running sum window (at least 1) */
 	explicit running_counter(size_type size)
-		: _counts(size), _running_count(0) {}
+		: _counts(detail::next_pow2(size)), _mask(_counts.size() - 1),
+                  _size(size), _pos(0), _running_count(0) {}
 
 	/**
 	 * Add a value to the queue.  If the queue is full, the value at the end
@@ -51,40 +73,187 @@ public:
 	 * @param count          the value to add
 	 */
 	void push(data_type count) {
-                if (_counts.full()) {
-                        _running_count -= _counts.front();
+                if (_pos >= _size) {
+                        _running_count -= _counts[(_pos - _size) & _mask];
                 }
-                _counts.push_back(count);
+                _counts[_pos & _mask] = count;
+                _pos += 1;
 		_running_count += count;
 	}
 
 	/** Whether the queue is full or not */
-	bool full() const { return _counts.full(); }
+	bool full() const { return _pos >= _size; }
+
+	/** The size of the running sum window */
+	size_type size() const { return _size; }
 
 	/** @return the running total */
 	data_type running_count() const { return _running_count; }
 
 	/** reset the counter */
 	void reset() {
-		_counts.clear();
+		_pos = 0;
 		_running_count = 0;
 	}
 
         /** output the state of the queue to a stream */
 	friend std::ostream& operator<< (std::ostream &os, const running_counter<T> &o) {
-                std::ostream_iterator<data_type> out(os," ");
-		os << o._running_count << " [" << o._counts.size() << '/' << o._counts.capacity() << "] (";
-                std::copy(o._counts.begin(), o._counts.end(), out);
+                size_type n = std::min(o._pos, o._size);
+		os << o._running_count << " [" << n << '/' << o._size << "] (";
+                for (size_type i = o._pos - n; i < o._pos; ++i)
+                        os << o._counts[i & o._mask] << ' ';
 		return os << ')';
 	}
 
 private:
 	/// count of samples in complete blocks
 	storage_type _counts;
+	size_type _mask;
+	/// the size of the window
+	size_type _size;
+	/// the number of values pushed since the last reset
+	size_type _pos;
 	/// a running count
 	data_type _running_count;
 };
 
+/**
+ * @ingroup miscgroup
+ * @brief calculate running sum over a window fixed at compile time
+ *
+ * The same as running_counter, but the queue is stored in the object and its
+ * size is a template parameter, so there are no allocations or indirections,
+ * and the compiler can fold the wraparound into a mask when N is a power of
+ * two.
+ *
+ * @param T  the data type stored in the counter
+ * @param N  the size of the running sum window
+ */
+template <class T, std::size_t N>
+class static_running_counter : boost::noncopyable {
+
+        BOOST_STATIC_ASSERT(N > 0);
+
+public:
+	typedef T data_type;
+        typedef std::size_t size_type;
+
+	static_running_counter() { reset(); }
+
+	/**
+	 * Add a value to the queue.  If the queue is full, the value at the end
+	 * of the queue is dropped.
+	 */
+	void push(data_type count) {
+                if (_filled == N)
+                        _running_count -= _counts[_head];
+                else
+                        _filled += 1;
+                _counts[_head] = count;
+                _head = next(_head);
+		_running_count += count;
+	}
+
+	bool full() const { return _filled == N; }
+
+	static size_type size() { return N; }
+
+	data_type running_count() const { return _running_count; }
+
+	void reset() {
+		_head = _filled = 0;
+		_running_count = 0;
+	}
+
+	friend std::ostream& operator<< (std::ostream &os, const static_running_counter<T,N> &o) {
+		os << o._running_count << " [" << o._filled << '/' << N << "] (";
+                size_type i = (o._filled == N) ? o._head : 0;
+                for (size_type n = 0; n < o._filled; ++n, i = next(i))
+                        os << o._counts[i] << ' ';
+		return os << ')';
+	}
+
+private:
+        enum { is_pow2 = (N & (N - 1)) == 0 };
+
+        static size_type next(size_type i) {
+                return (is_pow2) ? (i + 1) & (N - 1) : (i + 1 == N) ? 0 : i + 1;
+        }
+
+        boost::array<T, N> _counts;
+        size_type _head;
+        size_type _filled;
+	data_type _running_count;
+};
+
+/**
+ * @ingroup miscgroup
+ * @brief calculate running sums over several windows
+ *
+ * Keeps running sums over the last n values for several values of n, sharing
+ * a single queue sized to the longest window. This is cheaper than keeping a
+ * running_counter for each window, and the sums are always in step, which is
+ * useful for detectors that compare activity at several time scales.
+ */
+template <class T>
+class multi_running_counter : boost::noncopyable {
+
+        typedef std::vector<T> storage_type;
+
+public:
+	typedef T data_type;
+        typedef typename storage_type::size_type size_type;
+
+	/**
+	 * Initialize the counter.
+	 *
+	 * @param first, last  a sequence of window sizes (each at least 1)
+	 */
+        template <typename Iterator>
+        multi_running_counter(Iterator first, Iterator last)
+                : _windows(first, last), _running_counts(_windows.size(), 0), _pos(0) {
+                size_type longest = _windows.empty() ? 1 :
+                        *std::max_element(_windows.begin(), _windows.end());
+                _counts.resize(detail::next_pow2(longest));
+                _mask = _counts.size() - 1;
+        }
+
+	/** Add a value to all the windows, dropping the oldest value from full ones */
+	void push(data_type count) {
+                for (size_type k = 0; k < _windows.size(); ++k) {
+                        if (_pos >= _windows[k])
+                                _running_counts[k] -= _counts[(_pos - _windows[k]) & _mask];
+                        _running_counts[k] += count;
+                }
+                _counts[_pos & _mask] = count;
+                _pos += 1;
+	}
+
+	/** The number of windows */
+	size_type nwindows() const { return _windows.size(); }
+
+	/** The size of a window */
+	size_type size(size_type window) const { return _windows[window]; }
+
+	/** Whether a window is full */
+	bool full(size_type window) const { return _pos >= _windows[window]; }
+
+	/** @return the running total in a window */
+	data_type running_count(size_type window) const { return _running_counts[window]; }
+
+	void reset() {
+		_pos = 0;
+                std::fill(_running_counts.begin(), _running_counts.end(), data_type(0));
+	}
+
+private:
+        std::vector<size_type> _windows;
+        std::vector<data_type> _running_counts;
+        storage_type _counts;
+        size_type _mask;
+        size_type _pos;
+};
+
 }}
 
 #endif
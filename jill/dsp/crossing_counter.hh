@@ -12,17 +12,91 @@
 #ifndef _CROSSING_COUNTER_HH
 #define _CROSSING_COUNTER_HH
 
+#include <algorithm>
+#include <stdint.h>
 #include <boost/noncopyable.hpp>
 #include "counter.hh"
+#include "crossings.hh"
 
 namespace jill { namespace dsp {
 
+namespace detail {
+
+/**
+ * The algorithm behind crossing_counter::push(), shared with
+ * crossing_counter_bank. The state of the period in progress is passed by
+ * reference, and the counts for complete periods are pushed to @a queue,
+ * which needs push(), running_count() and full() members like
+ * running_counter.
+ */
+template <typename T, typename Queue>
+int
+push_periods(Queue & queue, int32_t & period_crossings, std::size_t & period_nsamples,
+             T thresh, std::size_t period_size, int32_t max_crossings,
+             T const * samples, std::size_t size, int32_t count_thresh, T * state)
+{
+        typedef int32_t count_type;
+        typedef std::size_t size_type;
+        int ret = -1;
+        if (state)
+                state[0] = float(queue.running_count()) / max_crossings;
+        // I only check positive crossings because it's faster and there's
+        // not much point in counting both for most signals. Crossings between
+        // the last sample of the previous block and the first sample of this
+        // one are not counted.
+        size_type i = 1;
+        while (i < size) {
+                // samples remaining in the current period
+                size_type n = (period_nsamples < period_size) ? period_size - period_nsamples : 1;
+                n = std::min(n, size - i);
+                // start of the period in this block (0 if it began in an
+                // earlier block) and the crossings it had there
+                const size_type start = (period_nsamples > 0) ? 0 : i;
+                const count_type carried = period_crossings;
+                period_crossings += count_crossings(samples + i - 1, n + 1, thresh);
+                period_nsamples += n;
+                if (state)
+                        std::fill(state + i, state + i + n,
+                                  T(float(queue.running_count()) / max_crossings));
+                i += n;
+                if (period_nsamples >= period_size) {
+                        queue.push(period_crossings);
+                        const count_type running = queue.running_count();
+                        if (queue.full() && ret < 0) {
+                                if (count_thresh > 0 && running > count_thresh) {
+                                        // the crossing that took the count over threshold
+                                        count_type k = count_thresh + 1 - (running - period_crossings);
+                                        if (k <= carried)
+                                                // in an earlier block, or before this period
+                                                ret = start;
+                                        else
+                                                ret = i - n - 1 + find_crossing(samples + i - n - 1, n + 1,
+                                                                                thresh, k - carried);
+                                }
+                                else if (count_thresh < 0 && running < -count_thresh)
+                                        ret = i - 1;
+                        }
+                        period_nsamples = 0;
+                        period_crossings = 0;
+                        if (state)
+                                state[i-1] = float(queue.running_count()) / max_crossings;
+                }
+        }
+        return ret;
+}
+
+}
+
 /**
  * Counts the number of times a signal crosses a threshold within a time window.
  *
  * Data are passed to the counter in blocks. The counter adds the number of
  * crossings in the block to a queue (@see jill::dsp::running_counter) to obtain
  * a moving sum of the counts in previous blocks.
+ *
+ * Each block is split at the boundaries of the analysis periods, and the
+ * crossings in each segment are counted with count_crossings(), which uses
+ * SIMD instructions for float and double samples.
  */
 template<typename T>
 class crossing_counter : boost::noncopyable {
@@ -43,9 +117,17 @@ public:
 	 * analysis periods and the number of counts in each period pushed on to
 	 * a queue. Each time the queue is updated, the total crossing count in
 	 * the analysis window is compared against a count threshold. The return
-	 * value of the function indicates the block in which the count crossed
+	 * value of the function indicates the sample at which the count crossed
 	 * this threshold.
 	 *
+	 * The count is only compared with the threshold at the end of each
+	 * period, but the offset is sample-accurate. For a positive count
+	 * threshold, it's the sample of the crossing that brought the count
+	 * above the threshold, or the start of the period if the window was
+	 * already over threshold when it filled. Offsets in earlier blocks are
+	 * returned as 0. For a negative threshold, the count can only drop at
+	 * a period boundary, so it's the last sample of the period.
+	 *
 	 * @param samples      A buffer of samples to analyze
 	 * @param size         The number of samples in the buffer. Must be at least 2
 	 * @param count_thresh The count threshold. Can be negative or positive,
@@ -55,40 +137,13 @@ public:
 	 *                     Useful for debug.
 	 *
 	 * @returns  -1 if no crossing occurred (including calls with samples < period_size)
-	 *           N=0+ if a crossing occurred in the Nth block of data
+	 *           N=0+ if the count crossed the threshold at the Nth sample
 	 *
 	 */
- 	int push(const sample_type * samples, size_type size, count_type count_thresh, sample_type * state=0) {
-		int ret = -1, period = 0;
-		sample_type last = *samples;
-		if (state)
-			state[0] = float(_counter.running_count()) / _max_crossings;
-		for (size_t i = 1; i < size; ++i) {
-			// I only check positive crossings because
-			// it's faster and there's not much point in
-			// counting both for most signals
-			if (last < _thresh && samples[i] >= _thresh)
-				_period_crossings += 1;
-			last = samples[i];
-			_period_nsamples += 1;
-			if (_period_nsamples >= _period_size)
-			{
-				_counter.push(_period_crossings);
-				if (_counter.full() && ret < 0) {
-					if (count_thresh > 0 && _counter.running_count() > count_thresh)
-						ret = period;
-					else if (count_thresh < 0 && _counter.running_count() < -count_thresh)
-						ret = period;
-				} // if (ret < 0)
-				period += 1;
-				_period_nsamples = 0;
-				_period_crossings = 0;
-			}
-			if (state)
-				state[i] = float(_counter.running_count()) / _max_crossings;
-			// here, ret should be the period in blocks or -1 if no crossing
-		}
-		return ret;
+	int push(const sample_type * samples, size_type size, count_type count_thresh, sample_type * state=0) {
+		return detail::push_periods(_counter, _period_crossings, _period_nsamples,
+					    sample_type(_thresh), _period_size, _max_crossings,
+					    samples, size, count_thresh, state);
 	}
 
 	/** The state of the counter */
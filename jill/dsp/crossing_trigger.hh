@@ -57,7 +57,7 @@ public:
 	 *  they are either pushed to the open-threshold counter or the
 	 *  close-threshold counter. If the active counter changes state, the
 	 *  gate is opened or closed, and the offset in the supplied data where
-	 *  this occurred (to the nearest period) is returned. If no state
+	 *  this occurred is returned (@see crossing_counter::push). If no state
 	 *  changed, -1 is returned.
 	 *
 	 *  @param samples    The input samples
@@ -70,9 +70,8 @@ public:
 	 */
 	int push(const sample_type * samples, size_type size, sample_type * counts=0) {
 		if (_open) {
-			int per = _close_counter.push(samples, size, _close_count_thresh, counts);
-			if (per > -1) {
-				int offset = per * _close_counter.period_size();
+			int offset = _close_counter.push(samples, size, _close_count_thresh, counts);
+			if (offset > -1) {
 				_open = false;
 				_close_counter.reset();
 				// push samples after offset to open counter
@@ -82,9 +81,8 @@ public:
 			}
 		}
 		else {
-			int per = _open_counter.push(samples, size, _open_count_thresh, counts);
-			if (per > -1) {
-				int offset = per * _open_counter.period_size();
+			int offset = _open_counter.push(samples, size, _open_count_thresh, counts);
+			if (offset > -1) {
 				_open = true;
 				_open_counter.reset();
 				// push samples after offset to close counter
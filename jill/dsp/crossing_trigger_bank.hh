@@ -0,0 +1,199 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _CROSSING_TRIGGER_BANK_HH
+#define _CROSSING_TRIGGER_BANK_HH
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include "crossing_counter.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * A set of crossing counters (@see jill::dsp::crossing_counter) sharing the
+ * same parameters, with the state for all channels stored in flat arrays
+ * indexed by channel. The queue of period counts for each channel is a ring in
+ * a single block of memory, so no allocation happens after construction.
+ */
+template <typename T>
+class crossing_counter_bank : boost::noncopyable {
+public:
+        typedef T sample_type;
+        typedef int32_t count_type;
+        typedef std::size_t size_type;
+
+        crossing_counter_bank(size_type nchannels, sample_type const & threshold,
+                              size_type period_size, size_type period_count)
+                : _thresh(threshold), _period_size(period_size),
+                  _period_count(std::max<size_type>(period_count, 1)),
+                  _max_crossings(period_count * period_size / 2),
+                  _period_crossings(nchannels, 0), _period_nsamples(nchannels, 0),
+                  _running(nchannels, 0), _filled(nchannels, 0), _head(nchannels, 0),
+                  _history(nchannels * _period_count, 0) {}
+
+        /**
+         * Analyze a block of samples from one channel. Same semantics as
+         * crossing_counter::push().
+         *
+         * @return -1 if the count didn't cross count_thresh, or the sample
+         *         at which it did
+         */
+        int push(size_type channel, sample_type const * samples, size_type size,
+                 count_type count_thresh, sample_type * state=0) {
+                channel_queue queue(*this, channel);
+                return detail::push_periods(queue, _period_crossings[channel],
+                                            _period_nsamples[channel], _thresh, _period_size,
+                                            _max_crossings, samples, size, count_thresh, state);
+        }
+
+        /** the running count for a channel */
+        count_type count(size_type channel) const { return _running[channel]; }
+        /** true if a full analysis window has been seen since the last reset */
+        bool full(size_type channel) const { return _filled[channel] == _period_count; }
+
+        /** reset the queue for a channel */
+        void reset(size_type channel) {
+                _period_crossings[channel] = 0;
+                _period_nsamples[channel] = 0;
+                _running[channel] = 0;
+                _filled[channel] = 0;
+                _head[channel] = 0;
+        }
+
+        size_type nchannels() const { return _running.size(); }
+        size_type period_size() const { return _period_size; }
+        sample_type thresh() const { return _thresh; }
+
+private:
+        /** the queue for one channel, with the interface push_periods() expects */
+        class channel_queue {
+        public:
+                channel_queue(crossing_counter_bank & bank, size_type channel)
+                        : _bank(bank), _channel(channel) {}
+                void push(count_type count) { _bank._push_count(_channel, count); }
+                count_type running_count() const { return _bank.count(_channel); }
+                bool full() const { return _bank.full(_channel); }
+        private:
+                crossing_counter_bank & _bank;
+                size_type _channel;
+        };
+
+        void _push_count(size_type channel, count_type count) {
+                count_type * ring = &_history[channel * _period_count];
+                size_type & head = _head[channel];
+                if (_filled[channel] == _period_count)
+                        _running[channel] -= ring[head];
+                else
+                        _filled[channel] += 1;
+                ring[head] = count;
+                head = (head + 1) % _period_count;
+                _running[channel] += count;
+        }
+
+        sample_type _thresh;
+        size_type _period_size;
+        size_type _period_count;
+        count_type _max_crossings;
+
+        std::vector<count_type> _period_crossings; // crossings in the current period
+        std::vector<size_type> _period_nsamples;   // samples in the current period
+        std::vector<count_type> _running;          // sum of the queue
+        std::vector<size_type> _filled;            // number of periods in the queue
+        std::vector<size_type> _head;              // next slot in the ring
+        std::vector<count_type> _history;          // [channel * period_count + slot]
+};
+
+/**
+ * A set of independent crossing triggers (@see jill::dsp::crossing_trigger)
+ * sharing the same parameters, one per channel. Each channel has its own gate
+ * state. The state is stored in per-channel arrays so that all the channels
+ * of a client can be analyzed in one process callback.
+ */
+template <typename T>
+class crossing_trigger_bank : boost::noncopyable {
+public:
+        typedef T sample_type;
+        typedef typename crossing_counter_bank<T>::size_type size_type;
+
+        /**
+         * Instantiate a bank of signal detectors. The parameters are the
+         * same as for crossing_trigger.
+         */
+        crossing_trigger_bank(size_type nchannels,
+                              sample_type const & othresh, int ocount_thresh, size_type owindow_periods,
+                              sample_type const & cthresh, int ccount_thresh, size_type cwindow_periods,
+                              size_type period_size)
+                : _open(nchannels, 0), _nopen(0),
+                  _open_counter(nchannels, othresh, period_size, owindow_periods),
+                  _close_counter(nchannels, cthresh, period_size, cwindow_periods),
+                  _open_count_thresh(ocount_thresh),
+                  _close_count_thresh(-ccount_thresh) {} // note sign reversal
+
+        /**
+         * Analyze a block of samples from one channel.
+         *
+         * @return the sample offset where the gate for the channel opened or
+         *         closed, or -1 if its state didn't change
+         */
+        int push(size_type channel, sample_type const * samples, size_type size,
+                 sample_type * counts=0) {
+                if (_open[channel]) {
+                        int offset = _close_counter.push(channel, samples, size,
+                                                         _close_count_thresh, counts);
+                        if (offset > -1) {
+                                _open[channel] = 0;
+                                _nopen -= 1;
+                                _close_counter.reset(channel);
+                                // push samples after offset to open counter
+                                _open_counter.push(channel, samples + offset, size - offset,
+                                                   _open_count_thresh,
+                                                   (counts != 0) ? counts + offset : 0);
+                                return offset;
+                        }
+                }
+                else {
+                        int offset = _open_counter.push(channel, samples, size,
+                                                        _open_count_thresh, counts);
+                        if (offset > -1) {
+                                _open[channel] = 1;
+                                _nopen += 1;
+                                _open_counter.reset(channel);
+                                // push samples after offset to close counter
+                                _close_counter.push(channel, samples + offset, size - offset,
+                                                    _close_count_thresh,
+                                                    (counts != 0) ? counts + offset : 0);
+                                return offset;
+                        }
+                }
+                return -1;
+        }
+
+        /** The state of the detector for a channel */
+        bool open(size_type channel) const { return _open[channel]; }
+        /** The number of channels with open gates */
+        size_type nopen() const { return _nopen; }
+        size_type nchannels() const { return _open.size(); }
+
+private:
+        std::vector<char> _open;
+        size_type _nopen;
+        crossing_counter_bank<sample_type> _open_counter;
+        crossing_counter_bank<sample_type> _close_counter;
+        int _open_count_thresh;
+        int _close_count_thresh;
+};
+
+}} // namespace jill::dsp
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cstring>
+#include <stdint.h>
+#include "crossings.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JILL_CROSSINGS_X86 1
+#endif
+
+using std::size_t;
+
+namespace {
+
+/* a signed integer the same size as T, for comparison masks */
+template <typename T> struct mask_of;
+template <> struct mask_of<float> { typedef int32_t type; };
+template <> struct mask_of<double> { typedef int64_t type; };
+
+/*
+ * Compare W pairs of adjacent samples at a time. Each comparison gives a mask
+ * of -1 (crossing) or 0 in each lane, which is subtracted from a per-lane
+ * count; the lanes are summed at the end. Two accumulators hide the latency of
+ * the loads. Lane counts are limited by the size of the integer type, so long
+ * buffers are split into chunks.
+ */
+template <typename T, int W>
+inline __attribute__((always_inline)) size_t
+count_block(T const * x, size_t size, T thresh)
+{
+        typedef T vector_type __attribute__((vector_size(W * sizeof(T))));
+        typedef typename mask_of<T>::type mask_type;
+        typedef mask_type count_vector __attribute__((vector_size(W * sizeof(T))));
+        const size_t max_chunk = size_t(1) << 30;
+
+        vector_type t;
+        for (int k = 0; k < W; ++k) t[k] = thresh;
+
+        size_t count = 0;
+        size_t i = 1;
+        while (i + 2 * W <= size) {
+                const size_t stop = (size - i > max_chunk) ? i + max_chunk : size;
+                count_vector acc0 = count_vector(), acc1 = count_vector();
+                for (; i + 2 * W <= stop; i += 2 * W) {
+                        vector_type a0, b0, a1, b1;
+                        std::memcpy(&a0, x + i - 1, sizeof(vector_type));
+                        std::memcpy(&b0, x + i, sizeof(vector_type));
+                        std::memcpy(&a1, x + i + W - 1, sizeof(vector_type));
+                        std::memcpy(&b1, x + i + W, sizeof(vector_type));
+                        acc0 -= (a0 < t) & (b0 >= t);
+                        acc1 -= (a1 < t) & (b1 >= t);
+                }
+                acc0 += acc1;
+                for (int k = 0; k < W; ++k)
+                        count += acc0[k];
+        }
+        for (; i < size; ++i)
+                count += (x[i-1] < thresh && x[i] >= thresh);
+        return count;
+}
+
+/*
+ * Check W samples at a time for values outside [lo, hi]. Two vectors are
+ * compared per iteration and their masks combined, so the inner loop only has
+ * one branch for 2W samples. When the branch is taken, the scalar loop finds
+ * the exact index.
+ */
+template <typename T, int W>
+inline __attribute__((always_inline)) size_t
+find_block(T const * x, size_t size, T lo, T hi)
+{
+        typedef T vector_type __attribute__((vector_size(W * sizeof(T))));
+        typedef typename mask_of<T>::type mask_type;
+        typedef mask_type mask_vector __attribute__((vector_size(W * sizeof(T))));
+
+        vector_type l, h;
+        for (int k = 0; k < W; ++k) { l[k] = lo; h[k] = hi; }
+
+        size_t i = 0;
+        for (; i + 2 * W <= size; i += 2 * W) {
+                vector_type a, b;
+                std::memcpy(&a, x + i, sizeof(vector_type));
+                std::memcpy(&b, x + i + W, sizeof(vector_type));
+                mask_vector m = (a < l) | (a > h) | (b < l) | (b > h);
+                mask_type any = 0;
+                for (int k = 0; k < W; ++k)
+                        any |= m[k];
+                if (any)
+                        break;
+        }
+        for (; i < size; ++i) {
+                if (x[i] < lo || x[i] > hi)
+                        return i;
+        }
+        return size;
+}
+
+typedef size_t (*float_kernel)(float const *, size_t, float);
+typedef size_t (*find_kernel)(float const *, size_t, float, float);
+typedef size_t (*double_kernel)(double const *, size_t, double);
+
+size_t count_scalar_f(float const * x, size_t size, float thresh)
+{
+        return jill::dsp::count_crossings<float>(x, size, thresh);
+}
+
+size_t count_scalar_d(double const * x, size_t size, double thresh)
+{
+        return jill::dsp::count_crossings<double>(x, size, thresh);
+}
+
+size_t find_scalar_f(float const * x, size_t size, float lo, float hi)
+{
+        return jill::dsp::find_outside<float>(x, size, lo, hi);
+}
+
+/*
+ * One set of entry points per instruction set. There's no AVX-512 version,
+ * because GCC scalarizes vector comparisons that produce 512-bit masks.
+ */
+#define CROSSINGS_ENTRY(suffix, W, target)                              \
+        target size_t                                                   \
+        count_##suffix##_f(float const * x, size_t size, float thresh)  \
+        {                                                               \
+                return count_block<float, W>(x, size, thresh);          \
+        }                                                               \
+        target size_t                                                   \
+        count_##suffix##_d(double const * x, size_t size, double thresh) \
+        {                                                               \
+                return count_block<double, W / 2>(x, size, thresh);     \
+        }                                                               \
+        target size_t                                                   \
+        find_##suffix##_f(float const * x, size_t size, float lo, float hi) \
+        {                                                               \
+                return find_block<float, W>(x, size, lo, hi);                  \
+        }
+
+#ifdef JILL_CROSSINGS_X86
+CROSSINGS_ENTRY(sse2, 4, __attribute__((target("sse2"))))
+CROSSINGS_ENTRY(avx2, 8, __attribute__((target("avx2"))))
+#endif
+
+#undef CROSSINGS_ENTRY
+
+enum isa_type { SCALAR, SSE2, AVX2 };
+
+isa_type
+best_isa()
+{
+#ifdef JILL_CROSSINGS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+                return AVX2;
+        if (__builtin_cpu_supports("sse2"))
+                return SSE2;
+#endif
+        return SCALAR;
+}
+
+/* the kernels for this CPU, selected on first use */
+struct kernels {
+        isa_type isa;
+        float_kernel f;
+        double_kernel d;
+        find_kernel find;
+
+        kernels() : isa(best_isa()), f(count_scalar_f), d(count_scalar_d), find(find_scalar_f) {
+#ifdef JILL_CROSSINGS_X86
+                if (isa == AVX2) { f = count_avx2_f; d = count_avx2_d; find = find_avx2_f; }
+                else if (isa == SSE2) { f = count_sse2_f; d = count_sse2_d; find = find_sse2_f; }
+#endif
+        }
+};
+
+kernels const &
+selected()
+{
+        static const kernels k;
+        return k;
+}
+
+} // anonymous namespace
+
+namespace jill { namespace dsp {
+
+size_t
+count_crossings(float const * samples, size_t size, float thresh)
+{
+        return selected().f(samples, size, thresh);
+}
+
+size_t
+count_crossings(double const * samples, size_t size, double thresh)
+{
+        return selected().d(samples, size, thresh);
+}
+
+size_t
+find_outside(float const * samples, size_t size, float lo, float hi)
+{
+        return selected().find(samples, size, lo, hi);
+}
+
+char const *
+crossings_isa()
+{
+        static char const * names[] = { "scalar", "sse2", "avx2" };
+        return names[selected().isa];
+}
+
+}} // namespace jill::dsp
@@ -0,0 +1,90 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _CROSSINGS_HH
+#define _CROSSINGS_HH
+
+#include <cstddef>
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup dspgroup
+ * @brief count positive threshold crossings in a buffer
+ *
+ * Counts the number of indices i in [1, size) where samples[i-1] < thresh and
+ * samples[i] >= thresh. Comparisons with NaN are false, so NaNs never cross.
+ *
+ * The float and double versions compare many samples at once with SIMD
+ * instructions (SSE2 or AVX2, selected at runtime); other types use
+ * a scalar loop. All versions give the same result.
+ */
+template <typename T>
+std::size_t
+count_crossings(T const * samples, std::size_t size, T thresh)
+{
+        std::size_t count = 0;
+        for (std::size_t i = 1; i < size; ++i)
+                count += (samples[i-1] < thresh && samples[i] >= thresh);
+        return count;
+}
+
+/**
+ * Locate the kth positive threshold crossing in a buffer (counting from 1),
+ * using the same definition as count_crossings().
+ *
+ * @return the index i of the sample at which the crossing occurred, or size
+ *         if there are fewer than k crossings
+ */
+template <typename T>
+std::size_t
+find_crossing(T const * samples, std::size_t size, T thresh, std::size_t k)
+{
+        for (std::size_t i = 1; i < size; ++i) {
+                if (samples[i-1] < thresh && samples[i] >= thresh && --k == 0)
+                        return i;
+        }
+        return size;
+}
+
+std::size_t count_crossings(float const * samples, std::size_t size, float thresh);
+std::size_t count_crossings(double const * samples, std::size_t size, double thresh);
+
+/**
+ * @ingroup dspgroup
+ * @brief find the first sample outside a range
+ *
+ * Scans a buffer for the first sample that is below lo or above hi. Use -inf
+ * or +inf for one-sided thresholds. NaNs are never outside the range. Like
+ * count_crossings, the float version compares many samples at once, so it's
+ * fast when most of the samples are inside the range.
+ *
+ * @return the index of the sample, or size if all the samples are in range
+ */
+template <typename T>
+std::size_t
+find_outside(T const * samples, std::size_t size, T lo, T hi)
+{
+        for (std::size_t i = 0; i < size; ++i) {
+                if (samples[i] < lo || samples[i] > hi)
+                        return i;
+        }
+        return size;
+}
+
+std::size_t find_outside(float const * samples, std::size_t size, float lo, float hi);
+
+/** @return the name of the instruction set used by count_crossings() and find_outside() */
+char const * crossings_isa();
+
+}} // namespace jill::dsp
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include "fft.hh"
+
+#ifdef JILL_WITH_FFTW
+#include <fftw3.h>
+#endif
+
+using namespace jill::dsp;
+using std::size_t;
+
+#ifdef JILL_WITH_FFTW
+
+fft::fft(size_t size)
+        : _size(size)
+{
+        if (size < 4 || (size & (size - 1)))
+                throw std::invalid_argument("FFT size must be a power of two");
+        _real = static_cast<value_type *>(fftw_malloc(sizeof(value_type) * size));
+        _spectrum = static_cast<complex_type *>(fftw_malloc(sizeof(complex_type) * nbins()));
+        fftw_complex * spectrum = reinterpret_cast<fftw_complex *>(_spectrum);
+        _forward_plan = fftw_plan_dft_r2c_1d(size, _real, spectrum, FFTW_MEASURE);
+        _inverse_plan = fftw_plan_dft_c2r_1d(size, spectrum, _real, FFTW_MEASURE);
+}
+
+fft::~fft()
+{
+        fftw_destroy_plan(static_cast<fftw_plan>(_forward_plan));
+        fftw_destroy_plan(static_cast<fftw_plan>(_inverse_plan));
+        fftw_free(_real);
+        fftw_free(_spectrum);
+}
+
+void
+fft::forward(value_type const * in, complex_type * out)
+{
+        std::copy(in, in + _size, _real);
+        fftw_execute(static_cast<fftw_plan>(_forward_plan));
+        std::copy(_spectrum, _spectrum + nbins(), out);
+}
+
+void
+fft::inverse(complex_type const * in, value_type * out)
+{
+        // c2r overwrites its input, so it always works on the internal copy
+        std::copy(in, in + nbins(), _spectrum);
+        fftw_execute(static_cast<fftw_plan>(_inverse_plan));
+        const value_type scale = 1.0 / _size;
+        for (size_t i = 0; i < _size; ++i)
+                out[i] = _real[i] * scale;
+}
+
+char const *
+fft::implementation()
+{
+        return "fftw";
+}
+
+#else
+
+fft::fft(size_t size)
+        : _size(size)
+{
+        if (size < 4 || (size & (size - 1)))
+                throw std::invalid_argument("FFT size must be a power of two");
+        const size_t m = size / 2;
+        const value_type pi = std::acos(-1.0);
+        _bitrev.resize(m);
+        size_t bits = 0;
+        while ((size_t(1) << bits) < m) ++bits;
+        for (size_t i = 0; i < m; ++i) {
+                size_t r = 0;
+                for (size_t b = 0; b < bits; ++b)
+                        if (i & (size_t(1) << b)) r |= size_t(1) << (bits - 1 - b);
+                _bitrev[i] = r;
+        }
+        // twiddle factors for each stage of the transform, in order
+        _twiddle.clear();
+        for (size_t half = 1; half < m; half *= 2) {
+                for (size_t j = 0; j < half; ++j)
+                        _twiddle.push_back(std::polar(1.0, -pi * j / half));
+        }
+        _split.resize(m + 1);
+        for (size_t k = 0; k <= m; ++k)
+                _split[k] = std::polar(1.0, -2 * pi * k / size);
+        _buffer.resize(m);
+}
+
+fft::~fft() {}
+
+/*
+ * In-place complex transform of length size/2. The twiddle factors for each
+ * stage are stored contiguously, and the complex arithmetic is written out to
+ * avoid the overhead of the C99 complex multiply.
+ */
+void
+fft::_transform(complex_type * data, bool inverse) const
+{
+        const size_t m = _size / 2;
+        for (size_t i = 0; i < m; ++i) {
+                if (i < _bitrev[i])
+                        std::swap(data[i], data[_bitrev[i]]);
+        }
+        value_type * d = reinterpret_cast<value_type *>(data);
+        const value_type sign = (inverse) ? -1.0 : 1.0;
+        complex_type const * stage = &_twiddle[0];
+        for (size_t half = 1; half < m; half *= 2) {
+                const size_t len = 2 * half;
+                for (size_t i = 0; i < m; i += len) {
+                        value_type * u = d + 2 * i;
+                        value_type * v = d + 2 * (i + half);
+                        for (size_t j = 0; j < half; ++j) {
+                                const value_type wr = stage[j].real();
+                                const value_type wi = sign * stage[j].imag();
+                                const value_type vr = v[2*j] * wr - v[2*j+1] * wi;
+                                const value_type vi = v[2*j] * wi + v[2*j+1] * wr;
+                                v[2*j] = u[2*j] - vr;
+                                v[2*j+1] = u[2*j+1] - vi;
+                                u[2*j] += vr;
+                                u[2*j+1] += vi;
+                        }
+                }
+                stage += half;
+        }
+}
+
+/*
+ * The even and odd samples are packed into the real and imaginary parts of a
+ * sequence of half the length. Its transform Z gives the transforms of the
+ * even (E) and odd (O) samples, which are combined as X[k] = E[k] + W^k O[k].
+ */
+void
+fft::forward(value_type const * in, complex_type * out)
+{
+        const size_t m = _size / 2;
+        complex_type * z = &_buffer[0];
+        for (size_t k = 0; k < m; ++k)
+                z[k] = complex_type(in[2*k], in[2*k+1]);
+        _transform(z, false);
+        // bins 0 and m only involve Z[0]
+        out[0] = complex_type(z[0].real() + z[0].imag(), 0);
+        out[m] = complex_type(z[0].real() - z[0].imag(), 0);
+        for (size_t k = 1; k < m; ++k) {
+                const value_type er = 0.5 * (z[k].real() + z[m-k].real());
+                const value_type ei = 0.5 * (z[k].imag() - z[m-k].imag());
+                const value_type or_ = 0.5 * (z[k].imag() + z[m-k].imag());
+                const value_type oi = -0.5 * (z[k].real() - z[m-k].real());
+                const value_type wr = _split[k].real(), wi = _split[k].imag();
+                out[k] = complex_type(er + wr * or_ - wi * oi, ei + wr * oi + wi * or_);
+        }
+}
+
+void
+fft::inverse(complex_type const * in, value_type * out)
+{
+        const size_t m = _size / 2;
+        complex_type * z = &_buffer[0];
+        for (size_t k = 0; k < m; ++k) {
+                const value_type er = 0.5 * (in[k].real() + in[m-k].real());
+                const value_type ei = 0.5 * (in[k].imag() - in[m-k].imag());
+                const value_type dr = 0.5 * (in[k].real() - in[m-k].real());
+                const value_type di = 0.5 * (in[k].imag() + in[m-k].imag());
+                // O = D conj(W^k), Z = E + iO
+                const value_type wr = _split[k].real(), wi = _split[k].imag();
+                const value_type or_ = dr * wr + di * wi;
+                const value_type oi = di * wr - dr * wi;
+                z[k] = complex_type(er - oi, ei + or_);
+        }
+        _transform(z, true);
+        const value_type scale = 1.0 / m;
+        for (size_t k = 0; k < m; ++k) {
+                out[2*k] = z[k].real() * scale;
+                out[2*k+1] = z[k].imag() * scale;
+        }
+}
+
+char const *
+fft::implementation()
+{
+        return "radix-2";
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _FFT_HH
+#define _FFT_HH
+
+#include <vector>
+#include <complex>
+#include <boost/noncopyable.hpp>
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup dspgroup
+ * @brief FFT of real-valued signals
+ *
+ * Computes forward and inverse transforms of real sequences whose length is a
+ * power of two. The default implementation is an iterative radix-2 transform
+ * of half the length, with the real input packed into the real and imaginary
+ * parts. If the library is built with FFTW (scons fftw=1), FFTW plans are used
+ * instead. All tables and plans are created by the constructor, so the
+ * transforms themselves don't allocate.
+ */
+class fft : boost::noncopyable {
+public:
+        typedef double value_type;
+        typedef std::complex<value_type> complex_type;
+
+        /**
+         * Initialize the transform.
+         *
+         * @param size  the length of the real sequence. Must be a power of two
+         *              and at least 4.
+         * @throws std::invalid_argument if the size is not valid
+         */
+        explicit fft(std::size_t size);
+        ~fft();
+
+        /** @return the length of the real sequence */
+        std::size_t size() const { return _size; }
+        /** @return the number of complex values in the spectrum (size/2 + 1) */
+        std::size_t nbins() const { return _size / 2 + 1; }
+
+        /**
+         * Forward transform.
+         *
+         * @param in   size() real values
+         * @param out  nbins() complex values, from DC to the Nyquist frequency
+         */
+        void forward(value_type const * in, complex_type * out);
+
+        /**
+         * Inverse transform, scaled so that inverse(forward(x)) == x.
+         *
+         * @param in   nbins() complex values
+         * @param out  size() real values
+         */
+        void inverse(complex_type const * in, value_type * out);
+
+        /** @return the name of the implementation */
+        static char const * implementation();
+
+private:
+        std::size_t _size;
+#ifdef JILL_WITH_FFTW
+        void * _forward_plan;
+        void * _inverse_plan;
+        value_type * _real;
+        complex_type * _spectrum;
+#else
+        void _transform(complex_type * data, bool inverse) const;
+
+        // bit-reversed indices and twiddle factors for the half-length transform
+        std::vector<std::size_t> _bitrev;
+        std::vector<complex_type> _twiddle;
+        // twiddle factors for separating the packed transform
+        std::vector<complex_type> _split;
+        std::vector<complex_type> _buffer;
+#endif
+};
+
+}} // namespace jill::dsp
+
+#endif
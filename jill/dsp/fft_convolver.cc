@@ -0,0 +1,107 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <algorithm>
+#include "fft_convolver.hh"
+
+using namespace jill::dsp;
+using jill::nframes_t;
+using std::size_t;
+
+fft_convolver::fft_convolver(std::vector<value_type> const & taps, nframes_t block_size)
+        : _block_size(block_size), _ntaps(taps.size()),
+          _npartitions(std::max<size_t>((taps.size() + block_size - 1) / block_size, 1)),
+          _fft(2 * block_size),
+          _filter(_npartitions * _fft.nbins()),
+          _accumulator(_fft.nbins()),
+          _output(2 * block_size)
+{
+        // each partition is zero-padded to twice the block size
+        std::vector<value_type> partition(2 * block_size);
+        for (size_t p = 0; p < _npartitions; ++p) {
+                std::fill(partition.begin(), partition.end(), 0);
+                size_t start = p * block_size;
+                size_t stop = std::min(start + block_size, taps.size());
+                if (start < stop)
+                        std::copy(taps.begin() + start, taps.begin() + stop, partition.begin());
+                _fft.forward(&partition[0], &_filter[p * _fft.nbins()]);
+        }
+}
+
+fft_convolver::channel_t
+fft_convolver::add_channel()
+{
+        channel_state state;
+        state.history.assign(2 * _block_size, 0);
+        state.spectra.assign(_npartitions * _fft.nbins(), 0);
+        state.position = 0;
+        _channels.push_back(state);
+        return _channels.size() - 1;
+}
+
+void
+fft_convolver::process(sample_type const * in, sample_type * out, channel_t channel,
+                       nframes_t nframes)
+{
+        channel_state & state = _channels[channel];
+        for (nframes_t i = 0; i + _block_size <= nframes; i += _block_size)
+                _process_block(in + i, out + i, state);
+}
+
+void
+fft_convolver::_process_block(sample_type const * in, sample_type * out, channel_state & state)
+{
+        const size_t B = _block_size;
+        const size_t nbins = _fft.nbins();
+        value_type * history = &state.history[0];
+
+        // slide the input window and transform it into the next slot
+        std::copy(history + B, history + 2 * B, history);
+        std::copy(in, in + B, history + B);
+        complex_type * spectra = &state.spectra[0];
+        _fft.forward(history, spectra + state.position * nbins);
+
+        // multiply the most recent input spectra with the filter partitions
+        // (written out to avoid the overhead of the C99 complex multiply)
+        value_type * acc = reinterpret_cast<value_type *>(&_accumulator[0]);
+        std::fill(acc, acc + 2 * nbins, 0);
+        size_t slot = state.position;
+        for (size_t p = 0; p < _npartitions; ++p) {
+                value_type const * x = reinterpret_cast<value_type const *>(spectra + slot * nbins);
+                value_type const * h = reinterpret_cast<value_type const *>(&_filter[p * nbins]);
+                for (size_t k = 0; k < 2 * nbins; k += 2) {
+                        acc[k] += x[k] * h[k] - x[k+1] * h[k+1];
+                        acc[k+1] += x[k] * h[k+1] + x[k+1] * h[k];
+                }
+                slot = (slot == 0) ? _npartitions - 1 : slot - 1;
+        }
+        state.position = (state.position + 1) % _npartitions;
+
+        // the first half of the result is wrapped around; the second half is valid
+        _fft.inverse(&_accumulator[0], &_output[0]);
+        std::copy(_output.begin() + B, _output.end(), out);
+}
+
+void
+fft_convolver::reset()
+{
+        for (size_t c = 0; c < _channels.size(); ++c)
+                reset(c);
+}
+
+void
+fft_convolver::reset(channel_t channel)
+{
+        channel_state & state = _channels[channel];
+        std::fill(state.history.begin(), state.history.end(), 0);
+        std::fill(state.spectra.begin(), state.spectra.end(), complex_type(0));
+        state.position = 0;
+}
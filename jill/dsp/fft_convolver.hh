@@ -0,0 +1,106 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _FFT_CONVOLVER_HH
+#define _FFT_CONVOLVER_HH
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "../types.hh"
+#include "fft.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup dspgroup
+ * @brief FIR filtering by FFT convolution
+ *
+ * Implements a uniformly partitioned overlap-save convolution. The impulse
+ * response is split into partitions the same length as the block size, and
+ * the spectrum of each partition is computed once. Each block of input is
+ * transformed with the previous block, and the spectra of the most recent
+ * blocks are multiplied with the partition spectra and summed. The last half
+ * of the inverse transform is the output. Because the block size is the same
+ * as the JACK period, the output for each period is available at the end of
+ * the same period, with no added latency.
+ *
+ * For N taps and a block size of B, the cost per sample is O(log B) for the
+ * transforms plus O(N / B) for the spectral products, one complex
+ * multiply-add per partition. It's still linear in the number of taps, but
+ * with a constant about B times smaller than direct convolution, so this is
+ * much faster for long filters.
+ */
+class fft_convolver : boost::noncopyable {
+public:
+        typedef sample_t sample_type;
+        typedef fft::value_type value_type;
+        typedef fft::complex_type complex_type;
+        typedef std::size_t channel_t;
+
+        /**
+         * Initialize the convolver.
+         *
+         * @param taps        the impulse response of the filter
+         * @param block_size  the number of samples processed at a time. Must be
+         *                    a power of two.
+         */
+        fft_convolver(std::vector<value_type> const & taps, nframes_t block_size);
+
+        /** Allocate state for a new channel. Not safe to call in the process callback. */
+        channel_t add_channel();
+
+        /**
+         * Filter a buffer. Uses only preallocated storage.
+         *
+         * @param in       the input samples
+         * @param out      the output samples. May be the same as in.
+         * @param channel  the channel handle
+         * @param nframes  the number of samples. Must be a multiple of the block size.
+         */
+        void process(sample_type const * in, sample_type * out, channel_t channel,
+                     nframes_t nframes);
+
+        /** reset the state of all channels */
+        void reset();
+        /** reset the state of one channel */
+        void reset(channel_t channel);
+
+        nframes_t block_size() const { return _block_size; }
+        std::size_t ntaps() const { return _ntaps; }
+        std::size_t npartitions() const { return _npartitions; }
+        std::size_t nchannels() const { return _channels.size(); }
+
+private:
+        struct channel_state {
+                // the previous and current blocks of input
+                std::vector<value_type> history;
+                // spectra of the last npartitions blocks of input
+                std::vector<complex_type> spectra;
+                std::size_t position;
+        };
+
+        void _process_block(sample_type const * in, sample_type * out, channel_state & state);
+
+        nframes_t _block_size;
+        std::size_t _ntaps;
+        std::size_t _npartitions;
+        fft _fft;
+        // spectra of the partitions of the impulse response
+        std::vector<complex_type> _filter;
+        std::vector<channel_state> _channels;
+        // scratch space
+        std::vector<complex_type> _accumulator;
+        std::vector<value_type> _output;
+};
+
+}} // namespace jill::dsp
+
+#endif
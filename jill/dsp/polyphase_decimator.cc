@@ -0,0 +1,81 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <algorithm>
+#include "polyphase_decimator.hh"
+
+using namespace jill::dsp;
+using jill::nframes_t;
+using std::size_t;
+
+polyphase_decimator::polyphase_decimator(nframes_t factor, std::vector<value_type> const & taps,
+                                         nframes_t period_size)
+        : _factor(std::max<nframes_t>(factor, 1)), _period_size(0),
+          _taps(taps.rbegin(), taps.rend())
+{
+        if (_taps.empty())
+                _taps.push_back(1.0);
+        set_period_size(period_size);
+}
+
+polyphase_decimator::channel_t
+polyphase_decimator::add_channel()
+{
+        _history.resize(_history.size() + _taps.size() - 1, 0);
+        _phase.push_back(0);
+        return _phase.size() - 1;
+}
+
+void
+polyphase_decimator::set_period_size(nframes_t nframes)
+{
+        _period_size = std::max<nframes_t>(nframes, 1);
+        _scratch.resize(_taps.size() - 1 + _period_size);
+}
+
+nframes_t
+polyphase_decimator::process(sample_type const * in, sample_type * out, channel_t channel,
+                             nframes_t nframes, nframes_t * offset)
+{
+        const size_t nhist = _taps.size() - 1;
+        value_type * history = &_history[0] + channel * nhist;
+        value_type const * taps = &_taps[0];
+        nframes_t & phase = _phase[channel];
+        nframes_t nout = 0;
+        if (offset) *offset = phase;
+
+        // the scratch buffer holds at most one period of input
+        for (nframes_t start = 0; start < nframes; start += _period_size) {
+                const nframes_t n = std::min(_period_size, nframes - start);
+                value_type * x = &_scratch[0];
+                std::copy(history, history + nhist, x);
+                std::copy(in + start, in + start + n, x + nhist);
+                // output i depends on inputs i-ntaps+1 .. i, at x[i] .. x[i+nhist]
+                nframes_t i = phase;
+                for (; i < n; i += _factor) {
+                        value_type y = 0;
+                        value_type const * window = x + i;
+                        for (size_t k = 0; k <= nhist; ++k)
+                                y += taps[k] * window[k];
+                        out[nout++] = y;
+                }
+                phase = i - n;
+                std::copy(x + n, x + n + nhist, history);
+        }
+        return nout;
+}
+
+void
+polyphase_decimator::reset()
+{
+        std::fill(_history.begin(), _history.end(), 0);
+        std::fill(_phase.begin(), _phase.end(), 0);
+}
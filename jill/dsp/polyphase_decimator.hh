@@ -0,0 +1,99 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _POLYPHASE_DECIMATOR_HH
+#define _POLYPHASE_DECIMATOR_HH
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "../types.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup dspgroup
+ * @brief FIR anti-alias filtering and decimation
+ *
+ * Reduces the sampling rate of a signal by an integer factor M. The signal is
+ * low-pass filtered by an FIR filter (e.g. from digital_filter::firwin) and
+ * only every Mth output is kept. Only the retained outputs are calculated, so
+ * the cost is ntaps/M multiplications per input sample; this is equivalent to
+ * running the M polyphase components of the filter at the lower rate.
+ *
+ * The decimation phase carries over between calls, so the number of output
+ * samples varies if the period size isn't a multiple of M. All channels added
+ * before the first call to process() stay aligned with each other.
+ */
+class polyphase_decimator : boost::noncopyable {
+public:
+        typedef sample_t sample_type;
+        typedef double value_type;
+        typedef std::size_t channel_t;
+
+        /**
+         * Initialize the decimator.
+         *
+         * @param factor  the decimation factor
+         * @param taps    the coefficients of the anti-aliasing filter
+         * @param period_size  the maximum number of samples passed to process()
+         */
+        polyphase_decimator(nframes_t factor, std::vector<value_type> const & taps,
+                            nframes_t period_size);
+
+        /** Allocate state for a new channel. Not safe in the process callback. */
+        channel_t add_channel();
+
+        /** Change the maximum period size. Not safe in the process callback. */
+        void set_period_size(nframes_t nframes);
+
+        /**
+         * Filter and decimate a buffer. Uses only preallocated storage.
+         *
+         * @param in       the input samples
+         * @param out      the output buffer; must have room for max_output(nframes) samples
+         * @param channel  the channel handle
+         * @param nframes  the number of input samples
+         * @param offset   if not null, set to the index of the input sample
+         *                 corresponding to the first output sample
+         * @return the number of output samples
+         */
+        nframes_t process(sample_type const * in, sample_type * out, channel_t channel,
+                          nframes_t nframes, nframes_t * offset=0);
+
+        /** reset the state of all channels */
+        void reset();
+
+        /** @return the largest number of outputs for nframes of input */
+        nframes_t max_output(nframes_t nframes) const {
+                return (nframes + _factor - 1) / _factor;
+        }
+        nframes_t factor() const { return _factor; }
+        std::size_t ntaps() const { return _taps.size(); }
+        std::size_t nchannels() const { return _phase.size(); }
+        /** @return the group delay of a linear-phase filter, in input samples */
+        double delay() const { return (_taps.size() - 1) / 2.0; }
+
+private:
+        nframes_t _factor;
+        nframes_t _period_size;
+        // taps in reverse order, so each output is a dot product with the history
+        std::vector<value_type> _taps;
+        // the last ntaps-1 input samples for each channel
+        std::vector<value_type> _history;
+        // the index of the next output sample relative to the next input block
+        std::vector<nframes_t> _phase;
+        // history followed by the current block of input
+        std::vector<value_type> _scratch;
+};
+
+}} // namespace jill::dsp
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cstring>
+#include <algorithm>
+#include "sos_lockstep.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JILL_LOCKSTEP_X86 1
+#endif
+
+using namespace jill::dsp;
+using jill::biquad_t;
+using jill::nframes_t;
+using std::size_t;
+
+namespace {
+
+typedef sos_lockstep::sample_type sample_type;
+typedef sos_lockstep::value_type value_type;
+
+/* number of frames processed at a time; the block is kept on the stack */
+const nframes_t chunk_frames = 256;
+
+/* a vector of N doubles. This should be the native register width of the ISA
+ * the calling function is compiled for; wider vectors are spilled to memory */
+template <int N>
+struct lane_vector {
+        typedef value_type type __attribute__((vector_size(N * sizeof(value_type))));
+};
+
+/*
+ * Filter 2N channels in lockstep, using two registers of N doubles so that
+ * two independent dependency chains are in flight. Samples are transposed into
+ * a block, the sections are run over the block one at a time (keeping the
+ * state and coefficients in registers), and the result is transposed back out.
+ * The state for section i is at state[4*N*i] (first variable) and
+ * state[4*N*i + 2*N] (second variable).
+ */
+template <int N>
+inline __attribute__((always_inline)) void
+filter_block(biquad_t const * sections, size_t nsections, value_type * state,
+             sample_type const * const * in, sample_type * const * out, nframes_t nframes)
+{
+        typedef typename lane_vector<N>::type vector_type;
+        const int W = 2 * N;
+        vector_type block[2 * chunk_frames];
+        // the same block, indexed by frame * W + channel
+        value_type * flat = reinterpret_cast<value_type *>(block);
+
+        for (nframes_t start = 0; start < nframes; start += chunk_frames) {
+                const nframes_t n = std::min(chunk_frames, nframes - start);
+                for (int c = 0; c < W; ++c) {
+                        if (in[c]) {
+                                sample_type const * x = in[c] + start;
+                                for (nframes_t k = 0; k < n; ++k)
+                                        flat[k * W + c] = x[k];
+                        }
+                        else {
+                                for (nframes_t k = 0; k < n; ++k)
+                                        flat[k * W + c] = 0;
+                        }
+                }
+                for (size_t i = 0; i < nsections; ++i) {
+                        const value_type b0 = sections[i].b0, b1 = sections[i].b1,
+                                b2 = sections[i].b2, a1 = sections[i].a1, a2 = sections[i].a2;
+                        value_type * s = state + 2 * W * i;
+                        vector_type s1a, s1b, s2a, s2b;
+                        std::memcpy(&s1a, s, sizeof(vector_type));
+                        std::memcpy(&s1b, s + N, sizeof(vector_type));
+                        std::memcpy(&s2a, s + W, sizeof(vector_type));
+                        std::memcpy(&s2b, s + W + N, sizeof(vector_type));
+                        for (nframes_t k = 0; k < n; ++k) {
+                                const vector_type xa = block[2*k], xb = block[2*k+1];
+                                const vector_type ya = b0 * xa + s1a;
+                                const vector_type yb = b0 * xb + s1b;
+                                s1a = b1 * xa - a1 * ya + s2a;
+                                s1b = b1 * xb - a1 * yb + s2b;
+                                s2a = b2 * xa - a2 * ya;
+                                s2b = b2 * xb - a2 * yb;
+                                block[2*k] = ya;
+                                block[2*k+1] = yb;
+                        }
+                        std::memcpy(s, &s1a, sizeof(vector_type));
+                        std::memcpy(s + N, &s1b, sizeof(vector_type));
+                        std::memcpy(s + W, &s2a, sizeof(vector_type));
+                        std::memcpy(s + W + N, &s2b, sizeof(vector_type));
+                }
+                for (int c = 0; c < W; ++c) {
+                        if (out[c] == 0) continue;
+                        sample_type * y = out[c] + start;
+                        for (nframes_t k = 0; k < n; ++k)
+                                y[k] = flat[k * W + c];
+                }
+        }
+}
+
+/* the same calculation for a single channel */
+void
+filter_channel(biquad_t const * sections, size_t nsections, value_type * state,
+               sample_type const * in, sample_type * out, nframes_t nframes)
+{
+        if (out == 0) return;
+        for (nframes_t k = 0; k < nframes; ++k) {
+                value_type x = (in) ? in[k] : 0;
+                for (size_t i = 0; i < nsections; ++i) {
+                        biquad_t const & b = sections[i];
+                        value_type * s = state + 2 * i;
+                        value_type y = b.b0 * x + s[0];
+                        s[0] = b.b1 * x - b.a1 * y + s[1];
+                        s[1] = b.b2 * x - b.a2 * y;
+                        x = y;
+                }
+                out[k] = x;
+        }
+}
+
+/*
+ * One entry point per instruction set. Each runs as many full blocks as it
+ * can and returns the number of channels processed.
+ */
+#define LOCKSTEP_ENTRY(name, N, target)                                 \
+        target size_t                                                   \
+        name(biquad_t const * sections, size_t nsections, value_type * state, \
+             sample_type const * const * in, sample_type * const * out, \
+             size_t nchannels, nframes_t nframes)                       \
+        {                                                               \
+                size_t c = 0;                                           \
+                for (; c + 2 * N <= nchannels; c += 2 * N)              \
+                        filter_block<N>(sections, nsections, state + 2 * nsections * c, \
+                                        in + c, out + c, nframes);      \
+                return c;                                               \
+        }
+
+#ifdef JILL_LOCKSTEP_X86
+LOCKSTEP_ENTRY(filter_sse2, 2, __attribute__((target("sse2"))))
+LOCKSTEP_ENTRY(filter_avx2, 4, __attribute__((target("avx2,fma"))))
+LOCKSTEP_ENTRY(filter_avx512, 8, __attribute__((target("avx512f"))))
+#endif
+
+#undef LOCKSTEP_ENTRY
+
+} // anonymous namespace
+
+sos_lockstep::sos_lockstep(std::vector<biquad_t> const & sections, size_t nchannels,
+                           isa_type isa)
+        : _sections(sections), _nchannels(nchannels), _isa(std::min(isa, best_isa())),
+          _state(2 * sections.size() * nchannels, 0)
+{}
+
+void
+sos_lockstep::process(sample_type const * const * in, sample_type * const * out,
+                      nframes_t nframes)
+{
+        const size_t nsections = _sections.size();
+        if (nsections == 0 || _nchannels == 0) return;
+        biquad_t const * sections = &_sections[0];
+        value_type * state = &_state[0];
+        size_t c = 0;
+        switch (_isa) {
+#ifdef JILL_LOCKSTEP_X86
+        case AVX512:
+                c = filter_avx512(sections, nsections, state, in, out, _nchannels, nframes);
+                break;
+        case AVX2:
+                c = filter_avx2(sections, nsections, state, in, out, _nchannels, nframes);
+                break;
+        case SSE2:
+                c = filter_sse2(sections, nsections, state, in, out, _nchannels, nframes);
+                break;
+#endif
+        default:
+                break;
+        }
+        for (; c < _nchannels; ++c)
+                filter_channel(sections, nsections, state + 2 * nsections * c,
+                               in[c], out[c], nframes);
+}
+
+void
+sos_lockstep::reset()
+{
+        std::fill(_state.begin(), _state.end(), 0);
+}
+
+size_t
+sos_lockstep::lanes() const
+{
+        switch (_isa) {
+        case AVX512: return 16;
+        case AVX2: return 8;
+        case SSE2: return 4;
+        default: return 1;
+        }
+}
+
+sos_lockstep::isa_type
+sos_lockstep::best_isa()
+{
+#ifdef JILL_LOCKSTEP_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+                return AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                return AVX2;
+        if (__builtin_cpu_supports("sse2"))
+                return SSE2;
+#endif
+        return SCALAR;
+}
+
+char const *
+sos_lockstep::isa_name(isa_type isa)
+{
+        switch (isa) {
+        case AVX512: return "avx512";
+        case AVX2: return "avx2";
+        case SSE2: return "sse2";
+        default: return "scalar";
+        }
+}
@@ -0,0 +1,91 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _SOS_LOCKSTEP_HH
+#define _SOS_LOCKSTEP_HH
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "../types.hh"
+#include "../transfer_function.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup dspgroup
+ * @brief multichannel filtering with cascaded second-order sections
+ *
+ * An IIR filter can't be vectorized along the time axis, because each output
+ * depends on the previous one. However, when many channels share the same
+ * coefficients, the channels can be filtered in lockstep, with each channel
+ * occupying one lane of a SIMD register. This class groups channels into
+ * blocks of 4 (SSE2), 8 (AVX2), or 16 (AVX-512) and runs the transposed direct
+ * form II kernel used by digital_filter on each block. The instruction set is
+ * selected at runtime. Any channels left over after the last full block are
+ * filtered one at a time. Calculations are in double precision.
+ */
+class sos_lockstep : boost::noncopyable {
+public:
+        typedef sample_t sample_type;
+        typedef double value_type;
+
+        /** instruction sets, in increasing order of vector width */
+        enum isa_type { SCALAR = 0, SSE2, AVX2, AVX512 };
+
+        /**
+         * Initialize the filter.
+         *
+         * @param sections   the second-order sections (see transfer_function::sos)
+         * @param nchannels  the number of channels to filter
+         * @param isa        the instruction set to use. If the processor
+         *                   doesn't support it, the best available one is used.
+         */
+        sos_lockstep(std::vector<biquad_t> const & sections, std::size_t nchannels,
+                     isa_type isa=AVX512);
+
+        /**
+         * Filter one period of data from all the channels. Uses no locks and
+         * does no allocation, so it's safe to call in the process thread.
+         *
+         * @param in       array of nchannels input buffers. A null pointer
+         *                 is treated as a buffer of zeros.
+         * @param out      array of nchannels output buffers. Can be the same
+         *                 as the input buffers. Null pointers are skipped.
+         * @param nframes  the number of samples in each buffer
+         */
+        void process(sample_type const * const * in, sample_type * const * out,
+                     nframes_t nframes);
+
+        /** Reset the filter state of all channels to zero */
+        void reset();
+
+        std::size_t nchannels() const { return _nchannels; }
+        std::size_t nsections() const { return _sections.size(); }
+        /** @return the number of channels filtered together */
+        std::size_t lanes() const;
+        isa_type isa() const { return _isa; }
+
+        /** @return the widest instruction set supported by the processor */
+        static isa_type best_isa();
+        static char const * isa_name(isa_type);
+
+private:
+        std::vector<biquad_t> _sections;
+        std::size_t _nchannels;
+        isa_type _isa;
+        // state for each section (two variables) for each channel, stored
+        // so that channels in a block are contiguous
+        std::vector<value_type> _state;
+};
+
+}} // namespace jill::dsp
+
+#endif
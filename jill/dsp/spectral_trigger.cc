@@ -0,0 +1,204 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include "spectral_trigger.hh"
+
+using namespace jill::dsp;
+using jill::nframes_t;
+using std::size_t;
+
+/*
+ * The spectrum is stored as interleaved real and imaginary parts. Two vectors
+ * holding two complex values each are squared, and the even and odd lanes are
+ * shuffled together and added to give four power values. GCC lowers the
+ * generic vectors to whatever the target supports (two SSE2 operations on a
+ * baseline x86-64 build).
+ */
+void
+jill::dsp::power_spectrum(fft::complex_type const * in, fft::value_type * out, size_t size)
+{
+        typedef fft::value_type value_type;
+        typedef value_type vector_type __attribute__((vector_size(4 * sizeof(value_type))));
+        typedef long long mask_type __attribute__((vector_size(4 * sizeof(long long))));
+        const mask_type even = { 0, 2, 4, 6 };
+        const mask_type odd = { 1, 3, 5, 7 };
+
+        value_type const * x = reinterpret_cast<value_type const *>(in);
+        size_t k = 0;
+        for (; k + 4 <= size; k += 4) {
+                vector_type a, b;
+                std::memcpy(&a, x + 2 * k, sizeof(vector_type));
+                std::memcpy(&b, x + 2 * k + 4, sizeof(vector_type));
+                a *= a;
+                b *= b;
+                vector_type p = __builtin_shuffle(a, b, even) + __builtin_shuffle(a, b, odd);
+                std::memcpy(out + k, &p, sizeof(vector_type));
+        }
+        for (; k < size; ++k)
+                out[k] = x[2*k] * x[2*k] + x[2*k+1] * x[2*k+1];
+}
+
+spectral_trigger::spectral_trigger(nframes_t sampling_rate, size_type nfft, size_type hop,
+                                   double band_low, double band_high, statistic_type statistic,
+                                   double othresh, size_type owindow,
+                                   double cthresh, size_type cwindow,
+                                   double floor)
+        : _fft(nfft), _hop(hop), _statistic(statistic), _floor(floor * floor),
+          _othresh(othresh), _cthresh(cthresh),
+          _owindow(std::max<size_type>(owindow, 1)), _cwindow(std::max<size_type>(cwindow, 1)),
+          _window(nfft), _history(nfft, 0), _position(0), _since_frame(0),
+          _frame(nfft), _spectrum(_fft.nbins()), _power(_fft.nbins()),
+          _open_counter(_owindow), _close_counter(_cwindow),
+          _open(false), _last(0)
+{
+        if (hop < 1 || hop > nfft)
+                throw std::invalid_argument("hop size must be between 1 and the window size");
+        if (band_low >= band_high)
+                throw std::invalid_argument("signal band is empty");
+        // bins whose center frequencies are in the band, excluding DC
+        const double df = double(sampling_rate) / nfft;
+        _band_first = std::max<size_type>(std::ceil(band_low / df), 1);
+        _band_last = std::min<size_type>(std::floor(band_high / df), _fft.nbins() - 1);
+        if (_band_last < _band_first + 1)
+                throw std::invalid_argument("signal band is narrower than two frequency bins");
+
+        const double pi = std::acos(-1.0);
+        _window_power = 0;
+        for (size_type i = 0; i < nfft; ++i) {
+                _window[i] = 0.5 - 0.5 * std::cos(2 * pi * i / nfft);
+                _window_power += _window[i] * _window[i];
+        }
+}
+
+spectral_trigger::value_type
+spectral_trigger::average() const
+{
+        if (_open)
+                return _close_counter.running_count() / _cwindow;
+        return _open_counter.running_count() / _owindow;
+}
+
+spectral_trigger::statistic_type
+spectral_trigger::parse_statistic(std::string const & name)
+{
+        if (name == "ratio")
+                return BAND_RATIO;
+        else if (name == "entropy")
+                return TONALITY;
+        throw std::invalid_argument("unknown spectral statistic: " + name);
+}
+
+void
+spectral_trigger::reset()
+{
+        std::fill(_history.begin(), _history.end(), 0);
+        _position = 0;
+        _since_frame = 0;
+        _open_counter.reset();
+        _close_counter.reset();
+        _open = false;
+        _last = 0;
+}
+
+int
+spectral_trigger::push(sample_type const * samples, size_type size, sample_type * stats)
+{
+        int ret = -1;
+        const size_type nfft = _history.size();
+        size_type i = 0;
+        while (i < size) {
+                // copy up to the end of the frame or the end of the history
+                size_type n = std::min(_hop - _since_frame, size - i);
+                n = std::min(n, nfft - _position);
+                std::copy(samples + i, samples + i + n, _history.begin() + _position);
+                if (stats)
+                        std::fill(stats + i, stats + i + n, sample_type(average()));
+                _position = (_position + n) % nfft;
+                _since_frame += n;
+                i += n;
+                if (_since_frame < _hop)
+                        continue;
+
+                _since_frame = 0;
+                _last = _analyze_frame();
+                if (!_open) {
+                        _open_counter.push(_last);
+                        if (_open_counter.full() &&
+                            _open_counter.running_count() > _othresh * _owindow &&
+                            ret < 0) {
+                                _open = true;
+                                _open_counter.reset();
+                                ret = i - 1;
+                        }
+                }
+                else {
+                        _close_counter.push(_last);
+                        if (_close_counter.full() &&
+                            _close_counter.running_count() < _cthresh * _cwindow &&
+                            ret < 0) {
+                                _open = false;
+                                _close_counter.reset();
+                                ret = i - 1;
+                        }
+                }
+        }
+        return ret;
+}
+
+spectral_trigger::value_type
+spectral_trigger::_analyze_frame()
+{
+        // the oldest sample is at the current position in the history
+        const size_type nfft = _history.size();
+        const size_type split = nfft - _position;
+        value_type sumsq = 0;
+        for (size_type j = 0; j < split; ++j) {
+                _frame[j] = _window[j] * _history[_position + j];
+                sumsq += _frame[j] * _frame[j];
+        }
+        for (size_type j = split; j < nfft; ++j) {
+                _frame[j] = _window[j] * _history[j - split];
+                sumsq += _frame[j] * _frame[j];
+        }
+        // quiet frames are skipped, which also avoids dividing by zero
+        if (sumsq <= _floor * _window_power)
+                return 0;
+
+        _fft.forward(&_frame[0], &_spectrum[0]);
+        power_spectrum(&_spectrum[0], &_power[0], _power.size());
+
+        value_type band = 0;
+        for (size_type k = _band_first; k <= _band_last; ++k)
+                band += _power[k];
+        if (band <= 0)
+                return 0;
+        if (_statistic == BAND_RATIO) {
+                value_type total = band;
+                for (size_type k = 1; k < _band_first; ++k)
+                        total += _power[k];
+                for (size_type k = _band_last + 1; k < _power.size(); ++k)
+                        total += _power[k];
+                return band / total;
+        }
+        // H = -sum(p log p), with p = P / band, is log(band) - sum(P log P) / band
+        value_type plogp = 0;
+        for (size_type k = _band_first; k <= _band_last; ++k) {
+                if (_power[k] > 0)
+                        plogp += _power[k] * std::log(_power[k]);
+        }
+        const value_type entropy = std::log(band) - plogp / band;
+        const value_type nbins = _band_last - _band_first + 1;
+        return std::max(0.0, std::min(1.0, 1.0 - entropy / std::log(nbins)));
+}
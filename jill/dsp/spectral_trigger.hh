@@ -0,0 +1,166 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _SPECTRAL_TRIGGER_HH
+#define _SPECTRAL_TRIGGER_HH
+
+#include <vector>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include "../types.hh"
+#include "fft.hh"
+#include "counter.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup dspgroup
+ * @brief compute the power spectrum of a complex sequence
+ *
+ * Stores |in[k]|^2 in out[k] for k in [0, size). Several values are computed
+ * at once with vector instructions.
+ */
+void power_spectrum(fft::complex_type const * in, fft::value_type * out, std::size_t size);
+
+/**
+ * @ingroup dspgroup
+ * @brief detect signals by their spectral content
+ *
+ * A window discriminator like crossing_trigger, but instead of counting
+ * threshold crossings it computes a short-time Fourier transform of the
+ * input. Samples are copied into a history buffer, and every @a hop samples
+ * the last @a nfft samples are multiplied by a Hann window and transformed.
+ * Each frame gives a statistic between 0 and 1 that measures how much the
+ * frame looks like signal (e.g. birdsong) rather than noise:
+ *
+ * - BAND_RATIO: the proportion of the power in a frequency band. Cage noise
+ *   is mostly at low frequencies, so this is low for noise.
+ * - TONALITY: one minus the normalized spectral (Shannon) entropy of the
+ *   power in the band. This is close to 0 for broadband noise and higher for
+ *   harmonic or tonal signals.
+ *
+ * Frames with RMS amplitude below @a floor have a statistic of 0. The gate
+ * opens when the average statistic over the last @a owindow frames exceeds
+ * the open threshold, and closes when the average over the last @a cwindow
+ * frames drops below the close threshold.
+ *
+ * All buffers and the FFT plan are allocated by the constructor, so push()
+ * can be called in the process callback.
+ */
+class spectral_trigger : boost::noncopyable {
+public:
+        typedef sample_t sample_type;
+        typedef fft::value_type value_type;
+        typedef fft::complex_type complex_type;
+        typedef std::size_t size_type;
+
+        enum statistic_type { BAND_RATIO, TONALITY };
+
+        /**
+         * Instantiate a spectral detector.
+         *
+         * @param sampling_rate  the sampling rate of the input (Hz)
+         * @param nfft           the size of the analysis window. Must be a power of two
+         * @param hop            the number of samples between frames (1 to nfft)
+         * @param band_low       the lower edge of the signal band (Hz)
+         * @param band_high      the upper edge of the signal band (Hz)
+         * @param statistic      the statistic computed for each frame
+         * @param othresh        the statistic threshold for opening the gate
+         * @param owindow        the number of frames averaged to open the gate
+         * @param cthresh        the statistic threshold for closing the gate
+         * @param cwindow        the number of frames averaged to close the gate
+         * @param floor          the minimum RMS amplitude of a frame
+         *
+         * @throws std::invalid_argument if the parameters are invalid
+         */
+        spectral_trigger(nframes_t sampling_rate, size_type nfft, size_type hop,
+                         double band_low, double band_high, statistic_type statistic,
+                         double othresh, size_type owindow,
+                         double cthresh, size_type cwindow,
+                         double floor=0.0);
+
+        /**
+         * Analyze a block of samples. Each time a frame is completed, its
+         * statistic is pushed to the open or close window, depending on the
+         * state of the gate. The state can change at most once in each
+         * call.
+         *
+         * @param samples  the input samples
+         * @param size     the number of samples
+         * @param stats    if not null, filled with the average statistic of
+         *                 the active window (useful for monitoring)
+         *
+         * @return the offset of the sample that completed the frame where
+         *         the gate opened or closed, or -1 if the state didn't change
+         */
+        int push(sample_type const * samples, size_type size, sample_type * stats=0);
+
+        /** The state of the detector */
+        bool open() const { return _open; }
+
+        /** The statistic for the last frame */
+        value_type last_statistic() const { return _last; }
+
+        /**
+         * The average statistic in the active window (the open window if
+         * the gate is closed, and vice versa). Frames not yet seen count
+         * as 0.
+         */
+        value_type average() const;
+
+        /** Reset the history and the gate */
+        void reset();
+
+        size_type nfft() const { return _fft.size(); }
+        size_type hop() const { return _hop; }
+        /** The first and last FFT bins in the signal band */
+        size_type band_first() const { return _band_first; }
+        size_type band_last() const { return _band_last; }
+
+        /**
+         * Parse the name of a statistic ("ratio" or "entropy").
+         * @throws std::invalid_argument for unknown names
+         */
+        static statistic_type parse_statistic(std::string const & name);
+
+private:
+        /** window, transform, and summarize the last nfft samples */
+        value_type _analyze_frame();
+
+        fft _fft;
+        size_type _hop;
+        size_type _band_first;
+        size_type _band_last;
+        statistic_type _statistic;
+        value_type _floor;              // minimum mean-square amplitude
+        value_type _window_power;       // sum of the squared window
+        value_type _othresh;
+        value_type _cthresh;
+        size_type _owindow;
+        size_type _cwindow;
+
+        std::vector<value_type> _window;
+        std::vector<value_type> _history;  // ring of the last nfft samples
+        size_type _position;            // next slot in the history
+        size_type _since_frame;         // samples since the last frame
+        std::vector<value_type> _frame;
+        std::vector<complex_type> _spectrum;
+        std::vector<value_type> _power;
+
+        running_counter<value_type> _open_counter;
+        running_counter<value_type> _close_counter;
+        bool _open;
+        value_type _last;
+};
+
+}} // namespace jill::dsp
+
+#endif
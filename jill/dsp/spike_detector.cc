@@ -0,0 +1,186 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include "spike_detector.hh"
+#include "crossings.hh"
+
+using namespace jill::dsp;
+using jill::nframes_t;
+using std::size_t;
+
+spike_detector::spike_detector(size_type nchannels, nframes_t max_period, double thresh,
+                               polarity_type polarity, size_type pre, size_type post,
+                               size_type align, size_type refractory,
+                               size_type noise_samples, size_type noise_stride)
+        : _thresh(thresh), _polarity(polarity), _pre(pre), _post(post),
+          _align(std::max<size_type>(align, 1)),
+          _refractory(std::max(refractory, _align)),
+          _noise_stride(std::max<size_type>(noise_stride, 1)),
+          _max_period(max_period), _scratch(noise_samples)
+{
+        if (post < 1)
+                throw std::invalid_argument("spike waveforms need at least one sample after the peak");
+        if (noise_samples < 8)
+                throw std::invalid_argument("noise estimate needs at least 8 samples");
+        // the history has to reach back from the end of a block to the start
+        // of the oldest pending snippet
+        size_type history = 1;
+        while (history < max_period + _pre + _align + _post)
+                history *= 2;
+        _history_mask = history - 1;
+        // crossings are separated by the refractory period, which bounds the
+        // number of spikes pending or completed at any time
+        _max_spikes = (max_period + _align + _post) / _refractory + 2;
+
+        channel_state state;
+        state.history.assign(history, 0);
+        state.count = state.next_allowed = 0;
+        state.pending.assign(_max_spikes, 0);
+        state.npending = 0;
+        state.noise.assign(noise_samples, 0);
+        state.noise_pos = state.noise_count = state.noise_fresh = state.noise_phase = 0;
+        state.sigma = 0;
+        state.threshold = std::numeric_limits<sample_type>::infinity();
+        state.waveforms.assign(_max_spikes * snippet_size(), 0);
+        state.spikes.resize(_max_spikes);
+        _channels.assign(nchannels, state);
+        for (size_type i = 0; i < nchannels; ++i) {
+                channel_state & c = _channels[i];
+                for (size_type j = 0; j < _max_spikes; ++j) {
+                        c.spikes[j].channel = i;
+                        c.spikes[j].waveform = &c.waveforms[j * snippet_size()];
+                }
+        }
+}
+
+spike_detector::polarity_type
+spike_detector::parse_polarity(std::string const & name)
+{
+        if (name == "neg")
+                return NEGATIVE;
+        else if (name == "pos")
+                return POSITIVE;
+        else if (name == "both")
+                return BOTH;
+        throw std::invalid_argument("unknown spike polarity: " + name);
+}
+
+spike_detector::size_type
+spike_detector::push(size_type channel, sample_type const * samples, nframes_t size)
+{
+        channel_state & c = _channels[channel];
+        _update_noise(c, samples, size);
+
+        // copy the block into the history
+        const count_type start = c.count;
+        const size_type pos = start & _history_mask;
+        const size_type n1 = std::min<size_type>(size, c.history.size() - pos);
+        std::copy(samples, samples + n1, c.history.begin() + pos);
+        std::copy(samples + n1, samples + size, c.history.begin());
+
+        // scan for crossings outside the refractory period
+        const sample_type inf = std::numeric_limits<sample_type>::infinity();
+        const sample_type lo = (_polarity == POSITIVE) ? -inf : -c.threshold;
+        const sample_type hi = (_polarity == NEGATIVE) ? inf : c.threshold;
+        size_type i = (c.next_allowed > start) ?
+                std::min<count_type>(size, c.next_allowed - start) : 0;
+        while (i < size) {
+                i += find_outside(samples + i, size - i, lo, hi);
+                if (i >= size)
+                        break;
+                c.pending[c.npending++] = start + i;
+                c.next_allowed = start + i + _refractory;
+                i += _refractory;
+        }
+        c.count += size;
+
+        size_type nspikes = 0;
+        _finalize(c, start, nspikes);
+        return nspikes;
+}
+
+/*
+ * Keeps every nth absolute value in a ring, and recomputes the median when an
+ * eighth of the ring has been replaced. nth_element is linear in the size of
+ * the ring, so this is cheap compared to sorting, and the estimate changes
+ * slowly anyway.
+ */
+void
+spike_detector::_update_noise(channel_state & c, sample_type const * samples, nframes_t size)
+{
+        const size_type nnoise = c.noise.size();
+        size_type i = c.noise_phase;
+        for (; i < size; i += _noise_stride) {
+                c.noise[c.noise_pos] = std::fabs(samples[i]);
+                c.noise_pos = (c.noise_pos + 1) % nnoise;
+                c.noise_count = std::min(c.noise_count + 1, nnoise);
+                c.noise_fresh += 1;
+        }
+        c.noise_phase = i - size;
+        if (c.noise_fresh < nnoise / 8)
+                return;
+
+        c.noise_fresh = 0;
+        std::copy(c.noise.begin(), c.noise.begin() + c.noise_count, _scratch.begin());
+        std::vector<sample_type>::iterator median = _scratch.begin() + c.noise_count / 2;
+        std::nth_element(_scratch.begin(), median, _scratch.begin() + c.noise_count);
+        c.sigma = *median / 0.6745;
+        c.threshold = (c.sigma > 0) ? sample_type(_thresh * c.sigma) :
+                std::numeric_limits<sample_type>::infinity();
+}
+
+void
+spike_detector::_finalize(channel_state & c, count_type block_start, size_type & nspikes)
+{
+        size_type k = 0;
+        for (; k < c.npending; ++k) {
+                const count_type t = c.pending[k];
+                // the last sample any snippet for this crossing could need
+                const count_type last = t + _align + _post - 2;
+                if (last >= c.count)
+                        break;
+
+                count_type peak = t;
+                sample_type best = c.history[t & _history_mask];
+                if (_polarity == BOTH)
+                        best = std::fabs(best);
+                for (count_type p = t + 1; p < t + _align; ++p) {
+                        sample_type v = c.history[p & _history_mask];
+                        bool better;
+                        if (_polarity == NEGATIVE)
+                                better = v < best;
+                        else if (_polarity == POSITIVE)
+                                better = v > best;
+                        else {
+                                v = std::fabs(v);
+                                better = v > best;
+                        }
+                        if (better) {
+                                best = v;
+                                peak = p;
+                        }
+                }
+
+                spike_type & s = c.spikes[nspikes];
+                sample_type * w = &c.waveforms[nspikes * snippet_size()];
+                nspikes += 1;
+                for (size_type j = 0; j < snippet_size(); ++j)
+                        w[j] = c.history[(peak - _pre + j) & _history_mask];
+                s.ready = last - block_start;
+                s.lag = last - peak;
+        }
+        std::copy(c.pending.begin() + k, c.pending.begin() + c.npending, c.pending.begin());
+        c.npending -= k;
+}
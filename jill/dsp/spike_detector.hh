@@ -0,0 +1,159 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _SPIKE_DETECTOR_HH
+#define _SPIKE_DETECTOR_HH
+
+#include <vector>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include "../types.hh"
+
+namespace jill { namespace dsp {
+
+/**
+ * @ingroup dspgroup
+ * @brief detect spikes and extract their waveforms
+ *
+ * Detects threshold crossings in many channels of extracellular data and
+ * extracts a snippet of the waveform around each one. The threshold for each
+ * channel is a multiple of a robust estimate of the noise, the median
+ * absolute deviation (MAD) divided by 0.6745. The estimate is updated from a
+ * strided sample of the recent input, so the data should be highpass
+ * filtered first (e.g. with jfilter).
+ *
+ * When a sample crosses the threshold, the detector looks for the peak (the
+ * minimum, maximum, or largest absolute value, depending on the polarity)
+ * within the next @a align samples, and stores the @a pre samples before the
+ * peak and the @a post samples from the peak onward. No new crossings are
+ * detected for @a refractory samples after each crossing. Because the
+ * snippet extends past the crossing, a spike may not be complete until a
+ * later call to push(). Each spike records the offset in the block where it
+ * was completed and the lag from the peak to that offset.
+ *
+ * Samples are scanned with find_outside(), which compares many samples at
+ * once, so the cost for sparsely firing channels is small. All storage is
+ * allocated by the constructor.
+ */
+class spike_detector : boost::noncopyable {
+public:
+        typedef sample_t sample_type;
+        typedef std::size_t size_type;
+
+        enum polarity_type { NEGATIVE, POSITIVE, BOTH };
+
+        /** A detected spike */
+        struct spike_type {
+                size_type channel;
+                nframes_t ready;                // offset where the snippet was complete
+                nframes_t lag;                  // samples from the peak to ready
+                sample_type const * waveform;   // pre() + post() samples
+        };
+
+        /**
+         * Initialize the detector.
+         *
+         * @param nchannels     the number of channels
+         * @param max_period    the largest block that will be pushed
+         * @param thresh        the threshold, in units of the noise estimate
+         * @param polarity      which crossings to detect
+         * @param pre           the number of samples before the peak
+         * @param post          the number of samples after (and including) the peak
+         * @param align         the number of samples after the crossing to search for the peak
+         * @param refractory    the number of samples after a crossing to ignore.
+         *                      Set to at least align
+         * @param noise_samples the number of samples in the noise estimate
+         * @param noise_stride  the interval between samples in the noise estimate
+         */
+        spike_detector(size_type nchannels, nframes_t max_period, double thresh,
+                       polarity_type polarity, size_type pre, size_type post,
+                       size_type align, size_type refractory,
+                       size_type noise_samples=4096, size_type noise_stride=1);
+
+        /**
+         * Analyze a block of samples from one channel.
+         *
+         * @param channel  the channel
+         * @param samples  the input samples
+         * @param size     the number of samples. Must not exceed max_period
+         *
+         * @return the number of spikes completed in the block. These are
+         *         available from spikes() until the next call to push() for the
+         *         same channel
+         */
+        size_type push(size_type channel, sample_type const * samples, nframes_t size);
+
+        /** The spikes completed in the last call to push() for a channel, in order */
+        spike_type const * spikes(size_type channel) const { return &_channels[channel].spikes[0]; }
+
+        /** The current threshold for a channel (infinite until there's a noise estimate) */
+        sample_type threshold(size_type channel) const { return _channels[channel].threshold; }
+
+        /** The current noise estimate for a channel (0 if there isn't one) */
+        sample_type noise(size_type channel) const { return _channels[channel].sigma; }
+
+        size_type nchannels() const { return _channels.size(); }
+        /** The largest number of spikes push() can return for one channel */
+        size_type max_spikes() const { return _max_spikes; }
+        /** The largest block push() accepts */
+        nframes_t max_period() const { return _max_period; }
+        size_type pre() const { return _pre; }
+        size_type post() const { return _post; }
+        /** The number of samples in each waveform */
+        size_type snippet_size() const { return _pre + _post; }
+
+        /**
+         * Parse the name of a polarity ("neg", "pos", or "both").
+         * @throws std::invalid_argument for unknown names
+         */
+        static polarity_type parse_polarity(std::string const & name);
+
+private:
+        typedef boost::uint64_t count_type;
+
+        struct channel_state {
+                std::vector<sample_type> history;    // ring of recent samples
+                count_type count;                    // samples seen
+                count_type next_allowed;             // end of the refractory period
+                std::vector<count_type> pending;     // crossings waiting for samples
+                size_type npending;
+                std::vector<sample_type> noise;      // ring of absolute values
+                size_type noise_pos;
+                size_type noise_count;
+                size_type noise_fresh;               // entries since the last estimate
+                size_type noise_phase;               // samples until the next entry
+                sample_type sigma;
+                sample_type threshold;
+                std::vector<sample_type> waveforms;
+                std::vector<spike_type> spikes;
+        };
+
+        void _update_noise(channel_state & c, sample_type const * samples, nframes_t size);
+        void _finalize(channel_state & c, count_type block_start, size_type & nspikes);
+
+        double _thresh;
+        polarity_type _polarity;
+        size_type _pre;
+        size_type _post;
+        size_type _align;
+        size_type _refractory;
+        size_type _noise_stride;
+        nframes_t _max_period;
+        size_type _history_mask;
+        size_type _max_spikes;
+        std::vector<channel_state> _channels;
+        std::vector<sample_type> _scratch;   // for the median
+};
+
+}} // namespace jill::dsp
+
+#endif
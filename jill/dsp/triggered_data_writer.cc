@@ -62,7 +62,7 @@ triggered_data_writer::start_recording(nframes_t event_time)
         assert(ptr);
 
         /* skip any earlier periods */
-        while (ptr->time + ptr->nframes() < onset) {
+        while (ptr->time + ptr->duration() < onset) {
                 _buffer->release();
                 ptr = _buffer->peek();
         }
@@ -77,7 +77,7 @@ triggered_data_writer::start_recording(nframes_t event_time)
         }
 
         /* write additional periods in prebuffer, up to current period */
-        while (ptr->time + ptr->nframes() <= event_time) {
+        while (ptr->time + ptr->duration() <= event_time) {
                 _writer->write(ptr, 0, 0);
                 _buffer->release();
                 ptr = _buffer->peek();
@@ -102,7 +102,7 @@ void
 triggered_data_writer::write(data_block_t const * data)
 {
         std::string id = data->id();
-        nframes_t nframes = data->nframes();
+        nframes_t nframes = data->duration();
         /* handle trigger channel */
         if (data->dtype == EVENT && id == _trigger_port) {
                 if (_recording) {
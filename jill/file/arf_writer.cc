@@ -39,6 +39,14 @@ struct event_t {
         char const * message;   // message (hex encoded for standard midi status)
 };
 
+/**
+ * @brief Storage format for spike times
+ */
+struct spike_t {
+        boost::uint32_t start;  // time of the peak, relative to entry start
+        boost::uint16_t channel;
+};
+
 /**
  * convert a midi message to hex
  * @param in   the midi message
@@ -89,6 +97,16 @@ struct datatype_traits<event_t> {
         }
 };
 
+template<>
+struct datatype_traits<spike_t> {
+	static hid_t value() {
+                hid_t ret = H5Tcreate(H5T_COMPOUND, sizeof(spike_t));
+                H5Tinsert(ret, "start", HOFFSET(spike_t, start), H5T_NATIVE_UINT32);
+                H5Tinsert(ret, "channel", HOFFSET(spike_t, channel), H5T_NATIVE_UINT16);
+                return ret;
+        }
+};
+
 }}}
 
 arf_writer::arf_writer(string const & filename,
@@ -193,7 +211,7 @@ arf_writer::write(data_block_t const * data, nframes_t start_frame, nframes_t st
 {
         if (data->sz_data == 0) return;
         std::string id = data->id();
-        nframes_t nframes = data->nframes();
+        nframes_t nframes = data->duration();
         dset_map_type::iterator dset;
         stop_frame = (stop_frame > 0) ? std::min(stop_frame, nframes) : nframes;
 
@@ -208,13 +226,22 @@ arf_writer::write(data_block_t const * data, nframes_t start_frame, nframes_t st
         }
         /* write the data */
         if (data->dtype == SAMPLED) {
-                dset = get_dataset(id, true);
+                dset = get_dataset(id, SAMPLES, data->decimation);
                 sample_t const * samples = reinterpret_cast<sample_t const *>(data->data());
-                dset->second->write(samples + start_frame, stop_frame - start_frame);
+                // convert frame offsets to sample indices for decimated data
+                nframes_t const dec = data->decimation;
+                nframes_t const first = (start_frame + dec - 1) / dec;
+                nframes_t const last = (stop_frame + dec - 1) / dec;
+                if (last > first)
+                        dset->second->write(samples + first, last - first);
+        }
+        else if (data->dtype == EVENT &&
+                 *static_cast<midi::data_type const *>(data->data()) == midi::spike) {
+                write_spike(id, data);
         }
         else if (data->dtype == EVENT) {
                 char * message = 0;
-                dset = get_dataset(id, false);
+                dset = get_dataset(id, EVENTS);
                 char const * buffer = reinterpret_cast<char const *>(data->data());
                 event_t e = {data->time - _entry_start, (uint8_t)buffer[0], buffer+1};
                 if (e.status >= midi::note_off) {
@@ -229,6 +256,31 @@ arf_writer::write(data_block_t const * data, nframes_t start_frame, nframes_t st
         _last_frame = data->time + stop_frame;
 }
 
+void
+arf_writer::write_spike(string const & name, data_block_t const * data)
+{
+        midi::spike_header header;
+        int nsamples = midi::read_spike(data->data(), data->sz_data, header);
+        if (nsamples < 0) return;
+        bool created = (_dsets.find(name) == _dsets.end());
+        dset_map_type::iterator times = get_dataset(name, SPIKE_TIMES);
+        dset_map_type::iterator waveforms = get_dataset(name + "_waveforms", SAMPLES);
+        if (created) {
+                waveforms->second->write_attribute("snippet_size", nframes_t(nsamples));
+                waveforms->second->write_attribute("peak_index", nframes_t(header.peak));
+        }
+        // the event is sent after the end of the waveform; peaks before the
+        // start of the entry are stored at 0
+        nframes_t offset = data->time - _entry_start;
+        spike_t s = { (header.lag < offset) ? offset - header.lag : 0, header.channel };
+        DBG << "spike: t=" << data->time << " id=" << name << " channel=" << s.channel
+            << " lag=" << header.lag;
+        times->second->write(&s, 1);
+        std::vector<sample_t> waveform(nsamples);
+        midi::read_spike(data->data(), data->sz_data, header, &waveform[0]);
+        waveforms->second->write(&waveform[0], nsamples);
+}
+
 void
 arf_writer::flush()
 {
@@ -263,7 +315,7 @@ arf_writer::_get_last_entry_index()
 
 
 arf_writer::dset_map_type::iterator
-arf_writer::get_dataset(string const & name, bool is_sampled)
+arf_writer::get_dataset(string const & name, dataset_type type, nframes_t decimation)
 {
         map<string, string>::iterator uuid = _dset_uuids.find(name);
         if (uuid == _dset_uuids.end()) {
@@ -276,17 +328,31 @@ arf_writer::get_dataset(string const & name, bool is_sampled)
         dset_map_type::iterator dset = _dsets.find(name);
         if (dset == _dsets.end()) {
                 arf::packet_table_ptr pt;
-                if (is_sampled) {
+                if (type == SAMPLES) {
                         pt = _entry->create_packet_table<sample_t>(name, "", arf::UNDEFINED,
                                                                    false, ARF_CHUNK_SIZE,
                                                                    _compression);
                 }
+                else if (type == SPIKE_TIMES) {
+                        pt = _entry->create_packet_table<spike_t>(name, "samples", arf::EVENT,
+                                                                  false, ARF_CHUNK_SIZE,
+                                                                  _compression);
+                }
                 else {
                         pt = _entry->create_packet_table<event_t>(name, "samples", arf::EVENT,
                                                                   false, ARF_CHUNK_SIZE,
                                                                   _compression);
                 }
-                pt->write_attribute("sampling_rate", _data_source.sampling_rate());
+                nframes_t rate = _data_source.sampling_rate();
+                if (decimation <= 1)
+                        pt->write_attribute("sampling_rate", rate);
+                else {
+                        if (rate % decimation == 0)
+                                pt->write_attribute("sampling_rate", rate / decimation);
+                        else
+                                pt->write_attribute("sampling_rate", double(rate) / decimation);
+                        pt->write_attribute("decimation", decimation);
+                }
                 pt->write_attribute("uuid", uuid->second);
                 LOG << "created dataset: " << pt->name();
                 dset = _dsets.insert(dset, make_pair(name,pt));
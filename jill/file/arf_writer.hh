@@ -46,14 +46,31 @@ public:
 protected:
         typedef std::map<std::string, arf::packet_table_ptr> dset_map_type;
 
+        /** The kinds of data stored in datasets */
+        enum dataset_type {
+                SAMPLES,        // sampled data
+                EVENTS,         // event times, status, and messages
+                SPIKE_TIMES     // spike times and channels (waveforms are sampled data)
+        };
+
         /**
          * Look up dataset in current entry, creating as needed.
          *
          * @param name         the name of the dataset (channel)
-         * @param is_sampled   whether the dataset holds samples or events
+         * @param type         the kind of data in the dataset
+         * @param decimation   for sampled data, the ratio of the server
+         *                     sampling rate to the dataset's sampling rate
          * @return derefable iterator for appropriate dataset
          */
-        dset_map_type::iterator get_dataset(std::string const & name, bool is_sampled);
+        dset_map_type::iterator get_dataset(std::string const & name, dataset_type type,
+                                            nframes_t decimation=1);
+
+        /**
+         * Store a spike message. The time and channel are stored in one
+         * dataset, and the waveform is appended to a second dataset (with
+         * _waveforms added to the name) as sampled data.
+         */
+        void write_spike(std::string const & name, data_block_t const * data);
 
 private:
         /* find last entry index */
@@ -0,0 +1,172 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <boost/filesystem.hpp>
+#include "stimcache.hh"
+#include "stimfile.hh"
+#include "../logging.hh"
+
+namespace fs = boost::filesystem;
+using namespace jill::file;
+using jill::sample_t;
+using jill::nframes_t;
+
+stimcache::stimcache(std::string const & dir, std::size_t max_bytes, std::size_t nprotected)
+        : _dir(dir), _max_bytes(max_bytes), _nprotected(nprotected),
+          _bytes(0), _hits(0), _misses(0)
+{
+        if (!_dir.empty())
+                fs::create_directories(_dir);
+        pthread_mutex_init(&_lock, 0);
+}
+
+stimcache::~stimcache()
+{
+        pthread_mutex_destroy(&_lock);
+}
+
+std::string
+stimcache::entry_path(hash_type hash, nframes_t samplerate) const
+{
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << hash
+             << std::dec << '-' << samplerate << ".f32";
+        return (fs::path(_dir) / name.str()).string();
+}
+
+sample_t const *
+stimcache::map(hash_type hash, nframes_t samplerate, nframes_t nframes)
+{
+        if (_dir.empty()) return 0;
+        std::string path = entry_path(hash, samplerate);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+                __sync_add_and_fetch(&_misses, 1);
+                return 0;
+        }
+        struct stat st;
+        void * ptr = MAP_FAILED;
+        // an entry with the wrong size was truncated or comes from a
+        // different resampler, so it's ignored (and overwritten later)
+        if (fstat(fd, &st) == 0 && st.st_size == off_t(nframes * sizeof(sample_t)) && nframes > 0) {
+                int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+                flags |= MAP_POPULATE;
+#endif
+                ptr = mmap(0, st.st_size, PROT_READ, flags, fd, 0);
+        }
+        close(fd);
+        if (ptr == MAP_FAILED) {
+                __sync_add_and_fetch(&_misses, 1);
+                return 0;
+        }
+        __sync_add_and_fetch(&_hits, 1);
+        return static_cast<sample_t const *>(ptr);
+}
+
+void
+stimcache::unmap(sample_t const * samples, nframes_t nframes)
+{
+        munmap(const_cast<sample_t *>(samples), nframes * sizeof(sample_t));
+}
+
+/*
+ * Entries are written to a temporary file and renamed, so other processes
+ * using the same directory never see a partial entry.
+ */
+void
+stimcache::store(hash_type hash, nframes_t samplerate, sample_t const * samples, nframes_t nframes)
+{
+        if (_dir.empty()) return;
+        std::string path = entry_path(hash, samplerate);
+        std::ostringstream tmpname;
+        tmpname << path << '.' << getpid() << ".tmp";
+        std::string tmp = tmpname.str();
+        FILE * fp = fopen(tmp.c_str(), "wb");
+        if (fp == 0) {
+                LOG << "WARNING: unable to write to stimulus cache " << tmp;
+                return;
+        }
+        size_t n = fwrite(samples, sizeof(sample_t), nframes, fp);
+        if (fclose(fp) != 0 || n != nframes || rename(tmp.c_str(), path.c_str()) != 0) {
+                LOG << "WARNING: unable to write to stimulus cache " << path;
+                unlink(tmp.c_str());
+        }
+}
+
+void
+stimcache::touch(stimfile * stim, std::size_t nbytes)
+{
+        std::vector<stimfile *> victims;
+        pthread_mutex_lock(&_lock);
+        for (lru_type::iterator it = _lru.begin(); it != _lru.end(); ++it) {
+                if (it->first == stim) {
+                        _bytes -= it->second;
+                        _lru.erase(it);
+                        break;
+                }
+        }
+        _lru.push_front(std::make_pair(stim, nbytes));
+        _bytes += nbytes;
+        while (_max_bytes > 0 && _bytes > _max_bytes && _lru.size() > _nprotected) {
+                victims.push_back(_lru.back().first);
+                _bytes -= _lru.back().second;
+                _lru.pop_back();
+        }
+        pthread_mutex_unlock(&_lock);
+
+        // unload() calls forget(), so this has to happen outside the lock
+        for (std::vector<stimfile *>::iterator it = victims.begin(); it != victims.end(); ++it) {
+                DBG << "unloading " << (*it)->name() << " from memory";
+                (*it)->unload();
+        }
+}
+
+void
+stimcache::forget(stimfile const * stim)
+{
+        pthread_mutex_lock(&_lock);
+        for (lru_type::iterator it = _lru.begin(); it != _lru.end(); ++it) {
+                if (it->first == stim) {
+                        _bytes -= it->second;
+                        _lru.erase(it);
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&_lock);
+}
+
+stimcache::hash_type
+stimcache::hash_file(std::string const & path)
+{
+        hash_type hash = 14695981039346656037ULL;
+        FILE * fp = fopen(path.c_str(), "rb");
+        if (fp == 0)
+                throw jill::FileError("unable to read " + path);
+        std::vector<unsigned char> buf(65536);
+        size_t n;
+        while ((n = fread(&buf[0], 1, buf.size(), fp)) > 0) {
+                for (size_t i = 0; i < n; ++i) {
+                        hash ^= buf[i];
+                        hash *= 1099511628211ULL;
+                }
+        }
+        fclose(fp);
+        return hash;
+}
@@ -0,0 +1,122 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _STIMCACHE_HH
+#define _STIMCACHE_HH
+
+#include <string>
+#include <list>
+#include <pthread.h>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include "../types.hh"
+
+namespace jill { namespace file {
+
+class stimfile;
+
+/**
+ * Manages the samples loaded by a set of stimfiles.
+ *
+ * The cache limits the memory used by loaded stimuli. stimfile objects report
+ * to the cache when their samples are loaded or used. When the total exceeds
+ * the budget, the least recently used stimuli are unloaded. The most recently
+ * used stimuli are never unloaded, because they may be playing or about to
+ * play. stimqueue implementations load a stimulus before it becomes the head
+ * of the queue, and this is enough to keep it safe.
+ *
+ * The cache can also store resampled stimuli on disk, so that they only have
+ * to be resampled once. Entries are keyed by a hash of the contents of the
+ * original file and the target sampling rate, and contain the raw samples
+ * (one channel after another). Stored samples are mapped into memory instead
+ * of being read.
+ *
+ * The methods of this class are thread-safe.
+ */
+class stimcache : boost::noncopyable {
+
+public:
+        typedef boost::uint64_t hash_type;
+
+        /**
+         * Initialize the cache.
+         *
+         * @param dir        the directory for resampled stimuli (created if
+         *                   needed), or empty to keep samples only in memory
+         * @param max_bytes  the memory budget for loaded samples, or 0 for no limit
+         * @param nprotected the number of most recently used stimuli that are
+         *                   never unloaded
+         */
+        stimcache(std::string const & dir, std::size_t max_bytes=0, std::size_t nprotected=2);
+        ~stimcache();
+
+        /**
+         * Map stored samples into memory.
+         *
+         * @param hash        the hash of the original file (@see hash_file)
+         * @param samplerate  the sampling rate of the samples
+         * @param nframes     the expected number of samples, in all channels
+         * @return a pointer to the samples, or 0 if there is no valid entry.
+         *         Release with unmap().
+         */
+        sample_t const * map(hash_type hash, nframes_t samplerate, nframes_t nframes);
+
+        /** Unmap samples returned by map() */
+        static void unmap(sample_t const * samples, nframes_t nframes);
+
+        /**
+         * Store samples on disk. Does nothing if there is no cache directory.
+         * Errors are logged but not fatal.
+         */
+        void store(hash_type hash, nframes_t samplerate, sample_t const * samples,
+                   nframes_t nframes);
+
+        /**
+         * Record that a stimulus has loaded or used its samples, and unload
+         * stimuli that have not been used recently if the budget is exceeded.
+         *
+         * @param stim    the stimulus
+         * @param nbytes  the size of its samples
+         */
+        void touch(stimfile * stim, std::size_t nbytes);
+
+        /** Record that a stimulus has unloaded its samples or been destroyed */
+        void forget(stimfile const * stim);
+
+        /** The directory for resampled stimuli */
+        std::string const & dir() const { return _dir; }
+        /** The number of bytes of loaded samples */
+        std::size_t bytes() const { return _bytes; }
+        std::size_t max_bytes() const { return _max_bytes; }
+        /** The number of stored stimuli that were mapped, and that had to be resampled */
+        std::size_t hits() const { return _hits; }
+        std::size_t misses() const { return _misses; }
+
+        /** Calculate a hash (64-bit FNV-1a) of the contents of a file */
+        static hash_type hash_file(std::string const & path);
+
+private:
+        typedef std::list<std::pair<stimfile *, std::size_t> > lru_type;
+
+        std::string entry_path(hash_type hash, nframes_t samplerate) const;
+
+        std::string _dir;
+        std::size_t const _max_bytes;
+        std::size_t const _nprotected;
+        std::size_t _bytes;
+        std::size_t _hits;
+        std::size_t _misses;
+        lru_type _lru;                  // most recently used first
+        pthread_mutex_t _lock;
+};
+
+}} // namespace jill::file
+
+#endif
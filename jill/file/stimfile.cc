@@ -9,6 +9,9 @@
  * (at your option) any later version.
  */
 
+#include <cstdlib>
+#include <new>
+#include <vector>
 #include "stimfile.hh"
 #include "../logging.hh"
 
@@ -21,25 +24,82 @@
 
 namespace fs = boost::filesystem;
 using namespace jill::file;
+using jill::nframes_t;
+using jill::sample_t;
 
-stimfile::stimfile(std::string const & path)
-        : _name(fs::path(path).stem().string()), _sndfile(0)
+/* channels in the buffer are aligned to this many bytes */
+static const std::size_t ChannelAlign = 64;
+
+/*
+ * The distance between the starts of channels in the buffer. Single-channel
+ * stimuli aren't padded, which keeps their cache entries the same size.
+ */
+static nframes_t
+channel_stride(nframes_t nframes, int nchannels)
+{
+        static const nframes_t align = ChannelAlign / sizeof(sample_t);
+        if (nchannels == 1) return nframes;
+        return (nframes + align - 1) / align * align;
+}
+
+/* copy interleaved samples into a newly allocated buffer with one array per channel */
+static sample_t *
+deinterleave(sample_t const * in, nframes_t nframes, int nchannels, nframes_t stride)
+{
+        void * mem;
+        std::size_t nbytes = std::max<std::size_t>(1, stride * nchannels) * sizeof(sample_t);
+        if (posix_memalign(&mem, ChannelAlign, nbytes) != 0)
+                throw std::bad_alloc();
+        sample_t * out = static_cast<sample_t *>(mem);
+        for (int c = 0; c < nchannels; ++c) {
+                sample_t * dst = out + c * stride;
+                for (nframes_t i = 0; i < nframes; ++i)
+                        dst[i] = in[i * nchannels + c];
+                std::fill(dst + nframes, dst + stride, 0.0f);
+        }
+        return out;
+}
+
+stimfile::stimfile(std::string const & path, stimcache * cache)
+        : _path(path), _name(fs::path(path).stem().string()), _sndfile(0),
+          _buffer(0), _mapped(0), _cache(cache), _hash(0), _hashed(false)
 {
         _sndfile = sf_open(path.c_str(), SFM_READ, &_sfinfo);
         if (_sndfile == 0) throw jill::FileError(sf_strerror(_sndfile));
-        if (_sfinfo.channels != 1) {
-                throw jill::FileError("input file contains more than one channel");
+        if (_sfinfo.channels < 1) {
+                sf_close(_sndfile);
+                throw jill::FileError("input file contains no channels");
         }
         _nframes = _sfinfo.frames;
         _samplerate = _sfinfo.samplerate;
+        _stride = channel_stride(_nframes, _sfinfo.channels);
 }
 
 stimfile::~stimfile()
 {
+        unload();
         if (_sndfile) sf_close(_sndfile);
+}
+
+void
+stimfile::unload()
+{
+        if (_cache) _cache->forget(this);
 #if MLOCK_STIMFILES
-        if (_buffer) munlock(_buffer.get(), _nframes * sizeof(sample_t));
+        if (buffer()) munlock(buffer(), _nsamples() * sizeof(sample_t));
 #endif
+        free(_buffer);
+        _buffer = 0;
+        if (_mapped) {
+                stimcache::unmap(_mapped, _nsamples());
+                _mapped = 0;
+        }
+}
+
+void
+stimfile::_touch()
+{
+        if (_cache) _cache->touch(this, _nsamples() * sizeof(sample_t));
 }
 
 void
@@ -47,45 +107,76 @@ stimfile::load_samples(nframes_t samplerate)
 {
         // TODO: assert that sample_t is same type as float
         SRC_DATA rs;
-        sample_t *buf;
+        int const nchannels = _sfinfo.channels;
 
         // check if we actually need to do work
-        if (_buffer) {
-                if (samplerate == 0 && _samplerate == nframes_t(_sfinfo.samplerate)) return;
-                else if (samplerate == _samplerate) return;
+        if (buffer()) {
+                if ((samplerate == 0 && _samplerate == nframes_t(_sfinfo.samplerate)) ||
+                    samplerate == _samplerate) {
+                        _touch();
+                        return;
+                }
+                unload();
         }
 
-        rs.input_frames = _sfinfo.frames;
-        buf = rs.data_in = new sample_t[rs.input_frames];
+        // resampled stimuli may have been stored in the cache
+        bool const resample = (samplerate > 0) && (samplerate != nframes_t(_sfinfo.samplerate));
+        if (resample && _cache && !_cache->dir().empty()) {
+                if (!_hashed) {
+                        _hash = stimcache::hash_file(_path);
+                        _hashed = true;
+                }
+                float ratio = float(samplerate) / float(_sfinfo.samplerate);
+                nframes_t nframes = (int)(_sfinfo.frames * double(ratio));
+                nframes_t stride = channel_stride(nframes, nchannels);
+                _mapped = _cache->map(_hash, samplerate, stride * nchannels);
+                if (_mapped) {
+                        _nframes = nframes;
+                        _samplerate = samplerate;
+                        _stride = stride;
+                        LOG << "mapped " << _nframes << " frames of " << _name << " at "
+                            << _samplerate << " from cache";
+#if MLOCK_STIMFILES
+                        mlock(_mapped, _nsamples() * sizeof(sample_t));
+#endif
+                        _touch();
+                        return;
+                }
+        }
 
+        // libsndfile and libsamplerate work with interleaved frames
+        std::vector<sample_t> in(std::max<std::size_t>(1, _sfinfo.frames * nchannels));
         sf_seek(_sndfile, 0, SEEK_SET);
         // read file, ignoring any discrepancies in # of samples
-        _nframes = rs.input_frames = sf_read_float(_sndfile, buf, rs.input_frames);
+        _nframes = rs.input_frames = sf_readf_float(_sndfile, &in[0], _sfinfo.frames);
         _samplerate = _sfinfo.samplerate;
         LOG << "read " << _nframes << " frames from " << _name << " at " << _samplerate;
 
-        if ((samplerate > 0) && (samplerate != _samplerate)) {
+        if (resample) {
+                rs.data_in = &in[0];
                 rs.src_ratio = float(samplerate) / float(_samplerate);
                 rs.output_frames = (int)(rs.input_frames * rs.src_ratio);
-		rs.data_out = new sample_t[rs.output_frames];
+                std::vector<sample_t> out(std::max<std::size_t>(1, rs.output_frames * nchannels));
+                rs.data_out = &out[0];
                 LOG << "resampling " << _name << " to " << samplerate << " (" << rs.src_ratio << ") -> "
                     << rs.output_frames << " frames";
 
-                int ec = src_simple(&rs, SRC_SINC_BEST_QUALITY, 1);
-                delete[] rs.data_in;
-		if (ec != 0) {
-                        delete[] rs.data_out;
+                int ec = src_simple(&rs, SRC_SINC_BEST_QUALITY, nchannels);
+		if (ec != 0)
 			throw std::runtime_error(src_strerror(ec));
-                }
 
                 _nframes = rs.output_frames;
                 _samplerate = samplerate;
-                buf = rs.data_out;
+                in.swap(out);
         }
 
+        _stride = channel_stride(_nframes, nchannels);
+        _buffer = deinterleave(&in[0], _nframes, nchannels, _stride);
+        if (resample && _hashed)
+                _cache->store(_hash, _samplerate, _buffer, _nsamples());
+
 #if MLOCK_STIMFILES
-        mlock(buf, _nframes * sizeof(sample_t));
+        mlock(_buffer, _nsamples() * sizeof(sample_t));
 #endif
-        _buffer.reset(buf);
-
+        _touch();
 }
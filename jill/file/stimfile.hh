@@ -12,9 +12,9 @@
 #define _STIMFILE_HH
 
 #include <string>
-#include <boost/scoped_array.hpp>
 #include <sndfile.h>
 #include "../stimulus.hh"
+#include "stimcache.hh"
 
 namespace jill { namespace file {
 
@@ -22,6 +22,12 @@ namespace jill { namespace file {
  * A stimulus stored on disk in a file. This implementation of stimulus_t uses
  * libsndfile to load the samples from disk, and libsamplerate to resample (if
  * needed). The loaded samples are stored in an array managed by the object.
+ * Multichannel files are deinterleaved when they are loaded, and each channel
+ * starts on a cache line boundary.
+ *
+ * If the stimulus is associated with a stimcache, the cache may unload the
+ * samples to stay within its memory budget, and resampled samples are stored
+ * on disk and mapped into memory the next time they are needed.
  */
 class stimfile : public jill::stimulus_t {
 
@@ -30,18 +36,24 @@ public:
          * Initialize object with path of stimfile.
          *
          * @param path   the location of the stimulus file
+         * @param cache  the cache for the samples, or 0. Must outlive the object
          *
          * @throws jill::FileError if the file doesn't exist
          */
-        stimfile(std::string const & path);
+        stimfile(std::string const & path, stimcache * cache=0);
         ~stimfile();
 
         char const * name() const { return _name.c_str(); }
 
         nframes_t nframes() const { return _nframes; }
         nframes_t samplerate() const { return _samplerate; }
+        std::size_t nchannels() const { return _sfinfo.channels; }
 
-        sample_t const * buffer() const { return (_buffer) ? _buffer.get() : 0; }
+        sample_t const * buffer() const { return (_buffer) ? _buffer : _mapped; }
+        sample_t const * channel(std::size_t chan) const {
+                sample_t const * buf = buffer();
+                return (buf && chan < nchannels()) ? buf + chan * _stride : 0;
+        }
 
         /**
          * Load samples from disk and resample as needed
@@ -50,15 +62,28 @@ public:
          */
         void load_samples(nframes_t samplerate=0);
 
+        /** Release the samples. buffer() will be 0 until they are loaded again */
+        void unload();
+
 private:
+        void _touch();
+        std::size_t _nsamples() const { return _stride * nchannels(); }
+
+        std::string _path;
         std::string _name;
         SF_INFO _sfinfo;
         SNDFILE *_sndfile;
 
         nframes_t _nframes;
         nframes_t _samplerate;
+        nframes_t _stride;              // distance between channels in the buffer
+
+        sample_t * _buffer;             // allocated samples
+        sample_t const * _mapped;       // samples mapped from the cache
 
-        boost::scoped_array<sample_t> _buffer;
+        stimcache * _cache;
+        stimcache::hash_type _hash;     // of the file, for the cache
+        bool _hashed;
 };
 
 }} // namespace jill::file
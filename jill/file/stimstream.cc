@@ -0,0 +1,189 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <unistd.h>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include "stimstream.hh"
+#include "../logging.hh"
+
+namespace fs = boost::filesystem;
+using namespace jill::file;
+using jill::nframes_t;
+using jill::sample_t;
+
+/* the number of frames read or resampled at a time */
+static const nframes_t BlockSize = 4096;
+
+stimstream::stimstream(std::string const & path, nframes_t buffer_size)
+        : _name(fs::path(path).stem().string()), _sndfile(0), _src(0),
+          _buffer_size(std::max(buffer_size, BlockSize * 2)),
+          _ratio(1.0), _inbuf(BlockSize), _outbuf(BlockSize), _pass_pos(0),
+          _read_pos(0), _pass_start(0), _running(false), _stopping(0)
+{
+        _sndfile = sf_open(path.c_str(), SFM_READ, &_sfinfo);
+        if (_sndfile == 0) throw jill::FileError(sf_strerror(_sndfile));
+        if (_sfinfo.channels != 1) {
+                sf_close(_sndfile);
+                throw jill::FileError("input file contains more than one channel");
+        }
+        _nframes = _sfinfo.frames;
+        _samplerate = _sfinfo.samplerate;
+}
+
+stimstream::~stimstream()
+{
+        stop();
+        if (_src) src_delete(_src);
+        if (_sndfile) sf_close(_sndfile);
+}
+
+void
+stimstream::load_samples(nframes_t samplerate)
+{
+        if (samplerate == 0) samplerate = _sfinfo.samplerate;
+        if (_running && samplerate == _samplerate) return;
+
+        stop();
+        if (_src) _src = src_delete(_src);
+        _samplerate = samplerate;
+        _nframes = _sfinfo.frames;
+        _ratio = 1.0;
+        if (_samplerate != nframes_t(_sfinfo.samplerate)) {
+                int ec;
+                _src = src_callback_new(stimstream::src_input, SRC_SINC_BEST_QUALITY, 1, &ec, this);
+                if (_src == 0)
+                        throw std::runtime_error(src_strerror(ec));
+                // same ratio and length as stimfile::load_samples
+                _ratio = float(_samplerate) / float(_sfinfo.samplerate);
+                _nframes = (nframes_t)(_sfinfo.frames * _ratio);
+        }
+        sf_seek(_sndfile, 0, SEEK_SET);
+        _pass_pos = 0;
+        _read_pos = _pass_start = 0;
+        _ring.reset(new dsp::ringbuffer<sample_t>(_buffer_size));
+        LOG << "streaming " << _name << " at " << _samplerate << ": " << _nframes
+            << " frames, " << _ring->size() << " frame buffer";
+
+        _stopping = 0;
+        int ret = pthread_create(&_thread_id, NULL, stimstream::thread, this);
+        if (ret != 0)
+                throw std::runtime_error("Failed to start stimulus streaming thread");
+        _running = true;
+
+        // wait for the buffer to fill up before the stimulus can be played
+        const std::size_t primed = std::min<std::size_t>(_nframes, _ring->size() / 2);
+        while (_ring->read_space() < primed)
+                usleep(1000);
+}
+
+void
+stimstream::stop()
+{
+        if (!_running) return;
+        __sync_add_and_fetch(&_stopping, 1);
+        pthread_join(_thread_id, NULL);
+        _running = false;
+}
+
+void *
+stimstream::thread(void * arg)
+{
+        stimstream * self = static_cast<stimstream *>(arg);
+        self->loop();
+        return 0;
+}
+
+/*
+ * Keeps the ringbuffer full. When there isn't room for a block, the thread
+ * sleeps for an eighth of the buffer's duration, which is much longer than a
+ * block takes to produce and much shorter than the buffer takes to drain.
+ */
+void
+stimstream::loop()
+{
+        const useconds_t nap = 1e6 * _ring->size() / _samplerate / 8;
+        if (_nframes == 0) return;
+        while (!__sync_fetch_and_add(&_stopping, 0)) {
+                if (_ring->write_space() < BlockSize) {
+                        usleep(nap);
+                        continue;
+                }
+                nframes_t n = produce(&_outbuf[0], BlockSize);
+                _ring->push(&_outbuf[0], n);
+        }
+}
+
+/*
+ * Generates up to nframes samples from the current pass. Short reads from the
+ * file or the resampler mean the input is exhausted, so the rest of the pass
+ * is padded with zeros to keep every pass nframes() long. At the end of the
+ * pass, the file and the resampler are rewound.
+ */
+nframes_t
+stimstream::produce(sample_t * dest, nframes_t nframes)
+{
+        nframes = std::min(nframes, _nframes - _pass_pos);
+        long got;
+        if (_src) {
+                got = src_callback_read(_src, _ratio, nframes, dest);
+                if (got < 0 || src_error(_src) != 0) {
+                        LOG << "error resampling " << _name << ": " << src_strerror(src_error(_src));
+                        got = 0;
+                }
+        }
+        else {
+                got = sf_read_float(_sndfile, dest, nframes);
+        }
+        std::fill(dest + got, dest + nframes, 0.0f);
+
+        _pass_pos += nframes;
+        if (_pass_pos >= _nframes) {
+                sf_seek(_sndfile, 0, SEEK_SET);
+                if (_src) src_reset(_src);
+                _pass_pos = 0;
+        }
+        return nframes;
+}
+
+long
+stimstream::src_input(void * arg, float ** data)
+{
+        stimstream * self = static_cast<stimstream *>(arg);
+        *data = &self->_inbuf[0];
+        return sf_read_float(self->_sndfile, *data, self->_inbuf.size());
+}
+
+nframes_t
+stimstream::read(sample_t * dest, nframes_t offset, nframes_t nframes, std::size_t chan) const
+{
+        if (!_ring || chan > 0 || offset >= _nframes) return 0;
+        nframes = std::min(nframes, _nframes - offset);
+
+        // a new presentation starts at the beginning of the next pass, which
+        // skips anything left from a presentation that was cut short
+        if (offset == 0)
+                _pass_start = (_read_pos + _nframes - 1) / _nframes * _nframes;
+        const count_type target = _pass_start + offset;
+        if (_read_pos < target) {
+                std::size_t skip = std::min<count_type>(target - _read_pos, _ring->read_space());
+                if (skip > 0)
+                        _read_pos += _ring->pop(static_cast<sample_t *>(0), skip);
+        }
+        if (_read_pos != target)
+                return 0;
+
+        std::size_t n = std::min<std::size_t>(nframes, _ring->read_space());
+        if (n > 0)
+                n = _ring->pop(dest, n);
+        _read_pos += n;
+        return n;
+}
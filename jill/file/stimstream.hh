@@ -0,0 +1,119 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _STIMSTREAM_HH
+#define _STIMSTREAM_HH
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <sndfile.h>
+#include <samplerate.h>
+#include "../stimulus.hh"
+#include "../dsp/ringbuffer.hh"
+
+namespace jill { namespace file {
+
+/**
+ * A stimulus that is streamed from disk during playback. Unlike stimfile, the
+ * samples are never loaded all at once, so this class is suitable for very
+ * long stimuli. A background thread reads the file (with libsndfile),
+ * resamples it if needed (with the libsamplerate callback interface), and
+ * writes the samples to a ringbuffer. The consumer pulls samples out of the
+ * ringbuffer with read(), which is wait-free. buffer() is always 0.
+ *
+ * The thread writes the stimulus into the ringbuffer over and over, so that
+ * the start of the next presentation is ready as soon as the current one
+ * ends. Each pass is exactly nframes() long. If a presentation is cut short,
+ * the remaining samples are skipped at the start of the next one. The thread
+ * starts in load_samples() and runs until the object is destroyed, so only
+ * use this class for stimuli that are too long to hold in memory. Only
+ * single-channel files can be streamed.
+ */
+class stimstream : public jill::stimulus_t {
+
+public:
+        /**
+         * Open a stimulus file for streaming.
+         *
+         * @param path         the location of the stimulus file
+         * @param buffer_size  the number of frames to buffer
+         *
+         * @throws jill::FileError if the file doesn't exist
+         */
+        stimstream(std::string const & path, nframes_t buffer_size=262144);
+        ~stimstream();
+
+        char const * name() const { return _name.c_str(); }
+
+        nframes_t nframes() const { return _nframes; }
+        nframes_t samplerate() const { return _samplerate; }
+
+        sample_t const * buffer() const { return 0; }
+
+        /**
+         * Copy samples from the stream. Presentations start with offset 0,
+         * and subsequent calls must request the following samples in order.
+         * Wait-free.
+         *
+         * @return the number of samples copied. Fewer than @a nframes means
+         *         the streaming thread has fallen behind.
+         */
+        nframes_t read(sample_t * dest, nframes_t offset, nframes_t nframes,
+                       std::size_t chan=0) const;
+
+        /**
+         * Start streaming at @a samplerate, and wait until the buffer is at
+         * least half full. Does nothing if the stream is already running at
+         * this rate. Changing the rate during playback is not supported.
+         *
+         * @param samplerate - the target samplerate, or 0 to use the file's rate
+         */
+        void load_samples(nframes_t samplerate=0);
+
+private:
+        typedef boost::uint64_t count_type;
+
+        static void * thread(void * arg);       // thread entry point
+        void loop();                            // called by thread
+        nframes_t produce(sample_t * dest, nframes_t nframes);
+        void stop();
+
+        static long src_input(void * arg, float ** data);
+
+        std::string _name;
+        SF_INFO _sfinfo;
+        SNDFILE *_sndfile;
+        SRC_STATE *_src;
+
+        nframes_t _nframes;
+        nframes_t _samplerate;
+        nframes_t const _buffer_size;
+        double _ratio;                          // resampling ratio
+
+        boost::scoped_ptr<dsp::ringbuffer<sample_t> > _ring;
+        std::vector<sample_t> _inbuf;           // for libsamplerate
+        std::vector<sample_t> _outbuf;
+        nframes_t _pass_pos;                    // position of the writer in the pass
+
+        /* the reader's position in the stream (modified by read()) */
+        mutable count_type _read_pos;
+        mutable count_type _pass_start;
+
+        pthread_t _thread_id;
+        bool _running;
+        int _stopping;
+};
+
+}} // namespace jill::file
+
+#endif
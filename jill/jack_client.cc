@@ -11,24 +11,27 @@
  */
 #include "jack_client.hh"
 #include "logging.hh"
+#include "rt_logger.hh"
 #include "util/string.hh"
+#include "util/cycle_profiler.hh"
 #include <jack/statistics.h>
 #include <jack/midiport.h>
 #include <cerrno>
+#include <cstring>
 #include <algorithm>
 
 using namespace jill;
 using std::string;
 
 jack_client::jack_client(string const & name)
-        : _nports(0)
+        : _nports(0), _port_table(new port_table_type), _rt_table(_port_table)
 {
         start_client(name.c_str(), 0);
         set_callbacks();
 }
 
 jack_client::jack_client(string const & name, string const & server)
-        : _nports(0)
+        : _nports(0), _port_table(new port_table_type), _rt_table(_port_table)
 {
         if (!server.empty())
                 start_client(name.c_str(), server.c_str());
@@ -43,6 +46,10 @@ jack_client::~jack_client()
 	if (_client) {
                 jack_client_close(_client);
         }
+        std::list<port_table_type *>::const_iterator it;
+        for (it = _retired_tables.begin(); it != _retired_tables.end(); ++it)
+                delete *it;
+        delete _port_table;
 }
 
 void
@@ -69,6 +76,7 @@ jack_client::start_client(char const * name, char const * server_name)
 void
 jack_client::set_callbacks()
 {
+        jack_set_thread_init_callback(_client, &thread_init_callback_, static_cast<void*>(this));
         jack_set_process_callback(_client, &process_callback_, static_cast<void*>(this));
         jack_set_port_registration_callback(_client, &portreg_callback_, static_cast<void*>(this));
         jack_set_port_connect_callback(_client, &portconn_callback_, static_cast<void*>(this));
@@ -89,6 +97,7 @@ jack_client::register_port(string const & name, string const & type,
         }
         _ports.push_back(port);
         _nports += 1;
+        update_port_table();
         return port;
 }
 
@@ -108,9 +117,43 @@ jack_client::unregister_port(jack_port_t *port)
         }
         _ports.remove(port);
         _nports += -1;
+        update_port_table();
         LOG << "port unregistered: " << jack_port_name(port) ;
 }
 
+/*
+ * The process thread publishes the table it's using in _rt_table, and
+ * double-checks that it's still current, so a replaced table can be freed as
+ * soon as it's no longer in _rt_table.
+ */
+void
+jack_client::update_port_table()
+{
+        port_table_type * table = new port_table_type;
+        table->reserve(_nports);
+        port_list_type::const_iterator it;
+        for (it = _ports.begin(); it != _ports.end(); ++it) {
+                port_info_t info;
+                info.port = *it;
+                info.dtype = (strcmp(jack_port_type(*it), JACK_DEFAULT_MIDI_TYPE) == 0) ? EVENT : SAMPLED;
+                info.name = jack_port_short_name(*it);
+                table->push_back(info);
+        }
+        port_table_type * old = __sync_lock_test_and_set(&_port_table, table);
+        __sync_synchronize();
+        _retired_tables.push_back(old);
+
+        std::list<port_table_type *>::iterator rt = _retired_tables.begin();
+        while (rt != _retired_tables.end()) {
+                if (*rt == _rt_table)
+                        ++rt;
+                else {
+                        delete *rt;
+                        rt = _retired_tables.erase(rt);
+                }
+        }
+}
+
 void
 jack_client::activate()
 {
@@ -267,12 +310,33 @@ jack_client::time() const
  * registered by the user.
  */
 
+void
+jack_client::thread_init_callback_(void *arg)
+{
+        // allocate a realtime logging buffer for each thread JACK creates
+        rt_logger::instance().register_thread();
+}
+
 int
 jack_client::process_callback_(nframes_t nframes, void *arg)
 {
 	jack_client *self = static_cast<jack_client*>(arg);
         nframes_t time = jack_last_frame_time(self->_client);
-	return (self->_process_cb) ? self->_process_cb(self, nframes, time) : 0;
+        if (!self->_process_cb) return 0;
+
+        port_table_type * table;
+        do {
+                table = self->_port_table;
+                self->_rt_table = table;
+                __sync_synchronize();
+        } while (table != self->_port_table);
+
+        if (!self->_profiler) return self->_process_cb(self, nframes, time);
+
+        utime_t start = jack_get_time();
+        int ret = self->_process_cb(self, nframes, time);
+        self->_profiler->record(time, nframes, jack_get_time() - start);
+        return ret;
 }
 
 void
@@ -326,6 +390,8 @@ jack_client::xrun_callback_(void *arg)
 {
 	jack_client *self = static_cast<jack_client*>(arg);
         float delay = jack_get_xrun_delayed_usecs(self->_client);
+        // not called in the process thread, which is the only one registered
+        // with the realtime logger
         LOG << "jack xrun (us): " << delay ;
 	return (self->_xrun_cb) ? self->_xrun_cb(self, delay) : 0;
 }
@@ -375,3 +441,8 @@ void
 jack_client::set_shutdown_callback(ShutdownCallback const & cb) {
         _shutdown_cb = cb;
 }
+
+void
+jack_client::enable_profiling(float interval) {
+        _profiler.reset(new util::cycle_profiler(sampling_rate(), interval));
+}
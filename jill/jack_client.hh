@@ -14,8 +14,10 @@
 
 #include <string>
 #include <list>
+#include <vector>
 #include <boost/noncopyable.hpp>
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <jack/jack.h>
 #include "data_source.hh"
 
@@ -26,6 +28,8 @@
 
 namespace jill {
 
+namespace util { class cycle_profiler; }
+
 /**
  * @ingroup clientgroup
  * @brief Manages interactions with JACK system
@@ -90,6 +94,23 @@ public:
 
         typedef std::list<jack_port_t*> port_list_type;
 
+        /**
+         * Descriptor for a port owned by the client. The type and name are
+         * looked up when the port is registered, so that the process callback
+         * doesn't need to make any string comparisons.
+         */
+        struct port_info_t {
+                jack_port_t * port;     // the JACK port
+                dtype_t dtype;          // SAMPLED for audio ports, EVENT for midi
+                std::string name;       // short name of the port
+
+                /** the port's buffer for the current period */
+                void * buffer(nframes_t nframes) const {
+                        return jack_port_get_buffer(port, nframes);
+                }
+        };
+        typedef std::vector<port_info_t> port_table_type;
+
 	/**
 	 * Initialize a new JACK client. All clients are identified to the JACK
 	 * server by an alphanumeric name, which is specified here. Creates the
@@ -150,6 +171,17 @@ public:
 	void set_xrun_callback(XrunCallback const & cb);
         void set_shutdown_callback(ShutdownCallback const & cb);
 
+        /**
+         * Measure the duration of each call to the process callback and
+         * periodically log statistics about how much of the period budget it
+         * uses. Measurement is wait-free; statistics are logged from a
+         * background thread. Call before activating the client.
+         *
+         * @param interval  how often to log statistics (in seconds)
+         * @throws std::invalid_argument if interval is less than 1 ms
+         */
+        void enable_profiling(float interval);
+
         /** Activate the client. Do this before attempting to connect ports */
         void activate();
 
@@ -199,6 +231,15 @@ public:
         port_list_type const & ports() const { return _ports;}
         std::size_t nports() const { return _nports; }
 
+        /**
+         * Contiguous table of descriptors for the ports registered through
+         * this object. The table is rebuilt when ports are registered or
+         * unregistered and swapped in atomically. Only valid inside the
+         * process callback, where it's wait-free and consistent for the
+         * duration of the cycle.
+         */
+        port_table_type const & port_table() const { return *_rt_table; }
+
         /**
          * Look up a jack port by name. The port doesn't have to be owned by the
          * client. Not RT safe.
@@ -236,10 +277,20 @@ private:
         XrunCallback _xrun_cb;
         ShutdownCallback _shutdown_cb;
 
+        boost::scoped_ptr<util::cycle_profiler> _profiler;
+
+        // the current port table, and the one in use by the process thread
+        port_table_type * volatile _port_table;
+        port_table_type * volatile _rt_table;
+        // tables replaced but possibly still in use by the process thread
+        std::list<port_table_type *> _retired_tables;
+
         void start_client(char const * name, char const * server_name=0);
         void set_callbacks();
+        void update_port_table();
 
         /* static callback functions actually registered with JACK server */
+        static void thread_init_callback_(void *);
 	static int process_callback_(nframes_t, void *);
 	static void portreg_callback_(jack_port_id_t, int, void *);
 	static void portconn_callback_(jack_port_id_t, jack_port_id_t, int, void *);
@@ -14,6 +14,8 @@
 #include "zmq.hh"
 #include <sstream>
 #include <cstdio>
+#include <stdexcept>
+#include <sys/time.h>
 #include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -36,16 +38,28 @@ log_msg::~log_msg()
 logger::logger()
         // initialize zmq context and socket. Use a dealer socket because log
         // messages are asynchronous (no response from recipient).
-        : _context(zmq_init(1)), _socket(zmq_socket(_context, ZMQ_DEALER)),
+        : _head(0), _async(true), _running(true),
+          _context(zmq_init(1)), _socket(zmq_socket(_context, ZMQ_DEALER)),
           _connected(false)
 {
         pthread_mutex_init(&_lock, 0);
+        pthread_mutex_init(&_queue_lock, 0);
+        pthread_cond_init(&_ready, 0);
+        int ret = pthread_create(&_thread_id, NULL, logger::thread, this);
+        if (ret != 0)
+                throw std::runtime_error("Failed to start logging thread");
 }
 
 logger::~logger()
 {
         // note: this object may be destroyed before other objects, so it's
         // generally not a good idea to log in destructors
+        pthread_mutex_lock(&_queue_lock);
+        _running = false;
+        pthread_cond_signal(&_ready);
+        pthread_mutex_unlock(&_queue_lock);
+        pthread_join(_thread_id, NULL);
+        set_async(false);
         _connected = false;
         DBG << "cleaning up logger";
         // wait 1 s for server to handle any queued messages, then close the
@@ -55,33 +69,132 @@ logger::~logger()
         zmq_close(_socket);
         zmq_ctx_destroy(_context);
         pthread_mutex_destroy(&_lock);
+        pthread_mutex_destroy(&_queue_lock);
+        pthread_cond_destroy(&_ready);
 }
 
 void
 logger::log(timestamp_t const & utc, std::string const & msg)
+{
+        if (!_async) {
+                entry_t entry = { utc, msg, 0 };
+                pthread_mutex_lock(&_lock);
+                write(&entry);
+                pthread_mutex_unlock(&_lock);
+                return;
+        }
+        entry_t * entry = new entry_t;
+        entry->utc = utc;
+        entry->msg = msg;
+        do {
+                entry->next = _head;
+        } while (!__sync_bool_compare_and_swap(&_head, entry->next, entry));
+
+        // wake the writer thread if it's not busy
+        if (pthread_mutex_trylock(&_queue_lock) == 0) {
+                pthread_cond_signal(&_ready);
+                pthread_mutex_unlock(&_queue_lock);
+        }
+}
+
+void
+logger::set_async(bool async)
+{
+        if (!async) flush();
+        _async = async;
+}
+
+void
+logger::flush()
+{
+        pthread_mutex_lock(&_lock);
+        // take all the pending messages at once, and reverse the list to put
+        // them in chronological order
+        entry_t * entry = __sync_lock_test_and_set(&_head, 0);
+        entry_t * list = 0;
+        while (entry) {
+                entry_t * next = entry->next;
+                entry->next = list;
+                list = entry;
+                entry = next;
+        }
+        if (list) write(list);
+        pthread_mutex_unlock(&_lock);
+
+        while (list) {
+                entry_t * next = list->next;
+                delete list;
+                list = next;
+        }
+}
+
+void
+logger::write(entry_t const * entries)
 {
         typedef boost::date_time::c_local_adjustor<timestamp_t> local_adj;
-        timestamp_t local = local_adj::utc_to_local(utc);
-        // printf calls are generally threadsafe
-        printf("%s [%s] %s\n", to_iso_string(local).c_str(), _source.c_str(), msg.c_str());
+        std::string out;
+        for (entry_t const * e = entries; e; e = e->next) {
+                timestamp_t local = local_adj::utc_to_local(e->utc);
+                out += to_iso_string(local);
+                out += " [";
+                out += _source;
+                out += "] ";
+                out += e->msg;
+                out += '\n';
+        }
+        fputs(out.c_str(), stdout);
+        fflush(stdout);
 
         if (_connected) {
-                pthread_mutex_lock(&_lock);
-                // message consists of the source name, the timestamp (as an iso
-                // string), and the actual log message. Note that the zmq dealer socket
-                // doesn't prepend an address envelope, so this is what the recipient
-                // router socket will see
-                zmq::send(_socket, _source, ZMQ_SNDMORE);
-                zmq::send(_socket, to_iso_string(utc), ZMQ_SNDMORE);
-                zmq::send(_socket, msg);
-                pthread_mutex_unlock(&_lock);
+                // each entry consists of the source name, the timestamp (as an
+                // iso string), and the actual log message. Entries are sent as a
+                // single multipart message. Note that the zmq dealer socket
+                // doesn't prepend an address envelope, so this is what the
+                // recipient router socket will see
+                for (entry_t const * e = entries; e; e = e->next) {
+                        zmq::send(_socket, _source, ZMQ_SNDMORE);
+                        zmq::send(_socket, to_iso_string(e->utc), ZMQ_SNDMORE);
+                        zmq::send(_socket, e->msg, (e->next) ? ZMQ_SNDMORE : 0);
+                }
+        }
+}
+
+void *
+logger::thread(void * arg)
+{
+        logger * self = static_cast<logger *>(arg);
+        self->loop();
+        return 0;
+}
+
+void
+logger::loop()
+{
+        timeval now;
+        timespec deadline;
+
+        pthread_mutex_lock(&_queue_lock);
+        while (_running) {
+                if (_head == 0) {
+                        // time out in case a signal was missed
+                        gettimeofday(&now, 0);
+                        deadline.tv_sec = now.tv_sec + 1;
+                        deadline.tv_nsec = now.tv_usec * 1000L;
+                        pthread_cond_timedwait(&_ready, &_queue_lock, &deadline);
+                }
+                pthread_mutex_unlock(&_queue_lock);
+                flush();
+                pthread_mutex_lock(&_queue_lock);
         }
+        pthread_mutex_unlock(&_queue_lock);
 }
 
 void
 logger::set_sourcename(std::string const & name)
 {
+        pthread_mutex_lock(&_lock);
         _source = name;
+        pthread_mutex_unlock(&_lock);
 }
 
 void
@@ -95,7 +208,10 @@ logger::connect(std::string const & server_name)
         // and be transmitted when it does.
         std::ostringstream endpoint;
         endpoint << "ipc:///tmp/org.meliza.jill/" << server_name << "/msg";
-        if (zmq_connect(_socket, endpoint.str().c_str()) != 0) {
+        pthread_mutex_lock(&_lock);
+        int rc = zmq_connect(_socket, endpoint.str().c_str());
+        pthread_mutex_unlock(&_lock);
+        if (rc != 0) {
                 LOG << "error connecting to endpoint " << endpoint.str();
         }
         else {
@@ -12,6 +12,7 @@
 #ifndef _LOGGER_HH
 #define _LOGGER_HH
 
+#include <string>
 #include <boost/noncopyable.hpp>
 #include <pthread.h>
 
@@ -23,6 +24,13 @@ namespace jill {
  * have to interact with this directly except to set the source name, which is
  * used in formatting log messages, and to connect to the external logger.
  *
+ * By default, messages are written asynchronously. log() pushes the message onto
+ * a lock-free stack and returns; a dedicated thread collects all the pending
+ * messages, writes them to the console in a single call, and sends them to the
+ * external logger as a single multipart message (with three frames per log
+ * entry). Call set_async(false) to write each message synchronously in the
+ * calling thread.
+ *
  * This class is a singleton and can only be accessed through instance()
  */
 class logger : boost::noncopyable {
@@ -35,9 +43,19 @@ public:
                 return _instance;
         }
 
-        /** Log a timestamped message */
+        /** Log a timestamped message. Lock-free in asynchronous mode. */
         void log(timestamp_t const & utc, std::string const & msg);
 
+        /**
+         * Set whether messages are written asynchronously (the default) or
+         * synchronously by the calling thread. Pending messages are written
+         * before switching modes.
+         */
+        void set_async(bool async);
+
+        /** Write any pending messages. Blocks until they're written. */
+        void flush();
+
         /**
          * Set the source name, which is used to label log entries. The name of
          * the process is a good choice.
@@ -58,11 +76,29 @@ public:
         void connect(std::string const & server_name);
 
 private:
+        /** A queued message */
+        struct entry_t {
+                timestamp_t utc;
+                std::string msg;
+                entry_t * next;
+        };
+
         logger();
         ~logger();
 
+        static void * thread(void * arg); // thread entry point
+        void loop();                      // called by thread
+        void write(entry_t const * entries); // write a list of entries
+
         std::string _source;
-        pthread_mutex_t _lock;  // mutex for zmq socket access
+        entry_t * volatile _head;         // lock-free stack of pending messages
+        bool _async;
+        bool _running;
+
+        pthread_t _thread_id;
+        pthread_mutex_t _queue_lock;      // mutex for _ready
+        pthread_cond_t _ready;            // signals the thread to write messages
+        pthread_mutex_t _lock;            // mutex for console and zmq socket access
         void * _context;        // zmq context
         void * _socket;         // zmq socket
         bool _connected;        // was connection successful?
@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <string>
 #include <cstring>
+#include <boost/cstdint.hpp>
 #include <jack/midiport.h>
 
 /**
@@ -31,6 +32,7 @@ struct midi {
         const static data_type stim_on = 0x00;      // non-standard; message is a string
         const static data_type stim_off = 0x10;     // non-standard; message is a string
         const static data_type info = 0x20;         // non-standard; message is a string
+        const static data_type spike = 0x30;        // non-standard; message is binary (see write_spike)
 
         const static data_type note_off = 0x80;     // used for offsets
         const static data_type note_on = 0x90;      // used for onsets and single events
@@ -71,6 +73,62 @@ struct midi {
                         return ENOBUFS;
         }
 
+        /**
+         * The header of a spike message. The message is the status byte,
+         * this header, and then the waveform as an array of sample_t. None
+         * of the fields are aligned, so use read_spike() to decode it.
+         */
+        struct spike_header {
+                boost::uint32_t lag;        // samples from the peak to the event time
+                boost::uint16_t channel;    // the input channel
+                boost::uint16_t peak;       // the index of the peak in the waveform
+        };
+
+        /**
+         * Write a spike waveform to a midi buffer.
+         *
+         * @param buffer    the JACK midi buffer
+         * @param time      the offset of the message (in samples)
+         * @param header    the channel, peak index, and lag of the spike
+         * @param waveform  the waveform
+         * @param nsamples  the number of samples in the waveform
+         */
+        static int write_spike(void * buffer, nframes_t time, spike_header const & header,
+                               sample_t const * waveform, std::size_t nsamples) {
+                std::size_t len = 1 + sizeof(spike_header) + nsamples * sizeof(sample_t);
+                data_type *buf = jack_midi_event_reserve(buffer, time, len);
+                if (buf) {
+                        buf[0] = spike;
+                        memcpy(buf + 1, &header, sizeof(spike_header));
+                        memcpy(buf + 1 + sizeof(spike_header), waveform, nsamples * sizeof(sample_t));
+                        return 0;
+                }
+                else
+                        return ENOBUFS;
+        }
+
+        /**
+         * Decode a spike message.
+         *
+         * @param buffer    the message, starting with the status byte
+         * @param size      the size of the message
+         * @param header    set to the header of the message
+         * @param waveform  if not null, the waveform is copied here
+         * @return the number of samples in the waveform, or -1 if the
+         *         message isn't a spike
+         */
+        static int read_spike(void const * buffer, std::size_t size, spike_header & header,
+                              sample_t * waveform=0) {
+                data_type const * buf = reinterpret_cast<data_type const *>(buffer);
+                if (size < 1 + sizeof(spike_header) || buf[0] != spike)
+                        return -1;
+                memcpy(&header, buf + 1, sizeof(spike_header));
+                std::size_t nsamples = (size - 1 - sizeof(spike_header)) / sizeof(sample_t);
+                if (waveform)
+                        memcpy(waveform, buf + 1 + sizeof(spike_header), nsamples * sizeof(sample_t));
+                return nsamples;
+        }
+
         /**
          * Find an onset or offset event in a midi event stream.
          *
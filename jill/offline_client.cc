@@ -0,0 +1,162 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * additions Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <cmath>
+#include <algorithm>
+#include "offline_client.hh"
+#include "stimulus.hh"
+#include "logging.hh"
+
+using namespace jill;
+using std::size_t;
+using std::string;
+
+offline_client::offline_client(string const & name, nframes_t sampling_rate, nframes_t period_size)
+        : _name(name), _sampling_rate(sampling_rate), _period_size(period_size), _frame(0)
+{
+        LOG << "created offline client: " << name << " (rate=" << sampling_rate
+            << ", period=" << period_size << ")";
+}
+
+offline_client::~offline_client() {}
+
+size_t
+offline_client::add_input(string const & name, Generator const & gen)
+{
+        channel_t chan = { name, true, gen };
+        _channels.push_back(chan);
+        _buffer.resize(_channels.size() * _period_size);
+        return _channels.size() - 1;
+}
+
+size_t
+offline_client::add_output(string const & name)
+{
+        channel_t chan = { name, false, Generator() };
+        _channels.push_back(chan);
+        _buffer.resize(_channels.size() * _period_size);
+        return _channels.size() - 1;
+}
+
+void
+offline_client::set_process_callback(ProcessCallback const & cb)
+{
+        _process_cb = cb;
+}
+
+size_t
+offline_client::run(size_t nperiods)
+{
+        size_t i;
+        for (i = 0; i < nperiods; ++i) {
+                for (size_t c = 0; c < _channels.size(); ++c) {
+                        sample_t * buf = &_buffer[c * _period_size];
+                        if (_channels[c].gen)
+                                _channels[c].gen(buf, _period_size, _frame);
+                        else
+                                std::fill(buf, buf + _period_size, 0.0f);
+                }
+                int ret = (_process_cb) ? _process_cb(this, _period_size, _frame) : 0;
+                _frame += _period_size;
+                if (ret != 0) {
+                        i += 1;
+                        break;
+                }
+        }
+        return i;
+}
+
+sample_t *
+offline_client::samples(size_t channel)
+{
+        if (channel < _channels.size())
+                return &_buffer[channel * _period_size];
+        else
+                return 0;
+}
+
+sample_t *
+offline_client::samples(string const & name)
+{
+        for (size_t c = 0; c < _channels.size(); ++c) {
+                if (_channels[c].name == name)
+                        return samples(c);
+        }
+        return 0;
+}
+
+nframes_t
+offline_client::frame(utime_t usec) const
+{
+        return nframes_t(usec * _sampling_rate / 1000000);
+}
+
+utime_t
+offline_client::time(nframes_t frame) const
+{
+        return utime_t(frame) * 1000000 / _sampling_rate;
+}
+
+
+offline::sine::sine(nframes_t sampling_rate, double freq, sample_t amplitude)
+        : _omega(2 * M_PI * freq / sampling_rate), _amplitude(amplitude)
+{}
+
+void
+offline::sine::operator()(sample_t * buf, nframes_t nframes, nframes_t time) const
+{
+        for (nframes_t i = 0; i < nframes; ++i)
+                buf[i] = _amplitude * sin(_omega * (time + i));
+}
+
+offline::noise::noise(sample_t amplitude, unsigned int seed)
+        : _amplitude(amplitude), _state(seed)
+{}
+
+void
+offline::noise::operator()(sample_t * buf, nframes_t nframes, nframes_t)
+{
+        for (nframes_t i = 0; i < nframes; ++i) {
+                // numerical recipes LCG; the top bits are the most random
+                _state = _state * 1664525u + 1013904223u;
+                buf[i] = _amplitude * (float(_state >> 8) / (1 << 23) - 1.0f);
+        }
+}
+
+offline::bursts::bursts(nframes_t sampling_rate, double freq, sample_t amplitude,
+                        nframes_t burst_frames, nframes_t gap_frames)
+        : _sine(sampling_rate, freq, amplitude), _burst(burst_frames),
+          _cycle(burst_frames + gap_frames)
+{}
+
+void
+offline::bursts::operator()(sample_t * buf, nframes_t nframes, nframes_t time) const
+{
+        _sine(buf, nframes, time);
+        for (nframes_t i = 0; i < nframes; ++i) {
+                if ((time + i) % _cycle >= _burst)
+                        buf[i] = 0;
+        }
+}
+
+offline::stimulus::stimulus(stimulus_t const * stim, nframes_t gap_frames)
+        : _stim(stim), _cycle(stim->nframes() + gap_frames)
+{}
+
+void
+offline::stimulus::operator()(sample_t * buf, nframes_t nframes, nframes_t time) const
+{
+        sample_t const * samples = _stim->buffer();
+        nframes_t const n = _stim->nframes();
+        for (nframes_t i = 0; i < nframes; ++i) {
+                nframes_t offset = (time + i) % _cycle;
+                buf[i] = (samples && offset < n) ? samples[offset] : 0;
+        }
+}
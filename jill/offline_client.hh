@@ -0,0 +1,194 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * additions Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _OFFLINE_CLIENT_HH
+#define _OFFLINE_CLIENT_HH
+
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include "data_source.hh"
+
+namespace jill {
+
+class stimulus_t;
+
+/**
+ * @ingroup clientgroup
+ * @brief Drives a process callback without a JACK server
+ *
+ * This class provides a deterministic data_source for testing and
+ * benchmarking processing code offline. The clock is synthetic: the client
+ * starts at frame 0, and each call to the process callback advances the clock
+ * by one period. Time in microseconds is calculated from the frame count and
+ * the sampling rate, so results are reproducible and don't depend on how fast
+ * the callback runs.
+ *
+ * Input channels are filled by generator functions before each period, and
+ * output channels are zeroed. run() then calls the process callback in a tight
+ * loop, so the callback (and any data_thread it feeds) runs as fast as the
+ * hardware allows.
+ */
+class offline_client : public data_source {
+
+public:
+        /**
+         * Type of the process callback. The arguments are the same as
+         * jack_client::ProcessCallback.
+         *
+         * @param client  the current client object
+         * @param size    the number of samples in the buffers
+         * @param time    the frame count at the start of the period
+         * @return 0 to continue, non-zero to stop run()
+         */
+        typedef boost::function<int (offline_client* client, nframes_t size, nframes_t time)> ProcessCallback;
+
+        /**
+         * Type of the generator functions that fill input channels.
+         *
+         * @param buf      the buffer to fill
+         * @param nframes  the number of samples in the buffer
+         * @param time     the frame count at the start of the buffer
+         */
+        typedef boost::function<void (sample_t * buf, nframes_t nframes, nframes_t time)> Generator;
+
+        /**
+         * Initialize a new offline client.
+         *
+         * @param name           the name of the client
+         * @param sampling_rate  the sampling rate of the synthetic clock
+         * @param period_size    the number of samples in each period
+         */
+        offline_client(std::string const & name, nframes_t sampling_rate, nframes_t period_size);
+        ~offline_client();
+
+        /**
+         * Add an input channel.
+         *
+         * @param name  the name of the channel
+         * @param gen   the function used to fill the channel before each
+         *              period. If empty, the channel is filled with zeros.
+         * @return the index of the channel
+         */
+        std::size_t add_input(std::string const & name, Generator const & gen=Generator());
+
+        /**
+         * Add an output channel. Outputs are zeroed before each period.
+         *
+         * @return the index of the channel
+         */
+        std::size_t add_output(std::string const & name);
+
+        /** Set the process callback */
+        void set_process_callback(ProcessCallback const & cb);
+
+        /**
+         * Run the process callback for a number of periods, or until the
+         * callback returns a non-zero value.
+         *
+         * @return the number of periods processed
+         */
+        std::size_t run(std::size_t nperiods);
+
+        /** Get the sample buffer for a channel (by index or name), or 0 if it doesn't exist */
+        sample_t * samples(std::size_t channel);
+        sample_t * samples(std::string const & name);
+
+        /** The number of channels */
+        std::size_t nchannels() const { return _channels.size(); }
+        /** The name of a channel */
+        char const * channel_name(std::size_t channel) const { return _channels.at(channel).name.c_str(); }
+        /** True if the channel is an input */
+        bool is_input(std::size_t channel) const { return _channels.at(channel).input; }
+
+        /** The number of samples in each period */
+        nframes_t buffer_size() const { return _period_size; }
+
+        /* Implementations of data_source functions */
+        char const * name() const { return _name.c_str(); }
+        nframes_t sampling_rate() const { return _sampling_rate; }
+        nframes_t frame() const { return _frame; }
+        nframes_t frame(utime_t) const;
+        utime_t time(nframes_t) const;
+        utime_t time() const { return time(_frame); }
+
+private:
+        struct channel_t {
+                std::string name;
+                bool input;
+                Generator gen;
+        };
+
+        std::string const _name;
+        nframes_t const _sampling_rate;
+        nframes_t const _period_size;
+        nframes_t _frame;                 // frame count at the start of the current period
+
+        std::vector<channel_t> _channels;
+        std::vector<sample_t> _buffer;    // sample buffers for all channels, contiguous
+        ProcessCallback _process_cb;
+};
+
+/**
+ * Generator functions for offline_client. Each of these is deterministic, so
+ * that repeated runs produce identical data.
+ */
+namespace offline {
+
+/** Sinusoid with a given frequency (Hz) and amplitude */
+struct sine {
+        sine(nframes_t sampling_rate, double freq, sample_t amplitude=1.0);
+        void operator()(sample_t * buf, nframes_t nframes, nframes_t time) const;
+private:
+        double _omega;
+        sample_t _amplitude;
+};
+
+/** Uniform white noise in [-amplitude, amplitude), from a seeded generator */
+struct noise {
+        noise(sample_t amplitude=1.0, unsigned int seed=1);
+        void operator()(sample_t * buf, nframes_t nframes, nframes_t time);
+private:
+        sample_t _amplitude;
+        unsigned int _state;
+};
+
+/**
+ * Bursts of a sinusoid separated by silence. The first burst starts at frame
+ * 0, and bursts repeat every burst_frames + gap_frames samples.
+ */
+struct bursts {
+        bursts(nframes_t sampling_rate, double freq, sample_t amplitude,
+               nframes_t burst_frames, nframes_t gap_frames);
+        void operator()(sample_t * buf, nframes_t nframes, nframes_t time) const;
+private:
+        sine _sine;
+        nframes_t _burst;
+        nframes_t _cycle;
+};
+
+/**
+ * Plays a stimulus repeatedly, with a gap between presentations. The samples
+ * must be loaded at the client's sampling rate before the generator is used,
+ * and the stimulus must outlive the generator.
+ */
+struct stimulus {
+        stimulus(stimulus_t const * stim, nframes_t gap_frames);
+        void operator()(sample_t * buf, nframes_t nframes, nframes_t time) const;
+private:
+        stimulus_t const * _stim;
+        nframes_t _cycle;
+};
+
+}
+
+} // namespace jill
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#include <sys/time.h>
+#include <time.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "rt_logger.hh"
+#include "logger.hh"
+
+using namespace jill;
+using std::size_t;
+
+BOOST_STATIC_ASSERT((sizeof(rt_logger::record_t) & (sizeof(rt_logger::record_t) - 1)) == 0);
+
+// the ringbuffer for the current thread
+static __thread rt_logger::ring_type * thread_ring = 0;
+
+// how often the background thread checks for messages (ms)
+static const long poll_interval_ms = 100;
+
+rt_logger::rt_logger()
+        : _dropped(0), _total_dropped(0), _written(0), _running(true)
+{
+        // ensure the logger outlives this object so flush() works in the dtor
+        logger::instance();
+        pthread_mutex_init(&_lock, 0);
+        pthread_cond_init(&_stop, 0);
+        int ret = pthread_create(&_thread_id, NULL, rt_logger::thread, this);
+        if (ret != 0)
+                throw std::runtime_error("Failed to start realtime logging thread");
+}
+
+rt_logger::~rt_logger()
+{
+        pthread_mutex_lock(&_lock);
+        _running = false;
+        pthread_cond_signal(&_stop);
+        pthread_mutex_unlock(&_lock);
+        pthread_join(_thread_id, NULL);
+        flush();
+        std::list<ring_type *>::const_iterator it;
+        for (it = _rings.begin(); it != _rings.end(); ++it)
+                delete *it;
+        pthread_mutex_destroy(&_lock);
+        pthread_cond_destroy(&_stop);
+}
+
+void
+rt_logger::register_thread(size_t capacity)
+{
+        if (thread_ring) return;
+        ring_type * ring = new ring_type(capacity);
+        pthread_mutex_lock(&_lock);
+        _rings.push_back(ring);
+        pthread_mutex_unlock(&_lock);
+        thread_ring = ring;
+}
+
+size_t
+rt_logger::capacity() const
+{
+        return (thread_ring) ? thread_ring->size() : 0;
+}
+
+void
+rt_logger::log(char const * fmt, rt_arg const * args, size_t nargs)
+{
+        ring_type * ring = thread_ring;
+        if (ring == 0 || ring->write_space() == 0) {
+                __sync_add_and_fetch(&_dropped, 1);
+                __sync_add_and_fetch(&_total_dropped, 1);
+                return;
+        }
+        // write in place; only this thread pushes to the ring
+        record_t * rec = ring->buffer() + ring->write_offset();
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        rec->time = utime_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        rec->fmt = fmt;
+        rec->nargs = (nargs > max_args) ? max_args : nargs;
+        for (size_t i = 0; i < rec->nargs; ++i) {
+                rec->types[i] = args[i].type;
+                rec->values[i] = args[i].value;
+        }
+        ring->push(0, 1);
+}
+
+void
+rt_logger::flush()
+{
+        pthread_mutex_lock(&_lock);
+        std::list<ring_type *>::const_iterator it;
+        for (it = _rings.begin(); it != _rings.end(); ++it)
+                (*it)->pop(boost::bind(&rt_logger::write, this, _1, _2));
+        pthread_mutex_unlock(&_lock);
+
+        int dropped = __sync_fetch_and_and(&_dropped, 0);
+        if (dropped)
+                LOG << "realtime logger dropped " << dropped << " messages";
+}
+
+size_t
+rt_logger::write(record_t const * recs, size_t count)
+{
+        using namespace boost::posix_time;
+        static const ptime epoch(boost::gregorian::date(1970,1,1));
+        for (size_t i = 0; i < count; ++i) {
+                timestamp_t utc = epoch + microseconds(recs[i].time);
+                log_msg(utc) << format(recs[i]);
+        }
+        __sync_add_and_fetch(&_written, count);
+        return count;
+}
+
+std::string
+rt_logger::format(record_t const & rec)
+{
+        std::ostringstream os;
+        size_t arg = 0;
+        for (char const * p = rec.fmt; *p; ++p) {
+                if (p[0] == '{' && p[1] == '}' && arg < rec.nargs) {
+                        rt_arg::value_t const & v = rec.values[arg];
+                        switch (rec.types[arg]) {
+                        case rt_arg::INT: os << v.i; break;
+                        case rt_arg::UINT: os << v.u; break;
+                        case rt_arg::DOUBLE: os << v.d; break;
+                        case rt_arg::STRING: os << (v.s ? v.s : "(null)"); break;
+                        }
+                        arg += 1;
+                        p += 1;
+                }
+                else
+                        os << *p;
+        }
+        return os.str();
+}
+
+void *
+rt_logger::thread(void * arg)
+{
+        rt_logger * self = static_cast<rt_logger *>(arg);
+        self->loop();
+        return 0;
+}
+
+void
+rt_logger::loop()
+{
+        timeval now;
+        timespec deadline;
+
+        pthread_mutex_lock(&_lock);
+        while (_running) {
+                gettimeofday(&now, 0);
+                long nsec = now.tv_usec * 1000L + poll_interval_ms * 1000000L;
+                deadline.tv_sec = now.tv_sec + nsec / 1000000000L;
+                deadline.tv_nsec = nsec % 1000000000L;
+                pthread_cond_timedwait(&_stop, &_lock, &deadline);
+                pthread_mutex_unlock(&_lock);
+                flush();
+                pthread_mutex_lock(&_lock);
+        }
+        pthread_mutex_unlock(&_lock);
+}
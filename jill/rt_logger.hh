@@ -0,0 +1,172 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ */
+#ifndef _RT_LOGGER_HH
+#define _RT_LOGGER_HH
+
+#include <string>
+#include <list>
+#include <pthread.h>
+#include <boost/noncopyable.hpp>
+#include "types.hh"
+#include "logging.hh"
+#include "dsp/ringbuffer.hh"
+
+/*
+ * Realtime-safe logging. Usage:
+ *
+ * RTLOG("ringbuffer full (req={}; avail={})", size, avail);
+ *
+ * Arguments are substituted for the {} placeholders in order. At most
+ * rt_logger::max_args arguments are supported. String arguments are stored
+ * as pointers and are not copied, so they must remain valid until the
+ * message is written (string literals and stimulus names are fine).
+ */
+#define RTLOG jill::rt_log
+
+#define RTDBG \
+        if (DEBUG < 2) ; \
+        else jill::rt_log
+
+namespace jill {
+
+/** An argument to a realtime log message */
+struct rt_arg {
+        enum type_t { INT = 0, UINT, DOUBLE, STRING };
+        union value_t {
+                long long i;
+                unsigned long long u;
+                double d;
+                char const * s;
+        };
+        unsigned char type;
+        value_t value;
+
+        rt_arg(int v) : type(INT) { value.i = v; }
+        rt_arg(long v) : type(INT) { value.i = v; }
+        rt_arg(long long v) : type(INT) { value.i = v; }
+        rt_arg(unsigned int v) : type(UINT) { value.u = v; }
+        rt_arg(unsigned long v) : type(UINT) { value.u = v; }
+        rt_arg(unsigned long long v) : type(UINT) { value.u = v; }
+        rt_arg(float v) : type(DOUBLE) { value.d = v; }
+        rt_arg(double v) : type(DOUBLE) { value.d = v; }
+        rt_arg(char const * v) : type(STRING) { value.s = v; }
+};
+
+/**
+ * Logger for use in realtime threads. log() never allocates memory or takes
+ * a lock: the format string, the time, and the arguments are copied into a
+ * fixed-size record and pushed onto a lock-free ringbuffer owned by the
+ * calling thread. A background thread periodically empties the ringbuffers,
+ * formats the messages, and passes them on to the regular logger.
+ *
+ * Each thread that logs must first call register_thread() from a non-realtime
+ * context (jack_client does this in the JACK thread init callback). Messages
+ * from unregistered threads, or that arrive when a thread's ringbuffer is full,
+ * are dropped and counted.
+ *
+ * This class is a singleton and can only be accessed through instance()
+ */
+class rt_logger : boost::noncopyable {
+
+public:
+        static const std::size_t max_args = 4;
+
+        /** The record stored for each message */
+        struct record_t {
+                utime_t time;                    // wall-clock time (us since epoch)
+                char const * fmt;                // format string
+                rt_arg::value_t values[max_args];
+                unsigned char types[max_args];
+                unsigned int nargs;
+                char pad[8];                     // pad to a power of two
+        };
+        typedef dsp::ringbuffer<record_t> ring_type;
+
+        /** Access the instance of the logger */
+        static rt_logger & instance() {
+                static rt_logger _instance;
+                return _instance;
+        }
+
+        /**
+         * Allocate a ringbuffer for the calling thread. Not realtime safe. Does
+         * nothing if the thread is already registered.
+         *
+         * @param capacity  the number of messages that can be queued. May be
+         *                  rounded up (@see capacity())
+         */
+        void register_thread(std::size_t capacity=256);
+
+        /** The number of messages the calling thread can queue, or 0 if it's not registered */
+        std::size_t capacity() const;
+
+        /** Queue a message. Wait-free. */
+        void log(char const * fmt, rt_arg const * args, std::size_t nargs);
+
+        /** Format and write all queued messages. Not realtime safe. */
+        void flush();
+
+        /** The number of messages written since the logger started */
+        unsigned long written() const { return _written; }
+        /** The number of messages dropped since the logger started */
+        unsigned long dropped() const { return _total_dropped; }
+
+        /** Substitute the arguments of a record into its format string */
+        static std::string format(record_t const & rec);
+
+private:
+        rt_logger();
+        ~rt_logger();
+
+        static void * thread(void * arg); // thread entry point
+        void loop();                      // called by thread
+        std::size_t write(record_t const * recs, std::size_t count);
+
+        std::list<ring_type *> _rings;  // one per registered thread
+        int _dropped;                   // since the last flush
+        unsigned long _total_dropped;
+        unsigned long _written;
+        bool _running;
+
+        pthread_t _thread_id;
+        pthread_mutex_t _lock;          // protects _rings and _running
+        pthread_cond_t _stop;
+};
+
+inline void rt_log(char const * fmt) {
+        rt_logger::instance().log(fmt, 0, 0);
+}
+
+inline void rt_log(char const * fmt, rt_arg const & a1) {
+        rt_arg args[] = { a1 };
+        rt_logger::instance().log(fmt, args, 1);
+}
+
+inline void rt_log(char const * fmt, rt_arg const & a1, rt_arg const & a2) {
+        rt_arg args[] = { a1, a2 };
+        rt_logger::instance().log(fmt, args, 2);
+}
+
+inline void rt_log(char const * fmt, rt_arg const & a1, rt_arg const & a2, rt_arg const & a3) {
+        rt_arg args[] = { a1, a2, a3 };
+        rt_logger::instance().log(fmt, args, 3);
+}
+
+inline void rt_log(char const * fmt, rt_arg const & a1, rt_arg const & a2, rt_arg const & a3,
+                   rt_arg const & a4) {
+        rt_arg args[] = { a1, a2, a3, a4 };
+        rt_logger::instance().log(fmt, args, 4);
+}
+
+}
+
+#endif
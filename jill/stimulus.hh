@@ -11,6 +11,7 @@
 #ifndef _STIMULUS_HH
 #define _STIMULUS_HH
 
+#include <algorithm>
 #include <boost/noncopyable.hpp>
 #include "types.hh"
 
@@ -18,9 +19,13 @@ namespace jill {
 
 /**
  * ABC for a stimulus. Each stimulus has a name, a sampling rate, and a
- * length/duration. In order to present the stimulus, the samples need to be
- * accessible in a contiguous array, and may have to be generated or loaded from
- * disk.
+ * length/duration. The samples may have to be generated or loaded from disk
+ * before the stimulus is presented. Most stimuli are stored in a contiguous
+ * array (see buffer()), but long ones may be streamed (see read()).
+ *
+ * Stimuli may have more than one channel. The channels are stored in separate
+ * arrays (see channel()), which all have the same length and are presented
+ * together.
  *
  */
 class stimulus_t : boost::noncopyable {
@@ -39,12 +44,47 @@ public:
         /** The duration of the stimulus */
         virtual float duration() const { return float(nframes()) / samplerate(); }
 
+        /** The number of channels in the stimulus */
+        virtual std::size_t nchannels() const { return 1; }
+
         /**
-         * The buffer for the stimulus. May be 0 if not loaded. If not 0, the
-         * length of the array will be equal to nframes()
+         * The buffer for the stimulus (the first channel). May be 0 if not
+         * loaded. If not 0, the length of the array will be equal to nframes()
          */
         virtual sample_t const * buffer() const = 0;
 
+        /**
+         * The buffer for one channel of the stimulus. The default
+         * implementation returns buffer() for the first channel.
+         *
+         * @param chan  the channel, less than nchannels()
+         * @return the samples, or 0 if not loaded. If not 0, the length of
+         *         the array will be equal to nframes()
+         */
+        virtual sample_t const * channel(std::size_t chan) const {
+                return (chan == 0) ? buffer() : 0;
+        }
+
+        /**
+         * Copy samples to a destination buffer. The default implementation
+         * copies from channel(). Stimuli that are not held in memory need to
+         * override this function. Must be wait-free.
+         *
+         * @param dest     the destination buffer
+         * @param offset   the position of the first sample in the stimulus
+         * @param nframes  the number of samples to copy
+         * @param chan     the channel to copy
+         * @return the number of samples copied
+         */
+        virtual nframes_t read(sample_t * dest, nframes_t offset, nframes_t nframes,
+                               std::size_t chan=0) const {
+                sample_t const * buf = channel(chan);
+                if (buf == 0 || offset >= this->nframes()) return 0;
+                nframes = std::min(nframes, this->nframes() - offset);
+                std::copy(buf + offset, buf + offset + nframes, dest);
+                return nframes;
+        }
+
         /**
          * Load samples and resample as needed.  Only needs to be called if
          * buffer() == 0, but may be called multiple times.
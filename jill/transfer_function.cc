@@ -1,3 +1,4 @@
+#include <stdexcept>
 #include "transfer_function.hh"
 #include "program_options.hh"
 #include "logging.hh"
@@ -10,12 +11,15 @@ transfer_function::transfer_function(poly b, poly a) {
         _numerator=b;
         _denominator=a;
         _is_analog_bool=true;
+        _gain=1;
+        _has_zpk=false;
 }
 
 transfer_function::transfer_function(std::vector<complex_t> z, 
                                      std::vector<complex_t> p,
-                                     COEF_t k) {
-        complex_t identity[0];
+                                     COEF_t k)
+        : _zeros(z), _poles(p), _gain(k), _has_zpk(true) {
+        complex_t identity[1];
         identity[0] = complex_t(1,0);
         complex_poly num(identity, 0);
         complex_poly denom(identity, 0);
@@ -65,8 +69,14 @@ transfer_function::normalize(){
 
 
 
-void 
+void
 transfer_function::transform(poly transform_num, poly transform_denom){
+        _transform(transform_num, transform_denom);
+        _has_zpk = false;
+}
+
+void
+transfer_function::_transform(poly transform_num, poly transform_denom){
        
        
        // denominator of transform raised to nth power is multipled by
@@ -105,9 +115,26 @@ transfer_function::bilinear() {
 
        COEF_t num[n+1] = {2, -2};
        COEF_t denom[n+1] = {1, 1};
-       transform(poly(num,n), poly(denom,n));
+       _transform(poly(num,n), poly(denom,n));
+
+       // s = fs2 (z - 1) / (z + 1), with fs2 = 2 to match the polynomial
+       // transform. Zeros at infinity map to z = -1.
+       if (_has_zpk) {
+               const COEF_t fs2 = 2;
+               complex_t gnum(1,0), gdenom(1,0);
+               for (size_t i = 0; i < _zeros.size(); ++i) {
+                       gnum *= fs2 - _zeros[i];
+                       _zeros[i] = (fs2 + _zeros[i]) / (fs2 - _zeros[i]);
+               }
+               for (size_t i = 0; i < _poles.size(); ++i) {
+                       gdenom *= fs2 - _poles[i];
+                       _poles[i] = (fs2 + _poles[i]) / (fs2 - _poles[i]);
+               }
+               _zeros.resize(_poles.size(), complex_t(-1,0));
+               _gain *= (gnum / gdenom).real();
+       }
 
-       _is_analog_bool=false;  
+       _is_analog_bool=false;
  }
 
 void
@@ -121,7 +148,13 @@ transfer_function::lp2lp(std::vector<COEF_t> Wn) {
 
         COEF_t num[2] = {0, 1};
         COEF_t denom[2] = {Wn[0], 0};
-        transform(poly(num,1), poly(denom,1));
+        _transform(poly(num,1), poly(denom,1));
+
+        if (_has_zpk) {
+                for (size_t i = 0; i < _zeros.size(); ++i) _zeros[i] *= Wn[0];
+                for (size_t i = 0; i < _poles.size(); ++i) _poles[i] *= Wn[0];
+                _gain *= std::pow(Wn[0], (int)(_poles.size() - _zeros.size()));
+        }
 }
 
 
@@ -137,7 +170,22 @@ transfer_function::lp2hp(std::vector<COEF_t> Wn) {
 
         COEF_t num[2] = {Wn[0], 0};
         COEF_t denom[2] = {0, 1};
-        transform(poly(num, 1), poly(denom, 1));       
+        _transform(poly(num, 1), poly(denom, 1));
+
+        // s -> Wn/s; zeros at infinity map to the origin
+        if (_has_zpk) {
+                complex_t gnum(1,0), gdenom(1,0);
+                for (size_t i = 0; i < _zeros.size(); ++i) {
+                        gnum *= -_zeros[i];
+                        _zeros[i] = Wn[0] / _zeros[i];
+                }
+                for (size_t i = 0; i < _poles.size(); ++i) {
+                        gdenom *= -_poles[i];
+                        _poles[i] = Wn[0] / _poles[i];
+                }
+                _zeros.resize(_poles.size(), complex_t(0,0));
+                _gain *= (gnum / gdenom).real();
+        }
 }
 
 void 
@@ -153,7 +201,32 @@ transfer_function::lp2bp(std::vector<COEF_t> Wn) {
  
         COEF_t num[3] = {Wn[0]*Wn[1], 0, 1};
         COEF_t denom[2] = {0, Wn[1]-Wn[0]};
-        transform(poly(num, 2), poly(denom, 1));
+        _transform(poly(num, 2), poly(denom, 1));
+
+        // s -> (s^2 + w0^2) / (s bw); each root r splits into two roots of
+        // s^2 - r bw s + w0^2, and zeros at infinity map to the origin
+        if (_has_zpk) {
+                const COEF_t bw = Wn[1] - Wn[0];
+                const COEF_t w0sq = Wn[0] * Wn[1];
+                const int degree = _poles.size() - _zeros.size();
+                std::vector<complex_t> z, p;
+                for (size_t i = 0; i < _zeros.size(); ++i) {
+                        complex_t r = _zeros[i] * bw / 2.0;
+                        complex_t d = std::sqrt(r * r - w0sq);
+                        z.push_back(r + d);
+                        z.push_back(r - d);
+                }
+                for (size_t i = 0; i < _poles.size(); ++i) {
+                        complex_t r = _poles[i] * bw / 2.0;
+                        complex_t d = std::sqrt(r * r - w0sq);
+                        p.push_back(r + d);
+                        p.push_back(r - d);
+                }
+                z.resize(z.size() + degree, complex_t(0,0));
+                _zeros.swap(z);
+                _poles.swap(p);
+                _gain *= std::pow(bw, degree);
+        }
 
 }
 
@@ -170,8 +243,39 @@ transfer_function::lp2bs(std::vector<COEF_t> Wn) {
         if (Wn[0] > Wn[1]) std::reverse(Wn.begin(),Wn.end());                         
 
         COEF_t num[2] = {0, Wn[1]-Wn[0]};
-        COEF_t denom[3] = {Wn[0]*Wn[1], 0, 1}; 
-        transform(poly(num, 1), poly(denom, 2));
+        COEF_t denom[3] = {Wn[0]*Wn[1], 0, 1};
+        _transform(poly(num, 1), poly(denom, 2));
+
+        // s -> s bw / (s^2 + w0^2); each root r splits into two roots of
+        // s^2 - (bw/r) s + w0^2, and zeros at infinity map to +/- j w0
+        if (_has_zpk) {
+                const COEF_t bw = Wn[1] - Wn[0];
+                const COEF_t w0sq = Wn[0] * Wn[1];
+                const int degree = _poles.size() - _zeros.size();
+                complex_t gnum(1,0), gdenom(1,0);
+                std::vector<complex_t> z, p;
+                for (size_t i = 0; i < _zeros.size(); ++i) {
+                        gnum *= -_zeros[i];
+                        complex_t r = (bw / 2.0) / _zeros[i];
+                        complex_t d = std::sqrt(r * r - w0sq);
+                        z.push_back(r + d);
+                        z.push_back(r - d);
+                }
+                for (size_t i = 0; i < _poles.size(); ++i) {
+                        gdenom *= -_poles[i];
+                        complex_t r = (bw / 2.0) / _poles[i];
+                        complex_t d = std::sqrt(r * r - w0sq);
+                        p.push_back(r + d);
+                        p.push_back(r - d);
+                }
+                for (int i = 0; i < degree; ++i) {
+                        z.push_back(complex_t(0, std::sqrt(w0sq)));
+                        z.push_back(complex_t(0, -std::sqrt(w0sq)));
+                }
+                _zeros.swap(z);
+                _poles.swap(p);
+                _gain *= (gnum / gdenom).real();
+        }
 
 }
 
@@ -192,3 +296,134 @@ transfer_function::transform_prototype(std::vector<COEF_t> Wn,
                 lp2bs(Wn);
         }
 }
+
+/*
+ * Helpers for sos(). Roots are split into real roots and complex roots with
+ * positive imaginary part (each standing for a conjugate pair).
+ */
+namespace {
+
+typedef transfer_function::complex_t complex_t;
+
+bool
+is_real(complex_t const & x)
+{
+        return std::abs(x.imag()) <= 1e-10 * std::max(1.0, std::abs(x));
+}
+
+void
+split_roots(std::vector<complex_t> const & roots,
+            std::vector<complex_t> & reals, std::vector<complex_t> & pairs)
+{
+        for (size_t i = 0; i < roots.size(); ++i) {
+                if (is_real(roots[i]))
+                        reals.push_back(complex_t(roots[i].real(), 0));
+                else if (roots[i].imag() > 0)
+                        pairs.push_back(roots[i]);
+        }
+}
+
+double
+circle_dist(complex_t const & x)
+{
+        return std::abs(1 - std::abs(x));
+}
+
+/* index of the element of v closest to the unit circle */
+size_t
+outermost(std::vector<complex_t> const & v)
+{
+        size_t best = 0;
+        for (size_t i = 1; i < v.size(); ++i) {
+                if (circle_dist(v[i]) < circle_dist(v[best]))
+                        best = i;
+        }
+        return best;
+}
+
+/* index of the element of v nearest to x */
+size_t
+nearest(std::vector<complex_t> const & v, complex_t const & x)
+{
+        size_t best = 0;
+        for (size_t i = 1; i < v.size(); ++i) {
+                if (std::abs(v[i] - x) < std::abs(v[best] - x))
+                        best = i;
+        }
+        return best;
+}
+
+complex_t
+take(std::vector<complex_t> & v, size_t i)
+{
+        complex_t ret = v[i];
+        v.erase(v.begin() + i);
+        return ret;
+}
+
+}
+
+std::vector<biquad_t>
+transfer_function::sos() const
+{
+        if (!_has_zpk || _is_analog_bool)
+                throw std::logic_error("sos() requires a digital system with known zeros and poles");
+
+        // pad with roots at the origin so there are an even number of each
+        size_t nsections = (std::max(_zeros.size(), _poles.size()) + 1) / 2;
+        std::vector<complex_t> z(_zeros), p(_poles);
+        z.resize(nsections * 2, complex_t(0,0));
+        p.resize(nsections * 2, complex_t(0,0));
+
+        std::vector<complex_t> preal, ppair, zreal, zpair;
+        split_roots(p, preal, ppair);
+        split_roots(z, zreal, zpair);
+
+        std::vector<biquad_t> sections;
+        while (!preal.empty() || !ppair.empty()) {
+                complex_t p1, p2, z1, z2;
+                // take the pole (or conjugate pair) closest to the unit
+                // circle. Real poles are taken two at a time; there's always
+                // an even number of them.
+                if (preal.empty() || (!ppair.empty() &&
+                                      circle_dist(ppair[outermost(ppair)]) <
+                                      circle_dist(preal[outermost(preal)]))) {
+                        p1 = take(ppair, outermost(ppair));
+                        p2 = std::conj(p1);
+                }
+                else {
+                        p1 = take(preal, outermost(preal));
+                        p2 = take(preal, outermost(preal));
+                }
+
+                // take the zero (or conjugate pair) nearest to the first pole
+                complex_t p1_upper(p1.real(), std::abs(p1.imag()));
+                if (zreal.size() < 2 || (!zpair.empty() &&
+                                         std::abs(zpair[nearest(zpair, p1_upper)] - p1_upper) <
+                                         std::abs(zreal[nearest(zreal, p1)] - p1))) {
+                        z1 = take(zpair, nearest(zpair, p1_upper));
+                        z2 = std::conj(z1);
+                }
+                else {
+                        z1 = take(zreal, nearest(zreal, p1));
+                        z2 = take(zreal, nearest(zreal, p2));
+                }
+
+                biquad_t s;
+                s.b0 = 1;
+                s.b1 = -(z1 + z2).real();
+                s.b2 = (z1 * z2).real();
+                s.a1 = -(p1 + p2).real();
+                s.a2 = (p1 * p2).real();
+                sections.push_back(s);
+        }
+
+        // poles closest to the unit circle go last, and the gain goes first
+        std::reverse(sections.begin(), sections.end());
+        if (!sections.empty()) {
+                sections[0].b0 *= _gain;
+                sections[0].b1 *= _gain;
+                sections[0].b2 *= _gain;
+        }
+        return sections;
+}
@@ -1,5 +1,5 @@
 #ifndef _TRANSFER_FUNCTION_HH
-#define _TRANSFER__FUNCTION_HH 1
+#define _TRANSFER_FUNCTION_HH 1
 
 #include <boost/math/tools/polynomial.hpp>
 #include <jack/jack.h>
@@ -10,6 +10,15 @@
 
 namespace jill {
 
+/**
+ * A second-order section of a digital filter, with transfer function
+ *
+ *   H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+ */
+struct biquad_t {
+        double b0, b1, b2, a1, a2;
+};
+
 class transfer_function {
 
 public: 
@@ -34,6 +43,26 @@ public:
         poly denom(){return _denominator;}
         bool is_analog(){return _is_analog_bool;}
 
+        /*
+         * If the system was constructed from zeros, poles, and gain, these
+         * are kept up to date by the prototype transformations and bilinear(),
+         * which is much more accurate than factoring the polynomials for
+         * high-order systems. transform() invalidates them.
+         */
+        bool has_zpk() const {return _has_zpk;}
+        std::vector<complex_t> const & zeros() const {return _zeros;}
+        std::vector<complex_t> const & poles() const {return _poles;}
+        COEF_t gain() const {return _gain;}
+
+        /*
+         * Convert a digital system to a cascade of second-order sections.
+         * Poles are paired with their conjugates and with the nearest
+         * zeros, and sections are ordered with the poles closest to the unit
+         * circle last. The gain is applied in the first section. Requires
+         * has_zpk() and !is_analog().
+         */
+        std::vector<biquad_t> sos() const;
+
 
         void transform(poly transform_num, poly transform_denom);
  
@@ -54,6 +83,13 @@ protected:
         poly _numerator;
         poly _denominator;
         bool _is_analog_bool;
+
+        std::vector<complex_t> _zeros;
+        std::vector<complex_t> _poles;
+        COEF_t _gain;
+        bool _has_zpk;
+
+        void _transform(poly transform_num, poly transform_denom);
 }; 
 
 } //namespace jill
@@ -63,6 +63,7 @@ struct data_block_t {
         dtype_t dtype;          // the type of data in the block
         std::size_t sz_id;      // the number of bytes in the id
         std::size_t sz_data;    // the number of bytes in the data
+        nframes_t decimation;   // sampled data: the number of frames per sample
 
         /** total size of the data, including header */
         std::size_t size() const { return sizeof(data_block_t) + sz_id + sz_data; }
@@ -83,6 +84,14 @@ struct data_block_t {
                 // TODO change if multiple events in a block
                 return (dtype == SAMPLED) ? sz_data / sizeof(sample_t) : 1;
         }
+
+        /**
+         * number of frames (at the server rate) spanned by the block. Differs
+         * from nframes() if the data have been decimated.
+         */
+        nframes_t duration() const {
+                return (dtype == SAMPLED) ? nframes() * decimation : 1;
+        }
 }; // does this need to be packed?
 
 /** Base type for all jill errors */
@@ -0,0 +1,151 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * additions Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <sys/time.h>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include "../logging.hh"
+#include "cycle_profiler.hh"
+
+using namespace jill::util;
+using std::size_t;
+
+cycle_profiler::cycle_profiler(nframes_t sampling_rate, float interval, size_t capacity)
+        : _cycles(capacity), _sampling_rate(sampling_rate),
+          _interval_ms(interval * 1000), _dropped(0), _running(true)
+{
+        // a zero interval would make the publishing thread spin
+        if (_interval_ms < 1)
+                throw std::invalid_argument("profiling interval must be at least 1 ms");
+        reset();
+        pthread_mutex_init(&_lock, 0);
+        pthread_cond_init(&_stop, 0);
+        int ret = pthread_create(&_thread_id, NULL, cycle_profiler::thread, this);
+        if (ret != 0)
+                throw std::runtime_error("Failed to start profiler thread");
+        LOG << "profiling process callback every " << interval << " s";
+}
+
+cycle_profiler::~cycle_profiler()
+{
+        stop();
+        pthread_mutex_destroy(&_lock);
+        pthread_cond_destroy(&_stop);
+}
+
+void
+cycle_profiler::stop()
+{
+        pthread_mutex_lock(&_lock);
+        if (!_running) {
+                pthread_mutex_unlock(&_lock);
+                return;
+        }
+        _running = false;
+        pthread_cond_signal(&_stop);
+        pthread_mutex_unlock(&_lock);
+        pthread_join(_thread_id, NULL);
+}
+
+void *
+cycle_profiler::thread(void * arg)
+{
+        cycle_profiler * self = static_cast<cycle_profiler *>(arg);
+        self->loop();
+        return 0;
+}
+
+void
+cycle_profiler::loop()
+{
+        timeval now;
+        timespec deadline;
+
+        pthread_mutex_lock(&_lock);
+        while (_running) {
+                gettimeofday(&now, 0);
+                long nsec = now.tv_usec * 1000L + (_interval_ms % 1000) * 1000000L;
+                deadline.tv_sec = now.tv_sec + _interval_ms / 1000 + nsec / 1000000000L;
+                deadline.tv_nsec = nsec % 1000000000L;
+                while (_running &&
+                       pthread_cond_timedwait(&_stop, &_lock, &deadline) != ETIMEDOUT);
+                _cycles.pop(boost::bind(&cycle_profiler::accumulate, this, _1, _2));
+                publish();
+        }
+        pthread_mutex_unlock(&_lock);
+}
+
+size_t
+cycle_profiler::accumulate(cycle_t const * cycles, size_t count)
+{
+        for (size_t i = 0; i < count; ++i) {
+                cycle_t const & c = cycles[i];
+                double load = double(c.usec) * _sampling_rate / (1e6 * c.nframes);
+                _count += 1;
+                _total_usec += c.usec;
+                _total_load += load;
+
+                // bin 0 is < 1/128; bin nbins-1 is >= 1 (an overrun)
+                size_t bin = nbins - 1;
+                for (double edge = 1.0; bin > 0 && load < edge; edge /= 2)
+                        bin -= 1;
+                _hist[bin] += 1;
+
+                // keep the worst cycles sorted in descending order
+                for (size_t j = 0; j < nworst; ++j) {
+                        if (load > _worst_load[j]) {
+                                for (size_t k = nworst - 1; k > j; --k) {
+                                        _worst[k] = _worst[k-1];
+                                        _worst_load[k] = _worst_load[k-1];
+                                }
+                                _worst[j] = c;
+                                _worst_load[j] = load;
+                                break;
+                        }
+                }
+        }
+        return count;
+}
+
+void
+cycle_profiler::publish()
+{
+        int dropped = __sync_fetch_and_and(&_dropped, 0);
+        if (_count > 0) {
+                LOG << "process callback: cycles=" << _count
+                    << ", mean=" << _total_usec / _count << " us"
+                    << " (" << 100 * _total_load / _count << "%)"
+                    << ", max=" << _worst[0].usec << " us"
+                    << " (" << 100 * _worst_load[0] << "%)"
+                    << ", dropped=" << dropped;
+                log_msg hist;
+                hist << "process callback load histogram: <1/128:" << _hist[0];
+                for (size_t i = 1; i < nbins - 1; ++i)
+                        hist << " <1/" << (1 << (nbins - 2 - i)) << ":" << _hist[i];
+                hist << " >=1:" << _hist[nbins - 1];
+        }
+        for (size_t i = 0; i < nworst && i < _count; ++i) {
+                LOG << "process callback worst cycle " << i + 1 << ": frame=" << _worst[i].time
+                    << ", nframes=" << _worst[i].nframes << ", duration=" << _worst[i].usec << " us"
+                    << " (" << 100 * _worst_load[i] << "%)";
+        }
+        reset();
+}
+
+void
+cycle_profiler::reset()
+{
+        _count = 0;
+        _total_usec = _total_load = 0;
+        std::fill(_hist, _hist + nbins, 0);
+        std::fill(_worst_load, _worst_load + nworst, -1.0);
+}
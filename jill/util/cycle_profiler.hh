@@ -0,0 +1,101 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * additions Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _CYCLE_PROFILER_HH
+#define _CYCLE_PROFILER_HH
+
+#include <pthread.h>
+#include <boost/noncopyable.hpp>
+#include "../types.hh"
+#include "../dsp/ringbuffer.hh"
+
+namespace jill { namespace util {
+
+/**
+ * Measures how much of the period budget a realtime process callback uses.
+ *
+ * The realtime thread calls record() once per cycle with the duration of the
+ * callback. Records are passed through a lock-free ringbuffer, so record() is
+ * wait-free and never allocates. A background thread wakes up at a fixed
+ * interval, drains the ringbuffer, and logs summary statistics: the number of
+ * cycles, the mean and maximum duration, the fraction of the period budget
+ * (nframes / sampling rate) used, a histogram of that fraction in log2 bins,
+ * and the frame times of the worst cycles.
+ */
+class cycle_profiler : boost::noncopyable {
+
+public:
+        /** The record stored for each cycle */
+        struct cycle_t {
+                nframes_t time;         // frame time at the start of the cycle
+                nframes_t nframes;      // period size
+                utime_t usec;           // duration of the callback (us)
+        };
+
+        /** number of histogram bins: < 1/128, ..., 1/2 - 1, and >= 1 */
+        static const std::size_t nbins = 9;
+        /** number of worst-case cycles reported per interval */
+        static const std::size_t nworst = 3;
+
+        /**
+         * Initialize the profiler and start the publishing thread.
+         *
+         * @param sampling_rate  the sampling rate of the data stream, used to
+         *                       calculate the time budget of each period
+         * @param interval       how often to log statistics (in seconds)
+         * @param capacity       the number of cycles that can be stored
+         *                       between publications. Cycles are dropped
+         *                       (and counted) if the buffer fills.
+         * @throws std::invalid_argument if interval is less than 1 ms
+         */
+        cycle_profiler(nframes_t sampling_rate, float interval, std::size_t capacity=4096);
+        ~cycle_profiler();
+
+        /** Store the duration of a cycle. Wait-free. */
+        void record(nframes_t time, nframes_t nframes, utime_t usec) {
+                cycle_t c = { time, nframes, usec };
+                if (_cycles.push(c) == 0)
+                        __sync_add_and_fetch(&_dropped, 1);
+        }
+
+        /** Stop the publishing thread. Remaining records are logged. */
+        void stop();
+
+private:
+        static void * thread(void * arg); // thread entry point
+        void loop();                      // called by thread
+        void publish();                   // log statistics and reset
+        void reset();                     // clear statistics
+
+        /** visitor for the ringbuffer; accumulates statistics */
+        std::size_t accumulate(cycle_t const * cycles, std::size_t count);
+
+        dsp::ringbuffer<cycle_t> _cycles;
+        nframes_t const _sampling_rate;
+        long const _interval_ms;
+        int _dropped;
+        bool _running;
+
+        // statistics for the current interval (owned by the publishing thread)
+        std::size_t _count;
+        double _total_usec;
+        double _total_load;
+        std::size_t _hist[nbins];
+        cycle_t _worst[nworst];
+        double _worst_load[nworst];
+
+        pthread_t _thread_id;
+        pthread_mutex_t _lock;
+        pthread_cond_t _stop;
+};
+
+}} // namespace jill::util
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <pthread.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include "load_stimuli.hh"
+#include "../logging.hh"
+
+using namespace jill;
+
+namespace {
+
+/* state shared by the worker threads */
+struct load_state {
+        std::vector<stimulus_t *> const * stimuli;
+        nframes_t samplerate;
+        std::size_t next;               // index of the next stimulus to load
+        std::size_t done;               // number of stimuli loaded
+        std::string error;              // the first error
+        pthread_mutex_t lock;           // protects error
+};
+
+/*
+ * Workers take stimuli from the list in order with an atomic increment, so
+ * long and short stimuli are balanced across threads without any scheduling.
+ */
+void *
+load_worker(void * arg)
+{
+        load_state * state = static_cast<load_state *>(arg);
+        std::size_t const n = state->stimuli->size();
+        std::size_t i;
+        while ((i = __sync_fetch_and_add(&state->next, 1)) < n) {
+                stimulus_t * stim = state->stimuli->at(i);
+                try {
+                        stim->load_samples(state->samplerate);
+                }
+                catch (std::exception const & e) {
+                        pthread_mutex_lock(&state->lock);
+                        if (state->error.empty())
+                                state->error = std::string(stim->name()) + ": " + e.what();
+                        pthread_mutex_unlock(&state->lock);
+                }
+                __sync_add_and_fetch(&state->done, 1);
+        }
+        return 0;
+}
+
+}
+
+std::size_t
+util::nprocessors()
+{
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return (n > 0) ? n : 1;
+}
+
+void
+util::load_stimuli(std::vector<stimulus_t *> const & stimuli, nframes_t samplerate,
+                   std::size_t nthreads, load_progress_fun progress)
+{
+        load_state state;
+        state.stimuli = &stimuli;
+        state.samplerate = samplerate;
+        state.next = state.done = 0;
+        pthread_mutex_init(&state.lock, 0);
+
+        if (nthreads == 0)
+                nthreads = nprocessors();
+        nthreads = std::min(nthreads, stimuli.size());
+        std::vector<pthread_t> threads;
+        for (std::size_t i = 0; i < nthreads; ++i) {
+                pthread_t id;
+                if (pthread_create(&id, NULL, load_worker, &state) != 0)
+                        break;
+                threads.push_back(id);
+        }
+        // if no threads could be started, load the stimuli in this one
+        if (threads.empty())
+                load_worker(&state);
+
+        std::size_t reported = 0;
+        std::size_t elapsed = 0;        // in ms
+        while (__sync_fetch_and_add(&state.done, 0) < stimuli.size()) {
+                usleep(100000);
+                elapsed += 100;
+                std::size_t done = __sync_fetch_and_add(&state.done, 0);
+                if (progress && elapsed >= 1000 && done != reported) {
+                        progress(done, stimuli.size());
+                        reported = done;
+                        elapsed = 0;
+                }
+        }
+        for (std::vector<pthread_t>::iterator it = threads.begin(); it != threads.end(); ++it)
+                pthread_join(*it, NULL);
+        pthread_mutex_destroy(&state.lock);
+
+        if (progress)
+                progress(stimuli.size(), stimuli.size());
+        if (!state.error.empty())
+                throw std::runtime_error(state.error);
+}
@@ -0,0 +1,45 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _LOAD_STIMULI_HH
+#define _LOAD_STIMULI_HH
+
+#include <vector>
+#include <boost/function.hpp>
+#include "../stimulus.hh"
+
+namespace jill { namespace util {
+
+/** Called with the number of stimuli that have been loaded and the total */
+typedef boost::function<void (std::size_t, std::size_t)> load_progress_fun;
+
+/**
+ * Load (and resample) a set of stimuli in parallel. Each stimulus is loaded by
+ * one of a pool of threads, and the function returns when all of them are
+ * ready. Stimuli must be distinct objects, because load_samples() is not
+ * thread-safe for a single stimulus.
+ *
+ * @param stimuli     the stimuli to load
+ * @param samplerate  the target sampling rate (@see stimulus_t::load_samples)
+ * @param nthreads    the number of threads, or 0 for the number of processors
+ * @param progress    if not empty, called in the calling thread about once a
+ *                    second and when all stimuli are loaded
+ *
+ * @throws the first error encountered loading a stimulus, as std::runtime_error
+ */
+void load_stimuli(std::vector<stimulus_t *> const & stimuli, nframes_t samplerate,
+                  std::size_t nthreads=0, load_progress_fun progress=load_progress_fun());
+
+/** The number of online processors */
+std::size_t nprocessors();
+
+}} // namespace jill::util
+
+#endif
@@ -8,19 +8,25 @@
  * the Free Software Foundation; either version 2 of the License, or
  * (at your option) any later version.
  */
+#include <sys/time.h>
 #include "../logging.hh"
 #include "readahead_stimqueue.hh"
 
 using namespace jill::util;
 
+/* how long the thread waits for a notification before checking the queue */
+static const long PollInterval_us = 50000;
+
 readahead_stimqueue::readahead_stimqueue(iterator first, iterator last,
                                          nframes_t samplerate,
-                                         bool loop)
-        :  _first(first), _last(last), _it(first), _head(0),
-           _samplerate(samplerate), _loop(loop)
+                                         bool loop,
+                                         std::size_t depth)
+        :  _first(first), _last(last), _it(first),
+           _samplerate(samplerate), _loop(loop), _depth(std::max<std::size_t>(depth, 2)),
+           _ready(_depth), _stopping(0), _joined(false)
 {
         pthread_mutex_init(&_lock, 0);
-        pthread_cond_init(&_ready, 0);
+        pthread_cond_init(&_released, 0);
         int ret = pthread_create(&_thread_id, NULL, readahead_stimqueue::thread, this);
         if (ret != 0)
                 throw std::runtime_error("Failed to start writer thread");
@@ -29,106 +35,101 @@ readahead_stimqueue::readahead_stimqueue(iterator first, iterator last,
 readahead_stimqueue::~readahead_stimqueue()
 {
         stop();
+        join();
         pthread_mutex_destroy(&_lock);
-        pthread_cond_destroy(&_ready);
+        pthread_cond_destroy(&_released);
 }
 
 void
 readahead_stimqueue::stop()
 {
-        // messy?
-        pthread_cancel(_thread_id);
+        __sync_bool_compare_and_swap(&_stopping, 0, 1);
 }
 
 void
 readahead_stimqueue::join()
 {
+        if (_joined) return;
         pthread_join(_thread_id, NULL);
+        _joined = true;
 }
 
 void *
 readahead_stimqueue::thread(void * arg)
 {
-	pthread_setcanceltype (PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
         readahead_stimqueue * self = static_cast<readahead_stimqueue *>(arg);
         self->loop();
         return 0;
 }
 
 /*
- * Threading notes: background thread locks mutex while it's working, and waits
- * on a condition variable when it's not (releasing the mutex).  RT threads call
- * head() and release(), both of which may need to notify the worker to load the
- * next stimulus. To keep these calls waitfree, a trylock call is used to obtain
- * the mutex prior to signaling the condition variable. If the worker is busy,
- * the trylock will fail.
+ * Threading notes: the worker is the only writer to the ringbuffer, and the
+ * consumer (the RT thread) is the only reader, so neither side needs a lock.
+ * The worker loads stimuli until depth are waiting, then sleeps on a
+ * condition variable. release() wakes it up, using trylock so the RT thread
+ * never blocks. If the worker happens to hold the lock, the signal is
+ * skipped, so the worker also wakes up periodically to check the queue (and
+ * whether stop() has been called, which can't take the lock because it's
+ * called from signal handlers).
  *
- * I'm not entirely sure if _head is properly protected, because both release()
- * can modify it even when loop() has the lock. It's probably mostly okay,
- * because release() doesn't modify the underlying object, and loop() only
- * performs a simple assignment. The consumer needs to avoid calling release()
- * when head is null to avoid any weird issues like tearing, but it's unlikely
- * to do so because it should check this condition.
+ * When the list is exhausted, the worker waits for the consumer to release the
+ * remaining stimuli before exiting, so join() returns after the last one has
+ * been played.
  */
 void
 readahead_stimqueue::loop()
 {
         jill::stimulus_t * ptr;
-	pthread_mutex_lock (&_lock);
+        pthread_mutex_lock(&_lock);
 
-        while (1) {
-                // load data
-                if (_head == 0) {
-                        if (_it == _last) {
-                                if (_loop) _it = _first;
-                                else break;
-                        }
+        while (__sync_fetch_and_add(&_stopping, 0) == 0) {
+                if (_it == _last && _loop)
+                        _it = _first;
+                if (_it == _last) {
+                        if (_ready.read_space() == 0) break;
+                }
+                else if (_ready.read_space() < _depth) {
                         ptr = *_it;
                         ptr->load_samples(_samplerate);
-                        _head = ptr;
+                        _ready.push(ptr);
                         LOG << "next stim: " << ptr->name() << " (" << ptr->duration() << " s)";
                         _it += 1;
+                        continue;
                 }
 
-                // read ahead
-                if (_it != _last) {
-                        ptr = *_it;
-                        ptr->load_samples(_samplerate);
-                }
-
-                // wait for iterator to change
-                pthread_cond_wait (&_ready, &_lock);
+                // wait for the consumer to release a stimulus
+                struct timeval now;
+                struct timespec timeout;
+                gettimeofday(&now, 0);
+                long usec = now.tv_usec + PollInterval_us;
+                timeout.tv_sec = now.tv_sec + usec / 1000000;
+                timeout.tv_nsec = (usec % 1000000) * 1000;
+                pthread_cond_timedwait(&_released, &_lock, &timeout);
         }
         LOG << "end of stimulus list";
-        pthread_mutex_unlock (&_lock);
+        pthread_mutex_unlock(&_lock);
+}
+
+void
+readahead_stimqueue::notify()
+{
+        if (pthread_mutex_trylock(&_lock) == 0) {
+                pthread_cond_signal(&_released);
+                pthread_mutex_unlock(&_lock);
+        }
 }
 
 jill::stimulus_t const *
 readahead_stimqueue::head()
 {
-        if (_head) return _head;
-        /*
-         * This function has to try to signal the condition variable to avoid a
-         * race condition where the worker is busy resampling the next stimulus
-         * when release is called. In this case, _head will be set to zero but
-         * the worker won't receive the signal to move the next stimulus into _head
-         */
-        if (pthread_mutex_trylock (&_lock) == 0) {
-                pthread_cond_signal (&_ready);
-                pthread_mutex_unlock (&_lock);
-        }
-        return 0;
+        if (_ready.read_space() == 0) return 0;
+        return _ready.buffer()[_ready.read_offset()];
 }
 
 
 void
 readahead_stimqueue::release()
 {
-        // FIXME? potential race condition with loop? need CAS?
-        _head = 0;
-        // signal thread that iterator has advanced
-        if (pthread_mutex_trylock (&_lock) == 0) {
-                pthread_cond_signal (&_ready);
-                pthread_mutex_unlock (&_lock);
-        }
+        _ready.pop(static_cast<stimulus_t **>(0), 1);
+        notify();
 }
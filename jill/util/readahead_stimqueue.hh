@@ -15,6 +15,7 @@
 #include <vector>
 #include <boost/shared_ptr.hpp>
 #include "stimqueue.hh"
+#include "../dsp/ringbuffer.hh"
 
 namespace jill {
 
@@ -25,6 +26,13 @@ namespace util {
 /**
  * An implementation of stimqueue that provides a background thread for loading
  * data from disk and resampling.
+ *
+ * The thread loads stimuli ahead of playback and passes them to the consumer
+ * through a single-producer, single-consumer ringbuffer. Up to @a depth
+ * stimuli are ready at any time, including the head of the queue, so short
+ * stimuli can be played back to back without waiting for the thread. head()
+ * and release() only touch the consumer side of the ringbuffer and are
+ * wait-free.
  */
 class readahead_stimqueue : public stimqueue {
 
@@ -39,32 +47,44 @@ public:
          * @param last   iterator pointing to the end of the sequence
          * @param samplerate   the sampling rate needed by the consumer
          * @param loop         whether to keep repeating the queue
+         * @param depth        the number of stimuli to keep ready (at least 2)
          */
         readahead_stimqueue(iterator first, iterator last,
                             nframes_t samplerate,
-                            bool loop=false);
+                            bool loop=false,
+                            std::size_t depth=2);
         ~readahead_stimqueue();
 
         stimulus_t const * head();
         void release();
+        /** Stop the queue. Async-signal-safe */
         void stop();
         void join();
 
+        /** The number of stimuli that are loaded and waiting, including the head */
+        std::size_t ready() const { return _ready.read_space(); }
+        std::size_t depth() const { return _depth; }
+
 private:
         static void * thread(void * arg); // thread entry point
         void loop();                      // called by thread
+        void notify();                    // wake the thread, if it's not busy
 
         iterator const _first;
         iterator const _last;
-        iterator _it;                             // current position
-        stimulus_t * _head;
+        iterator _it;                             // next stimulus to load
 
         nframes_t const _samplerate;
         bool const _loop;
+        std::size_t const _depth;
+
+        dsp::ringbuffer<stimulus_t *> _ready;     // loaded stimuli
+        int _stopping;
+        bool _joined;
 
         pthread_t _thread_id;
         pthread_mutex_t _lock;
-        pthread_cond_t  _ready;
+        pthread_cond_t  _released;
 
 };
 
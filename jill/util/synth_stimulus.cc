@@ -0,0 +1,276 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include "synth_stimulus.hh"
+
+using namespace jill;
+using namespace jill::util;
+using boost::uint32_t;
+
+const nframes_t synth_stimulus::default_samplerate;
+const nframes_t synth_stimulus::block_size;
+
+namespace {
+
+char const * kinds[] = { "tone", "sweep", "am", "noise", 0 };
+
+/* the number of samples the oscillator generates in parallel */
+const int Lanes = 8;
+
+/* the phase of x cycles in radians, dropping whole cycles to keep precision */
+inline double
+radians(double x)
+{
+        return 2 * M_PI * (x - std::floor(x));
+}
+
+/*
+ * Generate sin(2π(a n + b n²)) for offset <= n < offset + nframes, with a and
+ * b in cycles per sample. Lane k generates samples k, k + Lanes, ... by
+ * rotating a complex phasor z by a step w. With a stride of Lanes, the step is
+ * itself a phasor that rotates by a constant r (unless b is 0). The lanes are
+ * independent, so the inner loop can be vectorized. The phasors are computed
+ * from the exact phase on each call, so rounding errors don't accumulate.
+ */
+void
+oscillator(sample_t * dest, nframes_t offset, nframes_t nframes, double a, double b)
+{
+        const double L = Lanes;
+        float zr[Lanes], zi[Lanes], wr[Lanes], wi[Lanes];
+        for (int k = 0; k < Lanes; ++k) {
+                double n = double(offset) + k;
+                double phase = radians(a * n + b * n * n);
+                double step = radians(a * L + b * (2 * n * L + L * L));
+                zr[k] = std::cos(phase);
+                zi[k] = std::sin(phase);
+                wr[k] = std::cos(step);
+                wi[k] = std::sin(step);
+        }
+        const float rr = std::cos(radians(2 * b * L * L));
+        const float ri = std::sin(radians(2 * b * L * L));
+
+        nframes_t i = 0;
+        for (; i + Lanes <= nframes; i += Lanes) {
+                for (int k = 0; k < Lanes; ++k) {
+                        dest[i + k] = zi[k];
+                        float t = zr[k] * wr[k] - zi[k] * wi[k];
+                        zi[k] = zr[k] * wi[k] + zi[k] * wr[k];
+                        zr[k] = t;
+                        t = wr[k] * rr - wi[k] * ri;
+                        wi[k] = wr[k] * ri + wi[k] * rr;
+                        wr[k] = t;
+                }
+        }
+        for (int k = 0; i < nframes; ++i, ++k)
+                dest[i] = zi[k];
+}
+
+/* integer hash with good avalanche (from Chris Wellons' hash-prospector) */
+inline uint32_t
+hash32(uint32_t x)
+{
+        x ^= x >> 16;
+        x *= 0x7feb352dU;
+        x ^= x >> 15;
+        x *= 0x846ca68bU;
+        x ^= x >> 16;
+        return x;
+}
+
+/* 32-bit FNV-1a */
+uint32_t
+hash_string(std::string const & s)
+{
+        uint32_t h = 2166136261U;
+        for (std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+                h ^= static_cast<unsigned char>(*it);
+                h *= 16777619U;
+        }
+        return h;
+}
+
+}
+
+bool
+synth_stimulus::is_spec(std::string const & spec)
+{
+        std::string::size_type colon = spec.find(':');
+        if (colon == std::string::npos) return false;
+        for (char const ** kind = kinds; *kind; ++kind) {
+                if (spec.compare(0, colon, *kind) == 0)
+                        return true;
+        }
+        return false;
+}
+
+synth_stimulus *
+synth_stimulus::create(std::string const & spec)
+{
+        std::string::size_type colon = spec.find(':');
+        if (!is_spec(spec))
+                throw std::invalid_argument("unknown kind of stimulus: " + spec);
+        std::string const kind = spec.substr(0, colon);
+
+        param_map params;
+        std::istringstream ss(spec.substr(colon + 1));
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+                if (item.empty()) continue;
+                std::string::size_type eq = item.find('=');
+                if (eq == std::string::npos || eq == 0 || eq + 1 == item.size())
+                        throw std::invalid_argument(spec + ": invalid parameter " + item);
+                char const * value = item.c_str() + eq + 1;
+                char * end;
+                double x = strtod(value, &end);
+                if (*end != '\0')
+                        throw std::invalid_argument(spec + ": invalid parameter " + item);
+                params[item.substr(0, eq)] = x;
+        }
+
+        synth_stimulus * stim;
+        if (kind == "tone")
+                stim = new tone_stimulus(spec, params);
+        else if (kind == "sweep")
+                stim = new sweep_stimulus(spec, params);
+        else if (kind == "am")
+                stim = new am_stimulus(spec, params);
+        else
+                stim = new noise_stimulus(spec, params);
+        if (!params.empty()) {
+                delete stim;
+                throw std::invalid_argument(spec + ": unknown parameter " + params.begin()->first);
+        }
+        return stim;
+}
+
+synth_stimulus::synth_stimulus(std::string const & spec, param_map & params)
+        : _name(spec),
+          _duration(param(params, "dur")),
+          _amplitude(param(params, "amp", 1.0)),
+          _ramp(param(params, "ramp", 0.005))
+{
+        if (_duration <= 0)
+                throw std::invalid_argument(spec + ": duration must be positive");
+        if (_ramp < 0)
+                throw std::invalid_argument(spec + ": ramp can't be negative");
+        load_samples(default_samplerate);
+}
+
+double
+synth_stimulus::param(param_map & params, char const * key, double default_value) const
+{
+        param_map::iterator it = params.find(key);
+        if (it == params.end()) return default_value;
+        double value = it->second;
+        params.erase(it);
+        return value;
+}
+
+double
+synth_stimulus::param(param_map & params, char const * key) const
+{
+        if (params.find(key) == params.end())
+                throw std::invalid_argument(_name + ": missing parameter " + key);
+        return param(params, key, 0);
+}
+
+void
+synth_stimulus::load_samples(nframes_t samplerate)
+{
+        if (samplerate == 0) samplerate = default_samplerate;
+        _samplerate = samplerate;
+        _nframes = nframes_t(_duration * samplerate + 0.5);
+        _ramp_frames = std::min(nframes_t(_ramp * samplerate + 0.5), _nframes / 2);
+}
+
+nframes_t
+synth_stimulus::read(sample_t * dest, nframes_t offset, nframes_t nframes, std::size_t chan) const
+{
+        if (chan > 0 || offset >= _nframes) return 0;
+        nframes = std::min(nframes, _nframes - offset);
+        for (nframes_t done = 0; done < nframes; done += block_size)
+                synthesize(dest + done, offset + done, std::min(block_size, nframes - done));
+        for (nframes_t i = 0; i < nframes; ++i)
+                dest[i] *= _amplitude;
+
+        // cosine-squared ramps only touch the first and last few samples
+        const nframes_t end = offset + nframes;
+        const nframes_t offset_ramp = _nframes - _ramp_frames;
+        for (nframes_t n = offset; n < std::min(end, _ramp_frames); ++n) {
+                float g = std::sin(M_PI / 2 * n / _ramp_frames);
+                dest[n - offset] *= g * g;
+        }
+        for (nframes_t n = std::max(offset, offset_ramp); n < end; ++n) {
+                float g = std::sin(M_PI / 2 * (_nframes - 1 - n) / _ramp_frames);
+                dest[n - offset] *= g * g;
+        }
+        return nframes;
+}
+
+tone_stimulus::tone_stimulus(std::string const & spec, param_map & params)
+        : synth_stimulus(spec, params), _freq(param(params, "freq"))
+{}
+
+void
+tone_stimulus::synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const
+{
+        oscillator(dest, offset, nframes, _freq / samplerate(), 0);
+}
+
+sweep_stimulus::sweep_stimulus(std::string const & spec, param_map & params)
+        : synth_stimulus(spec, params), _f0(param(params, "f0")), _f1(param(params, "f1"))
+{}
+
+void
+sweep_stimulus::synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const
+{
+        // the instantaneous frequency is f0 + (f1 - f0) n / N
+        const double sr = samplerate();
+        oscillator(dest, offset, nframes, _f0 / sr, (_f1 - _f0) / (2 * sr * this->nframes()));
+}
+
+am_stimulus::am_stimulus(std::string const & spec, param_map & params)
+        : synth_stimulus(spec, params), _freq(param(params, "freq")), _mod(param(params, "mod")),
+          _depth(param(params, "depth", 1.0))
+{
+        if (_depth < 0 || _depth > 1)
+                throw std::invalid_argument(spec + ": modulation depth must be between 0 and 1");
+}
+
+void
+am_stimulus::synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const
+{
+        // the envelope is (1 + depth sin(2π mod t)) / (1 + depth)
+        sample_t env[block_size];
+        oscillator(dest, offset, nframes, _freq / samplerate(), 0);
+        oscillator(env, offset, nframes, _mod / samplerate(), 0);
+        const float scale = 1 / (1 + _depth);
+        for (nframes_t i = 0; i < nframes; ++i)
+                dest[i] *= (1 + _depth * env[i]) * scale;
+}
+
+noise_stimulus::noise_stimulus(std::string const & spec, param_map & params)
+        : synth_stimulus(spec, params),
+          _seed(hash32(uint32_t(param(params, "seed", hash_string(spec)))))
+{}
+
+void
+noise_stimulus::synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const
+{
+        // each sample is a hash of its position, so any block can be generated
+        for (nframes_t i = 0; i < nframes; ++i) {
+                uint32_t x = hash32(hash32(offset + i) ^ _seed);
+                dest[i] = boost::int32_t(x) * (1.0f / 2147483648.0f);
+        }
+}
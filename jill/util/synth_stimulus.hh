@@ -0,0 +1,168 @@
+/*
+ * JILL - C++ framework for JACK
+ *
+ * Copyright (C) 2013 C Daniel Meliza <dan || meliza.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _SYNTH_STIMULUS_HH
+#define _SYNTH_STIMULUS_HH
+
+#include <string>
+#include <map>
+#include <boost/cstdint.hpp>
+#include "../stimulus.hh"
+
+namespace jill { namespace util {
+
+/**
+ * ABC for stimuli that are synthesized from a few parameters instead of being
+ * loaded from disk. The samples are generated by read() as they are played,
+ * so nothing is stored and load_samples() only sets the sampling rate.
+ * Because read() can start at any offset, it doesn't depend on earlier calls,
+ * and the same samples are generated on every presentation.
+ *
+ * Stimuli are described by a spec of the form kind:key=value,key=value,...,
+ * which is also used as the name. The parameters for all kinds are:
+ *
+ * - dur:  the duration in s (required)
+ * - amp:  the peak amplitude (default 1.0)
+ * - ramp: the duration of cosine-squared onset and offset ramps in s
+ *         (default 0.005)
+ *
+ * The kinds are:
+ *
+ * - tone:  a pure tone at @a freq Hz
+ * - sweep: a linear frequency sweep from @a f0 to @a f1 Hz
+ * - am:    a tone at @a freq Hz, sinusoidally amplitude modulated at @a mod
+ *          Hz with modulation depth @a depth (0-1, default 1)
+ * - noise: white noise with a uniform distribution. The samples are
+ *          determined by @a seed (default derived from the spec), so each
+ *          spec is a frozen noise token.
+ *
+ * For example, tone:freq=1000,dur=0.5 or noise:dur=0.2,amp=0.1,seed=3
+ */
+class synth_stimulus : public jill::stimulus_t {
+
+public:
+        typedef std::map<std::string, double> param_map;
+
+        /**
+         * Create a stimulus from a spec.
+         *
+         * @return a new object, which the caller must delete
+         * @throws std::invalid_argument if the spec can't be parsed or is
+         *         missing required parameters
+         */
+        static synth_stimulus * create(std::string const & spec);
+
+        /** True if @a spec starts with the name of a kind of synthesized stimulus */
+        static bool is_spec(std::string const & spec);
+
+        /** The sampling rate used if load_samples() is called with 0 */
+        static const nframes_t default_samplerate = 48000;
+
+        virtual ~synth_stimulus() {}
+
+        char const * name() const { return _name.c_str(); }
+        nframes_t nframes() const { return _nframes; }
+        nframes_t samplerate() const { return _samplerate; }
+        float duration() const { return _duration; }
+
+        /** Always 0, because the samples are never stored */
+        sample_t const * buffer() const { return 0; }
+
+        /**
+         * Generate samples. Wait-free, and doesn't allocate memory, so it can
+         * be called in the process callback.
+         */
+        nframes_t read(sample_t * dest, nframes_t offset, nframes_t nframes,
+                       std::size_t chan=0) const;
+
+        /** Set the sampling rate, which determines nframes() */
+        void load_samples(nframes_t samplerate=0);
+
+protected:
+        /**
+         * Initialize the common parameters.
+         *
+         * @param spec    the spec, used as the name
+         * @param params  the parameters in the spec. Those used by the
+         *                stimulus are removed.
+         */
+        synth_stimulus(std::string const & spec, param_map & params);
+
+        /**
+         * Generate samples with an amplitude of 1, before the amplitude and
+         * ramps are applied. At most block_size samples are requested at a
+         * time.
+         */
+        virtual void synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const = 0;
+
+        /** The maximum number of samples passed to synthesize() */
+        static const nframes_t block_size = 1024;
+
+        /** Remove a parameter from @a params, or throw an error if it's required */
+        double param(param_map & params, char const * key, double default_value) const;
+        double param(param_map & params, char const * key) const;
+
+private:
+        std::string const _name;
+        float _duration;
+        float _amplitude;
+        float _ramp;
+
+        nframes_t _samplerate;
+        nframes_t _nframes;
+        nframes_t _ramp_frames;
+};
+
+/** A pure tone */
+class tone_stimulus : public synth_stimulus {
+public:
+        tone_stimulus(std::string const & spec, param_map & params);
+protected:
+        void synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const;
+private:
+        double _freq;
+};
+
+/** A linear frequency sweep */
+class sweep_stimulus : public synth_stimulus {
+public:
+        sweep_stimulus(std::string const & spec, param_map & params);
+protected:
+        void synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const;
+private:
+        double _f0;
+        double _f1;
+};
+
+/** A sinusoidally amplitude modulated tone */
+class am_stimulus : public synth_stimulus {
+public:
+        am_stimulus(std::string const & spec, param_map & params);
+protected:
+        void synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const;
+private:
+        double _freq;
+        double _mod;
+        float _depth;
+};
+
+/** Frozen white noise */
+class noise_stimulus : public synth_stimulus {
+public:
+        noise_stimulus(std::string const & spec, param_map & params);
+protected:
+        void synthesize(sample_t * dest, nframes_t offset, nframes_t nframes) const;
+private:
+        boost::uint32_t _seed;
+};
+
+}} // namespace jill::util
+
+#endif
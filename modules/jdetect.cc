@@ -9,6 +9,7 @@
  * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
  */
 #include <iostream>
+#include <sstream>
 #include <signal.h>
 #include <boost/shared_ptr.hpp>
 
@@ -17,7 +18,7 @@
 #include "jill/program_options.hh"
 #include "jill/midi.hh"
 #include "jill/dsp/ringbuffer.hh"
-#include "jill/dsp/crossing_trigger.hh"
+#include "jill/dsp/crossing_trigger_bank.hh"
 
 #define PROGRAM_NAME "jdetect"
 
@@ -36,8 +37,14 @@ public:
 	std::vector<string> input_ports;
 	/** A vector of outputs to connect to the client */
 	std::vector<string> output_ports;
+	/** A vector of outputs to connect to the combined gate */
+	std::vector<string> gate_ports;
         /** The MIDI output channel */
         midi::data_type output_chan;
+        /** The number of input channels */
+        int nports;
+        /** The number of open channels needed to open the combined gate */
+        int gate_count;
 
 	float open_threshold;
 	float close_threshold;
@@ -58,50 +65,111 @@ protected:
 
 jdetect_options options(PROGRAM_NAME);
 boost::shared_ptr<jack_client> client;
-boost::shared_ptr<dsp::crossing_trigger<sample_t> > trigger;
-jack_port_t *port_in, *port_trig, *port_count;
+boost::shared_ptr<dsp::crossing_trigger_bank<sample_t> > trigger;
+std::vector<jack_port_t *> ports_in, ports_trig, ports_count;
+jack_port_t *port_gate = 0;
 int stopping = 0;               // set to 1 to get process to clean up
 
-/* data storage for event times */
+/* data storage for event times; channel is -1 for the combined gate */
 struct event_t {
         nframes_t time;
+        int channel;
         int status;
 };
-dsp::ringbuffer<event_t> trig_times(128);
+boost::shared_ptr<dsp::ringbuffer<event_t> > trig_times;
 
-int
-process(jack_client *client, nframes_t nframes, nframes_t time)
+/* gate changes in the current period, sorted by offset; preallocated */
+struct change_t {
+        nframes_t offset;
+        std::size_t channel;
+};
+std::vector<change_t> changes;
+std::vector<void *> trig_buffers;
+bool gate_open = false;
+
+/* write a gate event to a MIDI buffer and queue it for logging */
+static void
+send_event(void * buffer, nframes_t offset, int midi_chan, bool on, nframes_t time, int channel)
 {
-	sample_t *in = client->samples(port_in, nframes);
-        sample_t *out = (port_count) ? client->samples(port_count, nframes) : 0;
-        void *trig_buffer = client->events(port_trig, nframes);
-        jack_midi_data_t buf[] = { jack_midi_data_t(options.output_chan & midi::chan_nib),
+        jack_midi_data_t buf[] = { jack_midi_data_t(midi_chan & midi::chan_nib),
                                    midi::default_pitch, midi::default_velocity };
+        buf[0] += (on) ? midi::note_on : midi::note_off;
+        event_t event = { time + offset, channel, buf[0] & midi::type_nib }; // data sent to logger
+        if (jack_midi_event_write(buffer, offset, buf, 3) != 0) {
+                // indicate error to logger function
+                event.status = midi::sysex;
+        }
+        trig_times->push(event);
+}
 
-        if (stopping && trigger->open()) {
-                buf[0] += midi::note_off;
-                jack_midi_event_write(trig_buffer, 0, buf, 3);
+/* the MIDI buffer and channel for gate events from an input channel */
+static void *
+channel_output(std::size_t channel, int & midi_chan)
+{
+        if (trig_buffers.size() > 1) {
+                midi_chan = options.output_chan;
+                return trig_buffers[channel];
+        }
+        midi_chan = options.output_chan + channel;
+        return trig_buffers[0];
+}
+
+int
+process(jack_client *client, nframes_t nframes, nframes_t time)
+{
+        const std::size_t nchannels = ports_in.size();
+        int midi_chan;
+        for (std::size_t c = 0; c < ports_trig.size(); ++c)
+                trig_buffers[c] = client->events(ports_trig[c], nframes);
+        void *gate_buffer = client->events(port_gate, nframes);
+
+        if (stopping && (trigger->nopen() > 0 || gate_open)) {
+                for (std::size_t c = 0; c < nchannels; ++c) {
+                        if (!trigger->open(c)) continue;
+                        void *buffer = channel_output(c, midi_chan);
+                        send_event(buffer, 0, midi_chan, false, time, c);
+                }
+                if (gate_open)
+                        send_event(gate_buffer, 0, options.output_chan, false, time, -1);
                 __sync_add_and_fetch(&stopping, -1);
                 return 0;
         }
 
-	// Step 1: Pass samples to window discriminator; its state may
-	// change, in which case the return value will be > -1 and
-	// indicate the frame in which the gate opened or closed. It
-	// also takes care of copying the current state of the buffer
-	// to the count monitor port (if not NULL)
-	int offset = trigger->push(in, nframes, out);
-        if (offset < 0) return 0;
-
-        if (trigger->open()) buf[0] += midi::note_on;
-        else buf[0] += midi::note_off;
+	// Step 1: Pass samples from each channel to its window
+	// discriminator; its state may change, in which case the return
+	// value will be > -1 and indicate the frame in which the gate
+	// opened or closed. It also takes care of copying the current state
+	// of the buffer to the count monitor port (if not NULL). Changes are
+	// kept in order of offset, because MIDI events have to be written in
+	// order.
+        const int nopen_before = trigger->nopen();
+        std::size_t nchanges = 0;
+        for (std::size_t c = 0; c < nchannels; ++c) {
+                sample_t *in = client->samples(ports_in[c], nframes);
+                sample_t *out = (ports_count.empty()) ? 0 : client->samples(ports_count[c], nframes);
+                int offset = trigger->push(c, in, nframes, out);
+                if (offset < 0) continue;
+                change_t change = { nframes_t(offset), c };
+                std::size_t i = nchanges++;
+                for (; i > 0 && changes[i-1].offset > change.offset; --i)
+                        changes[i] = changes[i-1];
+                changes[i] = change;
+        }
 
-        event_t event = { time + offset, buf[0] & midi::type_nib }; // data sent to logger
-        if (jack_midi_event_write(trig_buffer, offset, buf, 3) != 0) {
-                // indicate error to logger function
-                event.status = midi::sysex;
+        // Step 2: Send events for each change, and update the combined gate
+        int nopen = nopen_before;
+        for (std::size_t i = 0; i < nchanges; ++i) {
+                change_t const & change = changes[i];
+                bool open = trigger->open(change.channel);
+                void *buffer = channel_output(change.channel, midi_chan);
+                send_event(buffer, change.offset, midi_chan, open, time, change.channel);
+                nopen += (open) ? 1 : -1;
+                if (port_gate && (nopen >= options.gate_count) != gate_open) {
+                        gate_open = !gate_open;
+                        send_event(gate_buffer, change.offset, options.output_chan, gate_open,
+                                   time, -1);
+                }
         }
-        trig_times.push(event);
 
 	return 0;
 }
@@ -114,12 +182,15 @@ std::size_t log_times(event_t const * events, std::size_t count)
 	for (i = 0; i < count; ++i) {
                 e = events+i;
                 log_msg msg;
+                char const * source = (e->channel < 0) ? "gate" : "signal";
                 if (e->status==midi::note_on)
-                        msg << "signal on: ";
+                        msg << source << " on: ";
                 else if (e->status==midi::note_off)
-                        msg << "signal off:";
+                        msg << source << " off:";
                 else
                         msg << "WARNING: detected but couldn't send event: ";
+                if (e->channel >= 0 && ports_in.size() > 1)
+                        msg << " chan=" << e->channel + 1 << ",";
                 msg << " frames=" << e->time << ", us=" << client->time(e->time);
         }
         return i;
@@ -156,7 +227,8 @@ samplerate_callback(jack_client *client, nframes_t samplerate)
 	int open_count_thresh = options.open_crossing_rate * period_size / 1000 * open_crossing_periods;
 	int close_count_thresh = options.close_crossing_rate * period_size / 1000 * close_crossing_periods;
 
-        trigger.reset(new dsp::crossing_trigger<sample_t>(options.open_threshold,
+        trigger.reset(new dsp::crossing_trigger_bank<sample_t>(ports_in.size(),
+                                                         options.open_threshold,
                                                          open_count_thresh,
                                                          open_crossing_periods,
                                                          options.close_threshold,
@@ -165,6 +237,7 @@ samplerate_callback(jack_client *client, nframes_t samplerate)
                                                          period_size));
 
         // Log parameters
+        LOG << "input channels: " << ports_in.size();
         LOG << "period size: " << options.period_size_ms << " ms, " << period_size << " samples";
         LOG << "open threshold: " << options.open_threshold;
         LOG << "open count thresh: " << open_count_thresh;
@@ -183,15 +256,46 @@ main(int argc, char **argv)
 	try {
 		options.parse(argc, argv);
                 client.reset(new jack_client(options.client_name, options.server_name));
-
-                port_in = client->register_port("in", JACK_DEFAULT_AUDIO_TYPE,
-                                               JackPortIsInput, 0);
-                port_trig = client->register_port("trig_out",JACK_DEFAULT_MIDI_TYPE,
-                                                JackPortIsOutput, 0);
-                if (options.count("count-port")) {
-                        port_count = client->register_port("count",JACK_DEFAULT_AUDIO_TYPE,
+                if (options.count("profile"))
+                        client->enable_profiling(options.get<float>("profile"));
+
+                // with more than one channel, ports are numbered from 1
+                const int nports = options.nports;
+                if (nports < 1) {
+                        LOG << "ERROR: need at least one input port";
+                        throw Exit(-1);
+                }
+                bool split = options.count("split-outputs");
+                if (!split && nports > 16)
+                        LOG << "WARNING: more than 16 channels; MIDI channels will be reused";
+                for (int i = 0; i < nports; ++i) {
+                        std::ostringstream suffix;
+                        if (nports > 1) suffix << "_" << i + 1;
+                        ports_in.push_back(client->register_port("in" + suffix.str(),
+                                                                 JACK_DEFAULT_AUDIO_TYPE,
+                                                                 JackPortIsInput, 0));
+                        if (split || i == 0)
+                                ports_trig.push_back(client->register_port("trig_out" + suffix.str(),
+                                                                           JACK_DEFAULT_MIDI_TYPE,
+                                                                           JackPortIsOutput, 0));
+                        if (options.count("count-port"))
+                                ports_count.push_back(client->register_port("count" + suffix.str(),
+                                                                            JACK_DEFAULT_AUDIO_TYPE,
+                                                                            JackPortIsOutput, 0));
+                }
+                if (options.gate_count > nports) {
+                        LOG << "ERROR: combined gate needs more channels than there are inputs";
+                        throw Exit(-1);
+                }
+                else if (options.gate_count > 0) {
+                        port_gate = client->register_port("gate_out", JACK_DEFAULT_MIDI_TYPE,
                                                           JackPortIsOutput, 0);
+                        LOG << "combined gate opens when " << options.gate_count << " of "
+                            << nports << " channels are open";
                 }
+                trig_buffers.resize(ports_trig.size());
+                changes.resize(nports);
+                trig_times.reset(new dsp::ringbuffer<event_t>(128 * (nports + 1)));
 
                 // register signal handlers
 		signal(SIGINT,  signal_handler);
@@ -203,12 +307,36 @@ main(int argc, char **argv)
                 client->set_process_callback(process);
                 client->activate();
 
-                client->connect_ports(options.input_ports.begin(), options.input_ports.end(), "in");
-                client->connect_ports("trig_out", options.output_ports.begin(), options.output_ports.end());
+                if (nports == 1) {
+                        client->connect_ports(options.input_ports.begin(), options.input_ports.end(), "in");
+                }
+                else {
+                        // connect sources to inputs in order
+                        if (options.input_ports.size() > ports_in.size()) {
+                                LOG << "ERROR: more input connections than input ports";
+                                throw Exit(-1);
+                        }
+                        for (size_t i = 0; i < options.input_ports.size(); ++i)
+                                client->connect_port(options.input_ports[i], jack_port_name(ports_in[i]));
+                }
+                if (ports_trig.size() == 1) {
+                        client->connect_ports(jack_port_name(ports_trig[0]),
+                                              options.output_ports.begin(), options.output_ports.end());
+                }
+                else {
+                        if (options.output_ports.size() > ports_trig.size()) {
+                                LOG << "ERROR: more output connections than output ports";
+                                throw Exit(-1);
+                        }
+                        for (size_t i = 0; i < options.output_ports.size(); ++i)
+                                client->connect_port(jack_port_name(ports_trig[i]), options.output_ports[i]);
+                }
+                if (port_gate)
+                        client->connect_ports("gate_out", options.gate_ports.begin(), options.gate_ports.end());
 
                 while(1) {
                         sleep(1);
-                        trig_times.pop(log_times); // calls visitor function on ringbuffer
+                        trig_times->pop(log_times); // calls visitor function on ringbuffer
                 }
 
 		return EXIT_SUCCESS;
@@ -237,7 +365,17 @@ jdetect_options::jdetect_options(string const &program_name)
                 ("in,i",      po::value<vector<string> >(&input_ports), "add connection to input port")
                 ("out,o",     po::value<vector<string> >(&output_ports), "add connection to output port")
                 ("chan,c",    po::value<midi::data_type>(&output_chan)->default_value(0),
-                 "set MIDI channel for output messages (0-16)");
+                 "set MIDI channel for output messages (0-16). With more than one input, "
+                 "each input uses the next channel unless --split-outputs is set")
+                ("ports,p",   po::value<int>(&nports)->default_value(1),
+                 "set number of input channels, each with its own detector")
+                ("split-outputs", "create an output port for each input channel")
+                ("gate",      po::value<int>(&gate_count)->default_value(0),
+                 "send combined gate events on gate_out when at least N channels are open (0 to disable)")
+                ("gate-out",  po::value<vector<string> >(&gate_ports),
+                 "add connection to combined gate output port")
+                ("profile",   po::value<float>(),
+                 "log process callback timing every N seconds");
 
         // tropts is a group of options
         po::options_description tropts("Trigger options");
@@ -270,7 +408,10 @@ jdetect_options::print_usage()
                   << "Ports:\n"
                   << " * in:       for input of the signal(s) to be monitored\n"
                   << " * trig_out:  MIDI port producing gate open and close events\n"
-                  << " * count:    (optional) the current estimate of signal power"
+                  << " * count:    (optional) the current estimate of signal power\n"
+                  << " * gate_out: (optional) MIDI port producing combined gate events\n"
+                  << "With more than one channel, the in, count, and (with --split-outputs)\n"
+                  << "trig_out ports are numbered from 1."
                   << std::endl;
 }
 
@@ -4,12 +4,18 @@
 #include <boost/filesystem.hpp>
 #include <boost/lambda/lambda.hpp>
 #include <sstream>
+#include <fstream>
+#include <stdexcept>
 #include <algorithm>
+#include <cstring>
+#include <stdint.h>
 
 #include "../jill/digital_filter.hh"
+#include "../jill/dsp/sos_lockstep.hh"
 #include "../jill/logging.hh"
 #include "../jill/jack_client.hh"
 #include "../jill/program_options.hh"
+#include "../jill/zmq.hh"
 
 #define PROGRAM_NAME "jfilter"
 
@@ -33,6 +39,7 @@ public:
         svec output_ports;
   
         int nports;
+        int lockstep_ports;
 
         string filter_class;
         string filter_type;
@@ -41,6 +48,9 @@ public:
 
         std::vector<COEF_t> numerator;
         std::vector<COEF_t> denominator;
+        string coef_file;
+        size_t fft_threshold;
+        float crossfade_ms;
         
         
 
@@ -56,9 +66,16 @@ static boost::shared_ptr<jack_client> client;
 static plist_t ports_in, ports_out;
 static int ret = EXIT_SUCCESS;
 static int running = 1;
+static int xruns = 0;                   // set by jack_xrun, cleared by process
+static nframes_t new_period_size = 0;   // set by jack_bufsize, cleared by main
 
 
 static digital_filter filter; 
+static std::vector<digital_filter::channel_t> channels;
+// used instead of filter when there are enough ports to filter in lockstep
+static boost::shared_ptr<dsp::sos_lockstep> lockstep;
+static std::vector<sample_t const *> lockstep_in;
+static std::vector<sample_t *> lockstep_out;
 
 
 int 
@@ -66,14 +83,32 @@ process (jack_client *client, nframes_t nframes, nframes_t time)
 {
 
         sample_t *in, *out;
+
+        // pick up coefficients changed over the control socket
+        filter.update();
+        // the state is reset here rather than in jack_xrun, which runs in
+        // another thread and could touch a realization being retired
+        if (__sync_fetch_and_and(&xruns, 0)) {
+                filter.reset();
+                if (lockstep) lockstep->reset();
+        }
+
+        if (lockstep) {
+                plist_t::const_iterator it_in = ports_in.begin(), it_out = ports_out.begin();
+                for (size_t i = 0; it_in != ports_in.end(); ++i, ++it_in, ++it_out) {
+                        lockstep_in[i] = client->samples(*it_in, nframes);
+                        lockstep_out[i] = client->samples(*it_out, nframes);
+                }
+                lockstep->process(&lockstep_in[0], &lockstep_out[0], nframes);
+                return 0;
+        }
   
-        plist_t::const_iterator it_out = ports_out.begin();
-        for (plist_t::const_iterator it_in = ports_in.begin(); it_in != ports_in.end(); it_in++) { 
-                in = client->samples(*it_in, nframes);	  
+        plist_t::const_iterator it_in = ports_in.begin(), it_out = ports_out.begin();
+        for (size_t i = 0; it_in != ports_in.end(); ++i, ++it_in, ++it_out) {
+                in = client->samples(*it_in, nframes);
                 if (in == 0) continue;
                 out = client->samples(*it_out, nframes);
-                filter.filter_buf(in, out, jack_port_name(*it_in), nframes);
-                it_out++;
+                filter.filter_buf(in, out, channels[i], nframes);
         }
   
         return 0;      
@@ -92,7 +127,9 @@ jack_latency (jack_latency_callback_mode_t mode, void *arg)
 int
 jack_bufsize(jack_client *client, nframes_t nframes)
 {
-
+        // the FFT convolver uses the period as its block size. The filter is
+        // rebuilt by the main loop, which also makes the other design calls.
+        __sync_lock_test_and_set(&new_period_size, nframes);
 
         return 0;
 }
@@ -104,7 +141,7 @@ jack_xrun(jack_client *client, float delay)
 {
         
         std::cout << "xrun: " << delay << std::endl;
-        filter.reset_pads();
+        __sync_add_and_fetch(&xruns, 1);
         return 0;
 }
 
@@ -154,6 +191,201 @@ create_ports(int nports, string const & base_name, string const & type,
 
 
 
+/**
+ * Read filter coefficients from a text file. The first line contains the
+ * numerator coefficients and the optional second line the denominator
+ * coefficients, separated by whitespace or commas. Lines starting with '#'
+ * are ignored.
+ */
+void
+load_coefficients(string const & path, std::vector<COEF_t> & numerator,
+                  std::vector<COEF_t> & denominator)
+{
+        std::ifstream file(path.c_str());
+        if (!file.good())
+                throw std::runtime_error("unable to open coefficient file " + path);
+        std::vector<COEF_t> * dest[] = { &numerator, &denominator };
+        size_t n = 0;
+        string line;
+        while (n < 2 && std::getline(file, line)) {
+                if (line.empty() || line[0] == '#') continue;
+                std::replace(line.begin(), line.end(), ',', ' ');
+                std::istringstream values(line);
+                dest[n]->clear();
+                COEF_t value;
+                while (values >> value)
+                        dest[n]->push_back(value);
+                n += 1;
+        }
+        LOG << "read " << numerator.size() << " numerator and " << denominator.size()
+            << " denominator coefficients from " << path;
+}
+
+
+/*
+ * Coefficient changes over zmq, using the PLZTO request from the jillctl
+ * protocol (doc/jillctl.abnf). The supported functions are:
+ *
+ *   butter  string type, int order, double cutoff [, double cutoff]
+ *   firwin  int ntaps, double cutoff [, string window]
+ *   coef    int n, n doubles (numerator) [, doubles (denominator)]
+ */
+namespace jillctl {
+
+enum { OHAI = 0x01, OHAI_OK = 0x02, RTFM = 0x03, WTF = 0x04,
+       PLZTO = 0x08, PLZTO_OK = 0x09 };
+enum { INT = 0x01, UINT = 0x02, DOUBLE = 0x03, STRING = 0x04 };
+
+struct value_t {
+        int type;
+        int64_t i;
+        double d;
+        string s;
+};
+
+/* reads fields from a message, setting ok to false if it's too short */
+struct reader {
+        char const * pos;
+        char const * end;
+        bool ok;
+
+        reader(string const & msg) : pos(msg.data()), end(msg.data() + msg.size()), ok(true) {}
+
+        bool at_end() const { return pos >= end; }
+
+        unsigned char byte() {
+                if (pos >= end) { ok = false; return 0; }
+                return *pos++;
+        }
+
+        string str() {
+                char const * stop = std::find(pos, end, '\0');
+                if (stop == end) { ok = false; pos = end; return string(); }
+                string out(pos, stop);
+                pos = stop + 1;
+                return out;
+        }
+
+        // 64 bits in network order
+        uint64_t word() {
+                uint64_t out = 0;
+                for (int i = 0; i < 8; ++i)
+                        out = (out << 8) | byte();
+                return out;
+        }
+
+        value_t value() {
+                value_t v;
+                v.type = byte();
+                v.i = 0; v.d = 0;
+                if (v.type == INT || v.type == UINT) {
+                        v.i = word();
+                        v.d = v.i;
+                }
+                else if (v.type == DOUBLE) {
+                        uint64_t w = word();
+                        memcpy(&v.d, &w, sizeof(double));
+                }
+                else if (v.type == STRING)
+                        v.s = str();
+                else
+                        ok = false;
+                return v;
+        }
+};
+
+string
+reply(int code, string const & reason="")
+{
+        string out("\xCD\xC0");
+        out += char(code);
+        if (code == WTF) {
+                out += reason;
+                out += '\0';
+        }
+        return out;
+}
+
+/* apply a PLZTO request, returning the reply */
+string
+plzto(reader & msg)
+{
+        string client_name = msg.str();
+        string function = msg.str();
+        std::vector<value_t> args;
+        while (msg.ok && !msg.at_end())
+                args.push_back(msg.value());
+        if (!msg.ok) return reply(RTFM);
+
+        const double nyquist = client->sampling_rate() / 2.0;
+        if (function == "butter") {
+                if (args.size() < 3 || args.size() > 4 || args[0].type != STRING ||
+                    args[1].type != INT || args[1].i < 1)
+                        return reply(RTFM);
+                std::vector<COEF_t> Wc;
+                for (size_t i = 2; i < args.size(); ++i) {
+                        if (args[i].type != DOUBLE) return reply(RTFM);
+                        if (args[i].d <= 0 || args[i].d >= nyquist)
+                                return reply(WTF, "cutoff frequency out of range");
+                        Wc.push_back(args[i].d);
+                }
+                string const & type = args[0].s;
+                size_t nc = (type == "band-pass" || type == "band-stop") ? 2 : 1;
+                if ((type != "low-pass" && type != "high-pass" && nc == 1) || Wc.size() != nc)
+                        return reply(WTF, "invalid filter type or number of cutoff frequencies");
+                filter.butter(args[1].i, Wc, type, client->sampling_rate());
+        }
+        else if (function == "firwin") {
+                if (args.size() < 2 || args.size() > 3 || args[0].type != INT ||
+                    args[0].i < 1 || args[1].type != DOUBLE ||
+                    (args.size() == 3 && args[2].type != STRING))
+                        return reply(RTFM);
+                if (args[1].d <= 0 || args[1].d >= nyquist)
+                        return reply(WTF, "cutoff frequency out of range");
+                string window = (args.size() == 3) ? args[2].s : "hamming";
+                if (window != "hamming" && window != "hann" && window != "blackman" &&
+                    window != "rectangular")
+                        return reply(WTF, "unknown window type");
+                filter.firwin(args[0].i, args[1].d, client->sampling_rate(), window);
+        }
+        else if (function == "coef") {
+                if (args.size() < 2 || args[0].type != INT || args[0].i < 1 ||
+                    args[0].i >= (int64_t)args.size())
+                        return reply(RTFM);
+                std::vector<COEF_t> b, a;
+                for (size_t i = 1; i < args.size(); ++i) {
+                        if (args[i].type != DOUBLE) return reply(RTFM);
+                        ((int64_t)i <= args[0].i ? b : a).push_back(args[i].d);
+                }
+                if (!a.empty() && a[0] == 0)
+                        return reply(WTF, "first denominator coefficient is zero");
+                filter.custom_coef(b, a);
+        }
+        else
+                return reply(RTFM);
+        LOG << "filter coefficients changed by " << client_name;
+        return reply(PLZTO_OK);
+}
+
+/* handle a request from the control socket */
+string
+handle(string const & request)
+{
+        reader msg(request);
+        if (msg.byte() != 0xCD || msg.byte() != 0xC0) return reply(RTFM);
+        int command = msg.byte();
+        if (command == OHAI) {
+                if (msg.str() != "JILLCTL" || msg.byte() != 0x02 || !msg.ok)
+                        return reply(RTFM);
+                return reply(OHAI_OK);
+        }
+        else if (command == PLZTO)
+                return plzto(msg);
+        return reply(RTFM);
+}
+
+}
+
                    
 int
 main(int argc, char **argv)
@@ -167,18 +399,28 @@ main(int argc, char **argv)
 
                 // start client
                 client.reset(new jack_client(options.client_name, options.server_name));
-          
+                if (options.count("profile"))
+                        client->enable_profiling(options.get<float>("profile"));
 
                 // set filter coefficients
 
+                // type has a default value, so it's not used to decide
+                bool design = (options.count("order") || options.count("cutoff-frequencies"));
+                bool coefs = (options.count("numerator") || options.count("denominator") ||
+                              options.count("coef-file"));
                 bool butter = (options.count("order") && 
-                               options.count("cutoff-frequencies") && 
-                               options.count("type")
-                               ) && !(options.count("numerator") || options.count("denominator"));
-                bool custom =  !(options.count("order") || 
-                               options.count("cutoff-frequencies") ||
-                               options.count("type")
-                               ) && (options.count("numerator") && options.count("denominator"));
+                               options.count("cutoff-frequencies")) && !coefs;
+                bool custom = coefs && !design;
+
+                filter.set_fft_threshold(options.fft_threshold);
+                filter.set_period_size(client->buffer_size());
+                if (custom && options.count("coef-file")) {
+                        load_coefficients(options.coef_file, options.numerator, options.denominator);
+                }
+                if (custom && options.numerator.empty()) {
+                        LOG << "ERROR: no numerator coefficients";
+                        throw Exit(-1);
+                }
 
                 if (custom) {
                         filter.custom_coef(options.numerator,
@@ -201,6 +443,45 @@ main(int argc, char **argv)
                              
                 // register output ports 
                 ports_out = create_ports(options.nports, "out_", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+
+                // allocate filter state for each port
+                for (size_t i = 0; i < ports_in.size(); ++i)
+                        channels.push_back(filter.add_channel());
+
+                // the control socket swaps coefficients while the client runs
+                void * context = 0, * socket = 0;
+                if (options.count("control")) {
+                        nframes_t crossfade = options.crossfade_ms * client->sampling_rate() / 1000;
+                        filter.enable_hot_swap(crossfade);
+                        string server = (options.server_name.empty()) ? "default" : options.server_name;
+                        boost::filesystem::path dir = boost::filesystem::path("/tmp/org.meliza.jill") / server;
+                        boost::filesystem::create_directories(dir);
+                        string endpoint = "ipc://" + (dir / client->name()).string();
+                        context = zmq_init(1);
+                        socket = zmq_socket(context, ZMQ_REP);
+                        if (zmq_bind(socket, endpoint.c_str()) != 0) {
+                                LOG << "ERROR: unable to bind control socket to " << endpoint;
+                                throw Exit(-1);
+                        }
+                        LOG << "accepting filter changes at " << endpoint
+                            << " (crossfade=" << crossfade << " frames)";
+                        if (options.lockstep_ports > 0)
+                                LOG << "lockstep filtering is disabled with --control";
+                }
+                else
+                        // buffer size changes are still applied while running
+                        filter.enable_hot_swap();
+
+                // filter channels in lockstep if there are enough of them
+                if (filter.is_sos() && options.lockstep_ports > 0 && !socket &&
+                    ports_in.size() >= (size_t)options.lockstep_ports) {
+                        lockstep.reset(new dsp::sos_lockstep(filter.sections(), ports_in.size()));
+                        lockstep_in.resize(ports_in.size());
+                        lockstep_out.resize(ports_out.size());
+                        LOG << "filtering " << ports_in.size() << " ports in lockstep ("
+                            << dsp::sos_lockstep::isa_name(lockstep->isa()) << ", "
+                            << lockstep->lanes() << " channels per block)";
+                }
 		
                 // const jack_port_t* p = client->get_port(ports_out[0]);                        
                 // std::cout << jack_port_name(p) << std::endl;
@@ -216,8 +497,9 @@ main(int argc, char **argv)
                 client->set_xrun_callback(jack_xrun);
                 client->set_process_callback(process);
 
+                client->set_buffer_size_callback(jack_bufsize);
+
                 // uncomment if you need these callbacks
-                // client->set_buffer_size_callback(jack_bufsize);
                 // jack_set_latency_callback (client->client(), jack_latency, 0);
 
 		
@@ -279,10 +561,33 @@ main(int argc, char **argv)
 
 
                 while (running) {
-                        usleep(100000);
+                        nframes_t period_size = __sync_fetch_and_and(&new_period_size, 0);
+                        if (period_size)
+                                filter.set_period_size(period_size);
+                        filter.collect();
+                        if (!socket) {
+                                usleep(100000);
+                                continue;
+                        }
+                        zmq_pollitem_t item = { socket, 0, ZMQ_POLLIN, 0 };
+                        if (zmq_poll(&item, 1, 100 * ZMQ_POLL_MSEC) <= 0) continue;
+                        zmq::msg_ptr_t request = zmq::msg_init();
+                        if (zmq_msg_recv(request.get(), socket, 0) < 0) continue;
+                        string response;
+                        try {
+                                response = jillctl::handle(zmq::msg_str(request));
+                        }
+                        catch (std::exception const & e) {
+                                response = jillctl::reply(jillctl::WTF, e.what());
+                        }
+                        zmq::send(socket, response);
                 }
 
                 client->deactivate();
+                if (socket) {
+                        zmq_close(socket);
+                        zmq_ctx_destroy(context);
+                }
 		return ret;
 	}
 
@@ -316,7 +621,13 @@ jfilter_options::jfilter_options(string const &program_name)
                  "set filtering client name")
                 ("in,i",        po::value<vector<string> >(&input_ports), "add connections to input ports of jfilter")
                 ("out,o",       po::value<vector<string> >(&output_ports), "add connections to output ports of jfilter")
-                ("ports,p",     po::value<int>(&nports)->default_value(1), "number of jfilter ports to create.\n If less than number of connections, additional ports will be created.");
+                ("ports,p",     po::value<int>(&nports)->default_value(1), "number of jfilter ports to create.\n If less than number of connections, additional ports will be created.")
+                ("profile",     po::value<float>(), "log process callback timing every N seconds")
+                ("control",     "accept coefficient changes over zmq while running (see doc/jillctl.abnf)")
+                ("crossfade",   po::value<float>(&crossfade_ms)->default_value(0),
+                 "crossfade between old and new coefficients over this interval (ms)")
+                ("lockstep",    po::value<int>(&lockstep_ports)->default_value(8),
+                 "filter ports together with SIMD instructions if there are at least this many (0 to disable)");
                                             
   
         options.nports =  max(options.nports, max(options.count("in"), options.count("out"))); 
@@ -325,7 +636,11 @@ jfilter_options::jfilter_options(string const &program_name)
                 ("numerator",   po::value<vector<COEF_t> >(&numerator)->multitoken(), 
                  "Set custom numerator coefficients of filter.")
                 ("denominator", po::value<vector<COEF_t> >(&denominator)->multitoken(), 
-                 "Set custom denominator coefficients of filter")        
+                 "Set custom denominator coefficients of filter (optional for FIR filters)")
+                ("coef-file",   po::value<string>(&coef_file),
+                 "Read custom coefficients from a file (numerator on the first line, denominator on the second)")
+                ("fft-threshold", po::value<size_t>(&fft_threshold)->default_value(64),
+                 "Use FFT convolution for FIR filters with at least this many taps (0 to disable)")        
                 // ("class,c", po::value<string>(&filter_class)->default_value("butterworth"), "Class of filter.  Available classes: butterworth")
                 ("type,t", po::value<string>(&filter_type)->default_value("low-pass"), "Filter type. Available types: low-pass, high-pass, band-pass, band-stop")
                 ("cutoff-frequencies,f", po::value<vector<COEF_t> >(&cutoff_frequencies)->multitoken(), "Cutoff frequencies")
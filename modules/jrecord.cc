@@ -22,6 +22,8 @@
 #include "jill/file/arf_writer.hh"
 #include "jill/dsp/buffered_data_writer.hh"
 #include "jill/dsp/triggered_data_writer.hh"
+#include "jill/dsp/polyphase_decimator.hh"
+#include "jill/digital_filter.hh"
 
 #define PROGRAM_NAME "jrecord"
 
@@ -47,6 +49,8 @@ public:
 	float buffer_size_s;
 	int max_size_mb;
         int compression;
+        int decimate;
+        int decimate_taps;
 
 protected:
 
@@ -59,21 +63,33 @@ jrecord_options options(PROGRAM_NAME);
 boost::shared_ptr<jack_client> client;
 boost::shared_ptr<dsp::buffered_data_writer> arf_thread;
 jack_port_t * port_trig = 0;
+// decimation of sampled data; channel handles are indices in the port table
+boost::shared_ptr<dsp::polyphase_decimator> decimator;
+std::vector<sample_t> decimated;
 
 
 int
 process(jack_client *client, nframes_t nframes, nframes_t time)
 {
-        jack_port_t *port;
         void *buffer;
-        jack_client::port_list_type::const_iterator it;
+        jack_client::port_table_type const & ports = client->port_table();
+        jack_client::port_table_type::const_iterator it;
 
-        for (it = client->ports().begin(); it != client->ports().end(); ++it) {
-                port = *it;
-                buffer = jack_port_get_buffer(port, nframes);
+        for (it = ports.begin(); it != ports.end(); ++it) {
+                buffer = it->buffer(nframes);
                 if (buffer == 0) continue;
-                if (strcmp(jack_port_type(port), JACK_DEFAULT_AUDIO_TYPE) == 0) {
-                        arf_thread->push(time, SAMPLED, jack_port_short_name(port),
+                if (it->dtype == SAMPLED && decimator) {
+                        nframes_t offset;
+                        nframes_t n = decimator->process(static_cast<sample_t *>(buffer),
+                                                         &decimated[0], it - ports.begin(),
+                                                         nframes, &offset);
+                        if (n > 0)
+                                arf_thread->push(time + offset, SAMPLED, it->name.c_str(),
+                                                 n * sizeof(sample_t), &decimated[0],
+                                                 decimator->factor());
+                }
+                else if (it->dtype == SAMPLED) {
+                        arf_thread->push(time, SAMPLED, it->name.c_str(),
                                          nframes * sizeof(sample_t), buffer);
                 }
                 else {
@@ -83,7 +99,7 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
                                 jack_midi_event_get(&event, buffer, j);
                                 if (event.size == 0) continue;
                                 arf_thread->push(time + event.time,
-                                                 EVENT, jack_port_short_name(port),
+                                                 EVENT, it->name.c_str(),
                                                  event.size, event.buffer);
                         }
                 }
@@ -106,6 +122,10 @@ jack_xrun(jack_client *client, float delay)
 int
 jack_bufsize(jack_client *client, nframes_t nframes)
 {
+        if (decimator) {
+                decimator->set_period_size(nframes);
+                decimated.resize(decimator->max_output(nframes));
+        }
         std::size_t bytes = client->sampling_rate() * options.buffer_size_s * client->nports();
         if (port_trig != 0)
                 bytes += client->sampling_rate() * options.pretrigger_size_s * client->nports();
@@ -170,6 +190,8 @@ main(int argc, char **argv)
 	try {
 		options.parse(argc,argv);
                 client.reset(new jack_client(options.client_name, options.server_name));
+                if (options.count("profile"))
+                        client->enable_profiling(options.get<float>("profile"));
                 writer.reset(new file::arf_writer(options.output_file,
                                                   *client,
                                                   options.additional_options,
@@ -236,6 +258,26 @@ main(int argc, char **argv)
                                                JackPortIsInput | JackPortIsTerminal, 0);
                 }
 
+                /* set up decimation of sampled data */
+                if (options.decimate > 1) {
+                        nframes_t rate = client->sampling_rate();
+                        int ntaps = (options.decimate_taps > 0) ? options.decimate_taps :
+                                16 * options.decimate + 1;
+                        // pass band extends to 80% of the new Nyquist frequency
+                        digital_filter antialias;
+                        antialias.firwin(ntaps, 0.4 * rate / options.decimate, rate);
+                        decimator.reset(new dsp::polyphase_decimator(options.decimate,
+                                                                     antialias.coef_in(),
+                                                                     client->buffer_size()));
+                        decimated.resize(decimator->max_output(client->buffer_size()));
+                        for (std::size_t i = 0; i < client->nports(); ++i)
+                                decimator->add_channel();
+                        LOG << "decimating sampled data by " << options.decimate
+                            << " (" << double(rate) / options.decimate << " Hz, "
+                            << ntaps << " taps, delay="
+                            << 1000 * decimator->delay() / rate << " ms)";
+                }
+
                 // register signal handlers
 		signal(SIGINT,  signal_handler);
 		signal(SIGTERM, signal_handler);
@@ -298,7 +340,9 @@ jrecord_options::jrecord_options(string const &program_name)
                 ("trig,t",    po::value<svec>()->multitoken()->zero_tokens(),
                  "record in triggered mode (optionally specify inputs)")
                 ("buffer",     po::value<float>(&buffer_size_s)->default_value(2.0),
-                 "minimum ringbuffer size (s)");
+                 "minimum ringbuffer size (s)")
+                ("profile",    po::value<float>(),
+                 "log process callback timing every N seconds");
 
         po::options_description tropts("Capture options");
         tropts.add_options()
@@ -309,7 +353,11 @@ jrecord_options::jrecord_options(string const &program_name)
                 ("posttrigger", po::value<float>(&posttrigger_size_s)->default_value(0.5),
                  "duration to record after offset trigger (s)")
                 ("compression", po::value<int>(&compression)->default_value(0),
-                 "set compression in output file (0-9)");
+                 "set compression in output file (0-9)")
+                ("decimate",   po::value<int>(&decimate)->default_value(1),
+                 "reduce the sampling rate of sampled data by this factor")
+                ("decimate-taps", po::value<int>(&decimate_taps)->default_value(0),
+                 "number of taps in the anti-aliasing filter (default 16 * decimate + 1)");
 
         // command-line options
         cmd_opts.add(jillopts).add(tropts);
@@ -0,0 +1,290 @@
+/*
+ * Spectral signal detector
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ */
+#include <iostream>
+#include <signal.h>
+#include <boost/shared_ptr.hpp>
+
+#include "jill/logging.hh"
+#include "jill/jack_client.hh"
+#include "jill/program_options.hh"
+#include "jill/midi.hh"
+#include "jill/dsp/ringbuffer.hh"
+#include "jill/dsp/spectral_trigger.hh"
+
+#define PROGRAM_NAME "jspecdetect"
+
+using namespace jill;
+using std::string;
+
+class jspecdetect_options : public program_options {
+
+public:
+	jspecdetect_options(string const &program_name);
+
+        string server_name;
+	string client_name;
+
+	/** A vector of inputs to connect to the client */
+	std::vector<string> input_ports;
+	/** A vector of outputs to connect to the client */
+	std::vector<string> output_ports;
+        /** The MIDI output channel */
+        midi::data_type output_chan;
+
+        string statistic;
+        std::size_t nfft;
+        std::size_t hop;
+        float band_low;         // Hz
+        float band_high;
+        float floor;
+
+	float open_threshold;
+	float close_threshold;
+	float open_period_ms;
+	float close_period_ms;
+
+protected:
+
+	virtual void print_usage();
+
+}; // jspecdetect_options
+
+
+jspecdetect_options options(PROGRAM_NAME);
+boost::shared_ptr<jack_client> client;
+boost::shared_ptr<dsp::spectral_trigger> trigger;
+jack_port_t *port_in, *port_trig, *port_count = 0;
+int stopping = 0;               // set to 1 to get process to clean up
+
+/* data storage for event times */
+struct event_t {
+        nframes_t time;
+        int status;
+};
+dsp::ringbuffer<event_t> trig_times(128);
+
+/* write a gate event to the MIDI buffer and queue it for logging */
+static void
+send_event(void * buffer, nframes_t offset, bool on, nframes_t time)
+{
+        jack_midi_data_t buf[] = { jack_midi_data_t(options.output_chan & midi::chan_nib),
+                                   midi::default_pitch, midi::default_velocity };
+        buf[0] += (on) ? midi::note_on : midi::note_off;
+        event_t event = { time + offset, buf[0] & midi::type_nib }; // data sent to logger
+        if (jack_midi_event_write(buffer, offset, buf, 3) != 0) {
+                // indicate error to logger function
+                event.status = midi::sysex;
+        }
+        trig_times.push(event);
+}
+
+int
+process(jack_client *client, nframes_t nframes, nframes_t time)
+{
+	void *trig_buffer = client->events(port_trig, nframes);
+
+        if (stopping) {
+                if (trigger->open())
+                        send_event(trig_buffer, 0, false, time);
+                __sync_add_and_fetch(&stopping, -1);
+                return 0;
+        }
+
+	// Pass samples to the detector. If the gate opens or closes, the
+	// return value is the offset of the frame where this happened. The
+	// average statistic is copied to the count port (if not NULL).
+	sample_t *in = client->samples(port_in, nframes);
+	sample_t *out = (port_count) ? client->samples(port_count, nframes) : 0;
+	int offset = trigger->push(in, nframes, out);
+        if (offset > -1)
+                send_event(trig_buffer, offset, trigger->open(), time);
+
+	return 0;
+}
+
+/** visitor function for gate time ringbuffer */
+std::size_t log_times(event_t const * events, std::size_t count)
+{
+        event_t const *e;
+        std::size_t i;
+	for (i = 0; i < count; ++i) {
+                e = events+i;
+                log_msg msg;
+                if (e->status==midi::note_on)
+                        msg << "signal on: ";
+                else if (e->status==midi::note_off)
+                        msg << "signal off:";
+                else
+                        msg << "WARNING: detected but couldn't send event: ";
+                msg << " frames=" << e->time << ", us=" << client->time(e->time);
+        }
+        return i;
+}
+
+void
+signal_handler(int sig)
+{
+        __sync_add_and_fetch(&stopping, 1);
+        // wait for at least one process loop; not strictly async safe
+        usleep(2e6 * client->buffer_size() / client->sampling_rate());
+        exit(sig);
+}
+
+void
+jack_shutdown(jack_status_t code, char const *)
+{
+        __sync_add_and_fetch(&stopping, 1);
+        // wait for at least one process loop
+        usleep(2e6 * client->buffer_size() / client->sampling_rate());
+        exit(-1);
+}
+
+/**
+ * Callback for samplerate changes. This function is only called once.
+ */
+int
+samplerate_callback(jack_client *client, nframes_t samplerate)
+{
+        std::size_t hop = (options.hop > 0) ? options.hop : options.nfft / 2;
+        std::size_t open_frames = options.open_period_ms * samplerate / 1000 / hop;
+        std::size_t close_frames = options.close_period_ms * samplerate / 1000 / hop;
+        dsp::spectral_trigger::statistic_type stat =
+                dsp::spectral_trigger::parse_statistic(options.statistic);
+
+        trigger.reset(new dsp::spectral_trigger(samplerate, options.nfft, hop,
+                                                options.band_low, options.band_high, stat,
+                                                options.open_threshold, open_frames,
+                                                options.close_threshold, close_frames,
+                                                options.floor));
+
+        // Log parameters
+        LOG << "statistic: " << options.statistic;
+        LOG << "analysis window: " << options.nfft << " samples, hop: " << hop << " samples";
+        LOG << "signal band: " << options.band_low << "-" << options.band_high << " Hz (bins "
+            << trigger->band_first() << "-" << trigger->band_last() << ")";
+        LOG << "amplitude floor: " << options.floor;
+        LOG << "open threshold: " << options.open_threshold;
+        LOG << "open integration window: " << options.open_period_ms << " ms, " << open_frames << " frames";
+        LOG << "close threshold: " << options.close_threshold;
+        LOG << "close integration window: " << options.close_period_ms << " ms, " << close_frames << " frames";
+        return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	using namespace std;
+	try {
+		options.parse(argc, argv);
+                if (options.nfft < 4 || (options.nfft & (options.nfft - 1))) {
+                        LOG << "ERROR: window size must be a power of two";
+                        throw Exit(-1);
+                }
+                // check the statistic before connecting to the server
+                dsp::spectral_trigger::parse_statistic(options.statistic);
+                client.reset(new jack_client(options.client_name, options.server_name));
+                if (options.count("profile"))
+                        client->enable_profiling(options.get<float>("profile"));
+
+		port_in = client->register_port("in",JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+		port_trig = client->register_port("trig_out",JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+		if (options.count("count-port"))
+			port_count = client->register_port("count",JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+
+                // register signal handlers
+		signal(SIGINT,  signal_handler);
+		signal(SIGTERM, signal_handler);
+		signal(SIGHUP,  signal_handler);
+
+                client->set_shutdown_callback(jack_shutdown);
+                client->set_sample_rate_callback(samplerate_callback);
+                client->set_process_callback(process);
+                client->activate();
+
+                client->connect_ports(options.input_ports.begin(), options.input_ports.end(), "in");
+                client->connect_ports("trig_out", options.output_ports.begin(), options.output_ports.end());
+
+                while(1) {
+                        sleep(1);
+                        trig_times.pop(log_times); // calls visitor function on ringbuffer
+                }
+
+		return EXIT_SUCCESS;
+	}
+	catch (Exit const &e) {
+		return e.status();
+	}
+	catch (std::exception const &e) {
+                LOG << "ERROR: " << e.what();
+		return EXIT_FAILURE;
+	}
+
+}
+
+
+jspecdetect_options::jspecdetect_options(string const &program_name)
+        : program_options(program_name)
+{
+        using std::vector;
+
+        po::options_description jillopts("JILL options");
+        jillopts.add_options()
+                ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
+                ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
+                 "set client name")
+                ("in,i",      po::value<vector<string> >(&input_ports), "add connection to input port")
+                ("out,o",     po::value<vector<string> >(&output_ports), "add connection to output port")
+                ("chan,c",    po::value<midi::data_type>(&output_chan)->default_value(0),
+                 "set MIDI channel for output messages (0-16)")
+                ("profile",   po::value<float>(),
+                 "log process callback timing every N seconds");
+
+        // tropts is a group of options
+        po::options_description tropts("Trigger options");
+        tropts.add_options()
+                ("count-port", "create port to output detector state")
+                ("statistic", po::value<string>(&statistic)->default_value("ratio"),
+                 "set spectral statistic: ratio (band power ratio) or entropy (band tonality)")
+                ("nfft",      po::value<std::size_t>(&nfft)->default_value(512),
+                 "set analysis window size (samples; power of two)")
+                ("hop",       po::value<std::size_t>(&hop)->default_value(0),
+                 "set samples between analysis frames (default half the window)")
+                ("band-low",  po::value<float>(&band_low)->default_value(1000),
+                 "set lower edge of signal band (Hz)")
+                ("band-high", po::value<float>(&band_high)->default_value(8000),
+                 "set upper edge of signal band (Hz)")
+                ("floor",     po::value<float>(&floor)->default_value(0.001),
+                 "set minimum RMS amplitude for analysis frames")
+                ("open-thresh", po::value<float>(&open_threshold)->default_value(0.5),
+                 "set statistic threshold for open gate (0-1.0)")
+                ("open-period", po::value<float>(&open_period_ms)->default_value(100),
+                 "set integration time for open gate (ms)")
+                ("close-thresh", po::value<float>(&close_threshold)->default_value(0.2),
+                 "set statistic threshold for close gate (0-1.0)")
+                ("close-period", po::value<float>(&close_period_ms)->default_value(1000),
+                 "set integration time for close gate (ms)");
+
+        cmd_opts.add(jillopts).add(tropts);
+        visible_opts.add(jillopts).add(tropts);
+}
+
+void
+jspecdetect_options::print_usage()
+{
+        std::cout << "Usage: " << _program_name << " [options]\n"
+                  << visible_opts << std::endl
+                  << "Ports:\n"
+                  << " * in:       for input of the signal to be monitored\n"
+                  << " * trig_out: MIDI port producing gate open and close events\n"
+                  << " * count:    (optional) the average spectral statistic"
+                  << std::endl;
+}
@@ -0,0 +1,300 @@
+/*
+ * Spike detector and waveform extractor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
+ */
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <signal.h>
+#include <boost/shared_ptr.hpp>
+
+#include "jill/logging.hh"
+#include "jill/jack_client.hh"
+#include "jill/program_options.hh"
+#include "jill/midi.hh"
+#include "jill/dsp/spike_detector.hh"
+
+#define PROGRAM_NAME "jspike"
+
+using namespace jill;
+using std::string;
+
+class jspike_options : public program_options {
+
+public:
+	jspike_options(string const &program_name);
+
+        string server_name;
+	string client_name;
+
+	/** A vector of inputs to connect to the client */
+	std::vector<string> input_ports;
+	/** A vector of outputs to connect to the client */
+	std::vector<string> output_ports;
+        /** The number of input channels */
+        int nports;
+
+        float threshold;        // in units of the noise estimate
+        string polarity;
+        float pre_ms;
+        float post_ms;
+        float align_ms;
+        float refractory_ms;
+        float noise_window_s;
+        float stats_interval_s;
+
+protected:
+
+	virtual void print_usage();
+
+}; // jspike_options
+
+
+jspike_options options(PROGRAM_NAME);
+boost::shared_ptr<jack_client> client;
+boost::shared_ptr<dsp::spike_detector> detector;
+std::vector<jack_port_t *> ports_in;
+jack_port_t *port_spikes = 0;
+
+/* spikes in the current block, sorted by offset; preallocated */
+std::vector<dsp::spike_detector::spike_type const *> queue;
+/* spike counts for each channel, read by the main thread */
+std::vector<unsigned long> spike_counts;
+unsigned long dropped = 0;
+
+int
+process(jack_client *client, nframes_t nframes, nframes_t)
+{
+        const std::size_t nchannels = ports_in.size();
+        void *buffer = client->events(port_spikes, nframes);
+        midi::spike_header header;
+        header.peak = detector->pre();
+
+        // the detector accepts blocks up to the period size when it was
+        // created, so larger periods are split
+        for (nframes_t start = 0; start < nframes; start += detector->max_period()) {
+                const nframes_t size = std::min(nframes - start, detector->max_period());
+                std::size_t nspikes = 0;
+                for (std::size_t c = 0; c < nchannels; ++c) {
+                        sample_t *in = client->samples(ports_in[c], nframes) + start;
+                        std::size_t n = detector->push(c, in, size);
+                        dsp::spike_detector::spike_type const * spikes = detector->spikes(c);
+                        // MIDI events have to be written in order, so spikes
+                        // are inserted in order of offset (without allocating)
+                        for (std::size_t k = 0; k < n; ++k) {
+                                std::size_t i = nspikes++;
+                                for (; i > 0 && queue[i-1]->ready > spikes[k].ready; --i)
+                                        queue[i] = queue[i-1];
+                                queue[i] = spikes + k;
+                        }
+                        spike_counts[c] += n;
+                }
+                for (std::size_t i = 0; i < nspikes; ++i) {
+                        dsp::spike_detector::spike_type const * s = queue[i];
+                        header.lag = s->lag;
+                        header.channel = s->channel;
+                        if (midi::write_spike(buffer, start + s->ready, header, s->waveform,
+                                              detector->snippet_size()) != 0)
+                                __sync_add_and_fetch(&dropped, 1);
+                }
+        }
+	return 0;
+}
+
+/* log the threshold and spike count for each channel */
+void
+log_stats(std::vector<unsigned long> & last_counts)
+{
+        for (std::size_t c = 0; c < ports_in.size(); ++c) {
+                unsigned long count = spike_counts[c];
+                LOG << "chan=" << c + 1 << ", noise=" << detector->noise(c)
+                    << ", threshold=" << detector->threshold(c)
+                    << ", spikes=" << count - last_counts[c];
+                last_counts[c] = count;
+        }
+        unsigned long d = __sync_fetch_and_and(&dropped, 0);
+        if (d > 0)
+                LOG << "WARNING: " << d << " spikes couldn't be sent (MIDI buffer full)";
+}
+
+void
+signal_handler(int sig)
+{
+        exit(sig);
+}
+
+void
+jack_shutdown(jack_status_t code, char const *)
+{
+        exit(-1);
+}
+
+/**
+ * Callback for samplerate changes. This function is only called once.
+ */
+int
+samplerate_callback(jack_client *client, nframes_t samplerate)
+{
+        using std::size_t;
+        const double ms = samplerate / 1000.0;
+        size_t pre = options.pre_ms * ms;
+        size_t post = std::max<size_t>(options.post_ms * ms, 1);
+        size_t align = std::max<size_t>(options.align_ms * ms, 1);
+        size_t refractory = options.refractory_ms * ms;
+        const size_t noise_samples = 4096;
+        size_t stride = std::max<size_t>(options.noise_window_s * samplerate / noise_samples, 1);
+
+        detector.reset(new dsp::spike_detector(ports_in.size(), client->buffer_size(),
+                                               options.threshold,
+                                               dsp::spike_detector::parse_polarity(options.polarity),
+                                               pre, post, align, refractory,
+                                               noise_samples, stride));
+        queue.resize(ports_in.size() * detector->max_spikes());
+
+        // Log parameters
+        LOG << "input channels: " << ports_in.size();
+        LOG << "threshold: " << options.threshold << " x noise (" << options.polarity << ")";
+        LOG << "waveform: " << pre << " samples before peak, " << post << " from peak";
+        LOG << "peak search window: " << align << " samples";
+        LOG << "refractory period: " << std::max(refractory, align) << " samples";
+        LOG << "noise estimate: " << noise_samples << " samples, every " << stride << " samples";
+        return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	using namespace std;
+	try {
+		options.parse(argc, argv);
+                // check the polarity before connecting to the server
+                dsp::spike_detector::parse_polarity(options.polarity);
+                client.reset(new jack_client(options.client_name, options.server_name));
+                if (options.count("profile"))
+                        client->enable_profiling(options.get<float>("profile"));
+
+                // with more than one channel, ports are numbered from 1
+                const int nports = options.nports;
+                if (nports < 1 || nports > 65536) {
+                        LOG << "ERROR: number of input ports must be between 1 and 65536";
+                        throw Exit(-1);
+                }
+                for (int i = 0; i < nports; ++i) {
+                        std::ostringstream suffix;
+                        if (nports > 1) suffix << "_" << i + 1;
+                        ports_in.push_back(client->register_port("in" + suffix.str(),
+                                                                 JACK_DEFAULT_AUDIO_TYPE,
+                                                                 JackPortIsInput, 0));
+                }
+                port_spikes = client->register_port("spike_out", JACK_DEFAULT_MIDI_TYPE,
+                                                    JackPortIsOutput, 0);
+                spike_counts.resize(nports, 0);
+
+                // register signal handlers
+		signal(SIGINT,  signal_handler);
+		signal(SIGTERM, signal_handler);
+		signal(SIGHUP,  signal_handler);
+
+                client->set_shutdown_callback(jack_shutdown);
+                client->set_sample_rate_callback(samplerate_callback);
+                client->set_process_callback(process);
+                client->activate();
+
+                if (nports == 1) {
+                        client->connect_ports(options.input_ports.begin(), options.input_ports.end(), "in");
+                }
+                else {
+                        // connect sources to inputs in order
+                        if (options.input_ports.size() > ports_in.size()) {
+                                LOG << "ERROR: more input connections than input ports";
+                                throw Exit(-1);
+                        }
+                        for (size_t i = 0; i < options.input_ports.size(); ++i)
+                                client->connect_port(options.input_ports[i], jack_port_name(ports_in[i]));
+                }
+                client->connect_ports("spike_out", options.output_ports.begin(), options.output_ports.end());
+
+                std::vector<unsigned long> last_counts(nports, 0);
+                float elapsed = 0;
+                while(1) {
+                        sleep(1);
+                        elapsed += 1;
+                        if (options.stats_interval_s > 0 && elapsed >= options.stats_interval_s) {
+                                log_stats(last_counts);
+                                elapsed = 0;
+                        }
+                }
+
+		return EXIT_SUCCESS;
+	}
+	catch (Exit const &e) {
+		return e.status();
+	}
+	catch (std::exception const &e) {
+                LOG << "ERROR: " << e.what();
+		return EXIT_FAILURE;
+	}
+
+}
+
+
+jspike_options::jspike_options(string const &program_name)
+        : program_options(program_name)
+{
+        using std::vector;
+
+        po::options_description jillopts("JILL options");
+        jillopts.add_options()
+                ("server,s",  po::value<string>(&server_name), "connect to specific jack server")
+                ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
+                 "set client name")
+                ("in,i",      po::value<vector<string> >(&input_ports), "add connection to input port")
+                ("out,o",     po::value<vector<string> >(&output_ports), "add connection to output port")
+                ("ports,p",   po::value<int>(&nports)->default_value(1),
+                 "set number of input channels")
+                ("profile",   po::value<float>(),
+                 "log process callback timing every N seconds");
+
+        po::options_description spopts("Spike detection options");
+        spopts.add_options()
+                ("thresh",     po::value<float>(&threshold)->default_value(4.5),
+                 "set threshold, in multiples of the noise (MAD / 0.6745)")
+                ("polarity",   po::value<string>(&polarity)->default_value("neg"),
+                 "set polarity of spikes to detect: neg, pos, or both")
+                ("pre",        po::value<float>(&pre_ms)->default_value(0.5),
+                 "set waveform duration before the peak (ms)")
+                ("post",       po::value<float>(&post_ms)->default_value(1.5),
+                 "set waveform duration after the peak (ms)")
+                ("align",      po::value<float>(&align_ms)->default_value(0.5),
+                 "set window after the crossing to search for the peak (ms)")
+                ("refractory", po::value<float>(&refractory_ms)->default_value(1.0),
+                 "set time after a crossing when no spikes are detected (ms)")
+                ("noise-window", po::value<float>(&noise_window_s)->default_value(2.0),
+                 "set duration of data used to estimate the noise (s)")
+                ("stats",      po::value<float>(&stats_interval_s)->default_value(10),
+                 "log noise, thresholds, and spike counts every N seconds (0 to disable)");
+
+        cmd_opts.add(jillopts).add(spopts);
+        visible_opts.add(jillopts).add(spopts);
+}
+
+void
+jspike_options::print_usage()
+{
+        std::cout << "Usage: " << _program_name << " [options]\n"
+                  << visible_opts << std::endl
+                  << "Ports:\n"
+                  << " * in:        for input of the (highpass filtered) signals\n"
+                  << " * spike_out: MIDI port producing a spike event with the waveform for\n"
+                  << "              each detected spike. jrecord stores these as spike times\n"
+                  << "              and waveforms\n"
+                  << "With more than one channel, the in ports are numbered from 1."
+                  << std::endl;
+}
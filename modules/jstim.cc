@@ -9,19 +9,27 @@
  * Copyright (C) 2010-2013 C Daniel Meliza <dan || meliza.org>
  */
 #include <iostream>
+#include <sstream>
 #include <signal.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <algorithm>
 
 #include "jill/logging.hh"
+#include "jill/rt_logger.hh"
 #include "jill/jack_client.hh"
 #include "jill/program_options.hh"
 #include "jill/midi.hh"
 #include "jill/file/stimfile.hh"
+#include "jill/file/stimstream.hh"
+#include "jill/file/stimcache.hh"
 #include "jill/util/readahead_stimqueue.hh"
+#include "jill/util/load_stimuli.hh"
+#include "jill/util/synth_stimulus.hh"
 #include "jill/dsp/ringbuffer.hh"
+#include "jill/dsp/crossing_trigger.hh"
 
 #define PROGRAM_NAME "jstim"
 
@@ -42,6 +50,7 @@ public:
         midi::data_type trigout_chan;
 	std::vector<string> trigin_ports;
         std::vector<string> pulse_ports;
+        std::vector<string> detect_ports;
 
         std::vector<string> stimuli; // this is postprocessed
 
@@ -50,6 +59,18 @@ public:
         float min_interval_sec; // min interval btw starts, in sec
         nframes_t min_gap;
         nframes_t min_interval;
+        float stream_min_sec;   // stream stimuli at least this long
+        string cache_dir;       // where to store resampled stimuli
+        float cache_size_mb;    // memory budget for loaded stimuli
+        size_t nthreads;        // for loading stimuli in parallel
+        size_t readahead;       // number of stimuli to keep ready
+        size_t nchannels;       // number of output ports
+
+        float detect_thresh;    // threshold for detecting signals
+        float detect_rate;      // crossing rate to open the detector (s^-1)
+        float detect_window_ms; // integration window to open the detector
+        float detect_close_ms;  // integration window to close the detector
+        float detect_period_ms; // analysis period of the detector
 
       
         
@@ -64,9 +85,14 @@ protected:
 jstim_options options(PROGRAM_NAME);
 boost::shared_ptr<jack_client> client;
 boost::shared_ptr<util::readahead_stimqueue> queue;
+boost::shared_ptr<file::stimcache> cache;     // must outlive _stimuli
 boost::ptr_vector<stimulus_t> _stimuli;
 std::vector<stimulus_t *> _stimlist;
-jack_port_t *port_out, *port_trigout, *port_trigin, *port_pulse;
+std::vector<jack_port_t *> ports_out;
+std::vector<sample_t *> buffers_out;          // used by process()
+jack_port_t *port_trigout, *port_trigin, *port_pulse, *port_detect;
+boost::shared_ptr<dsp::crossing_trigger<sample_t> > detector;
+nframes_t capture_latency, playback_latency;   // set by jack_latency
 
 static const nframes_t PulseLen = 10;
 
@@ -91,6 +117,11 @@ static int xruns = 0;                  // xrun counter
  * available) into the output buffer, starting with the onset time. Advance the
  * stimulus buffer tracking variable to reflect the number of samples played.
  *
+ * Each channel of the stimulus is copied to the corresponding output port, so
+ * all channels start and stop at the same sample as the onset/offset events.
+ *
+ * In detection mode, the detector analyzes detect_in in every period, and a
+ * stimulus starts at the sample where the detector opened, in the same period.
  */
 int
 process(jack_client *client, nframes_t nframes, nframes_t time)
@@ -103,14 +134,25 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
         nframes_t period_offset;      // the offset in the period to start copying
 
         void * trig = client->events(port_trigout, nframes);
-        sample_t * out = client->samples(port_out, nframes);
-        // zero the output buffer - somewhat inefficient but safer
-        memset(out, 0, nframes * sizeof(sample_t));
+        // zero the output buffers - somewhat inefficient but safer
+        for (size_t c = 0; c < ports_out.size(); ++c) {
+                buffers_out[c] = client->samples(ports_out[c], nframes);
+                memset(buffers_out[c], 0, nframes * sizeof(sample_t));
+        }
         
         sample_t* pulse_buf = client->samples(port_pulse, nframes);                
         if (pulse_buf) memset(pulse_buf, 0, nframes * sizeof(sample_t));
               
 
+        // the detector has to see every period, even during playback
+        int detected = -1;
+        if (detector) {
+                sample_t const * in = client->samples(port_detect, nframes);
+                int offset = detector->push(in, nframes);
+                if (offset >= 0 && detector->open())
+                        detected = offset;
+        }
+
         // the currently playing stimulus (or nullptr)
         jill::stimulus_t const * stim = queue->head();
 
@@ -140,7 +182,17 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
                 if (period_offset > nframes) return 0; // no trigger
                 last_start = time + period_offset;
                 midi::write_message(trig, period_offset, midi::stim_on, stim->name());
-                DBG << "playback triggered: time=" << last_start << ", stim=" << stim->name();
+                RTDBG("playback triggered: time={}, stim={}", last_start, stim->name());
+        }
+        // did the detector open?
+        else if (port_detect) {
+                if (detected < 0) return 0;
+                period_offset = detected;
+                last_start = time + period_offset;
+                midi::write_message(trig, period_offset, midi::stim_on, stim->name());
+                // onset is at the detected sample, so all the latency is in the ports
+                RTLOG("playback triggered by detection: time={}, stim={}, latency={} frames",
+                      last_start, stim->name(), capture_latency + playback_latency);
         }
         // has enough time elapsed since the last stim?
         else {
@@ -161,14 +213,14 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
                 if (period_offset >= nframes) return 0; // not time yet
                 last_start = time + period_offset;
                 midi::write_message(trig, period_offset, midi::stim_on, stim->name());
-                DBG << "playback started: time=" << last_start << ", stim=" << stim->name();
+                RTDBG("playback started: time={}, stim={}", last_start, stim->name());
         }
         // sanity check - will be optimized out
         assert(period_offset < nframes);
 
         // copy samples, if there are any
         nframes_t nsamples = std::min(stim->nframes() - stim_offset, nframes - period_offset);
-        DBG << "stim_offset=" << stim_offset << ", period_offset=" << period_offset << ", nsamples=" << nsamples;
+        RTDBG("stim_offset={}, period_offset={}, nsamples={}", stim_offset, period_offset, nsamples);
        
 
     
@@ -181,9 +233,7 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
                                                         nframes - period_offset);                             
                         
                         std::fill_n(pulse_buf + period_offset, on_nsamples, (sample_t) 1);
-                        for (nframes_t i = 0; i < on_nsamples; i++) {
-                                std::cout << pulse_buf[period_offset + i] << std::endl;
-                        }
+                        RTDBG("pulse on: period_offset={}, nsamples={}", period_offset, on_nsamples);
                 }
                 // else if (off_period_offset < nframes) {        
                 //         off_period_offset = (stim->nframes() < (stim_offset + PulseLen))? 0 : 
@@ -197,9 +247,18 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
         
                                              
         if (nsamples > 0) {
-                memcpy(out + period_offset,
-                       stim->buffer() + stim_offset,
-                       nsamples * sizeof(sample_t));
+                // streamed stimuli may not have enough samples ready; the
+                // output stays zero and playback continues on schedule
+                nframes_t ncopied = nsamples;
+                size_t nchans = std::min(buffers_out.size(), stim->nchannels());
+                for (size_t c = 0; c < nchans; ++c) {
+                        nframes_t n = stim->read(buffers_out[c] + period_offset, stim_offset,
+                                                 nsamples, c);
+                        ncopied = std::min(ncopied, n);
+                }
+                if (ncopied < nsamples)
+                        RTLOG("stimulus underrun: stim={}, offset={}, missing={}", stim->name(),
+                              stim_offset + ncopied, nsamples - ncopied);
                 stim_offset += nsamples;
         }
         // did the stimulus end?
@@ -208,13 +267,36 @@ process(jack_client *client, nframes_t nframes, nframes_t time)
                 last_stop = time + period_offset + nsamples;
                 midi::write_message(trig, period_offset + nsamples,
                                     midi::stim_off, stim->name());
-                DBG << "playback ended: time=" << last_stop << ", stim=" << stim->name();
+                RTDBG("playback ended: time={}, stim={}", last_stop, stim->name());
                 stim_offset = 0;
         }
 
         return 0;
 }
 
+/*
+ * Called by JACK when the latency of the graph changes. The latency from a
+ * signal at the source of detect_in to a stimulus at the destination of the
+ * outputs is the sum of the capture and playback latencies.
+ */
+void
+jack_latency(jack_latency_callback_mode_t mode, void *arg)
+{
+        jack_latency_range_t range;
+        if (mode == JackCaptureLatency) {
+                jack_port_get_latency_range(port_detect, mode, &range);
+                capture_latency = range.max;
+        }
+        else {
+                jack_port_get_latency_range(ports_out[0], mode, &range);
+                playback_latency = range.max;
+        }
+        nframes_t latency = capture_latency + playback_latency;
+        LOG << "trigger-to-output latency: " << latency << " frames ("
+            << latency * 1000.0 / client->sampling_rate() << " ms; capture "
+            << capture_latency << ", playback " << playback_latency << ")";
+}
+
 int
 jack_xrun(jack_client *client, float delay)
 {
@@ -262,7 +344,19 @@ init_stimset(std::vector<string> const & stims, size_t const default_nreps)
                 }
                 else nreps = default_nreps;
                 try {
-                        jill::stimulus_t *stim = new file::stimfile(p.string());
+                        jill::stimulus_t *stim;
+                        if (util::synth_stimulus::is_spec(stims[i])) {
+                                stim = util::synth_stimulus::create(stims[i]);
+                        }
+                        else {
+                                stim = new file::stimfile(p.string(), cache.get());
+                                // only single-channel stimuli can be streamed
+                                if (options.count("stream") && stim->duration() >= options.stream_min_sec &&
+                                    stim->nchannels() == 1) {
+                                        delete stim;
+                                        stim = new file::stimstream(p.string());
+                                }
+                        }
                         _stimuli.push_back(stim);
                         for (size_t j = 0; j < nreps; ++j)
                                 _stimlist.push_back(stim);
@@ -270,10 +364,61 @@ init_stimset(std::vector<string> const & stims, size_t const default_nreps)
                 catch (jill::FileError const & e) {
                         LOG << "invalid stimulus " << p << ": " << e.what();
                 }
+                catch (std::invalid_argument const & e) {
+                        LOG << "invalid stimulus: " << e.what();
+                }
         }
 }
 
 
+static void
+log_progress(size_t done, size_t total)
+{
+        LOG << "prepared " << done << "/" << total << " stimuli";
+}
+
+/* load and resample all the stimuli before playback starts */
+static void
+preload_stimset(nframes_t samplerate)
+{
+        using namespace boost::posix_time;
+        std::vector<stimulus_t *> stims;
+        for (boost::ptr_vector<stimulus_t>::iterator it = _stimuli.begin(); it != _stimuli.end(); ++it)
+                stims.push_back(&*it);
+        size_t nthreads = (options.nthreads > 0) ? options.nthreads : util::nprocessors();
+        LOG << "preparing " << stims.size() << " stimuli with " << nthreads << " threads";
+        if (cache && cache->max_bytes() > 0)
+                LOG << "WARNING: stimuli may be unloaded to stay within the memory budget";
+        ptime start = microsec_clock::universal_time();
+        util::load_stimuli(stims, samplerate, nthreads, log_progress);
+        time_duration elapsed = microsec_clock::universal_time() - start;
+        LOG << "stimuli ready in " << elapsed.total_milliseconds() / 1000.0 << " s";
+}
+
+/*
+ * Set up the detector. The count thresholds are the number of crossings
+ * expected in each window at the detection rate.
+ */
+static void
+init_detector(nframes_t samplerate)
+{
+        nframes_t period_size = std::max(2.0f, options.detect_period_ms * samplerate / 1000);
+        int open_periods = std::max(1.0f, options.detect_window_ms / options.detect_period_ms);
+        int close_periods = std::max(1.0f, options.detect_close_ms / options.detect_period_ms);
+        int open_count = options.detect_rate * period_size / samplerate * open_periods;
+        int close_count = options.detect_rate * period_size / samplerate * close_periods;
+        detector.reset(new dsp::crossing_trigger<sample_t>(options.detect_thresh, open_count,
+                                                           open_periods, options.detect_thresh,
+                                                           close_count, close_periods,
+                                                           period_size));
+        LOG << "triggering playback by detection on detect_in";
+        LOG << "detection threshold: " << options.detect_thresh;
+        LOG << "detection period size: " << options.detect_period_ms << " ms, "
+            << period_size << " samples";
+        LOG << "open count thresh: " << open_count << " in " << open_periods << " periods";
+        LOG << "close count thresh: " << close_count << " in " << close_periods << " periods";
+}
+
 int
 main(int argc, char **argv)
 {
@@ -281,6 +426,8 @@ main(int argc, char **argv)
 	try {
 		options.parse(argc,argv);
                 client.reset(new jack_client(options.client_name, options.server_name));
+                if (options.count("profile"))
+                        client->enable_profiling(options.get<float>("profile"));
                 options.min_gap = options.min_gap_sec * client->sampling_rate();
                 options.min_interval = options.min_interval_sec * client->sampling_rate();
                 options.trigout_chan &= midi::chan_nib;
@@ -297,19 +444,59 @@ main(int argc, char **argv)
 		}
 
                 /* stimulus queue */
+                if (options.count("cache-dir") || options.cache_size_mb > 0) {
+                        // stimuli in the readahead queue must not be unloaded
+                        cache.reset(new file::stimcache(options.cache_dir,
+                                                        options.cache_size_mb * 1048576,
+                                                        options.readahead + 1));
+                        if (!options.cache_dir.empty())
+                                LOG << "resampled stimulus cache: " << options.cache_dir;
+                        if (options.cache_size_mb > 0)
+                                LOG << "stimulus memory budget: " << options.cache_size_mb << " MB";
+                }
                 init_stimset(options.stimuli, options.nreps);
                 if (options.count("shuffle")) {
                         LOG << "shuffled stimuli";
                         random_shuffle(_stimlist.begin(), _stimlist.end());
                 }
+                if (options.count("preload"))
+                        preload_stimset(client->sampling_rate());
                 queue.reset(new util::readahead_stimqueue(_stimlist.begin(), _stimlist.end(),
                                                           client->sampling_rate(),
-                                                          options.count("loop")));
-
-                port_out = client->register_port("out", JACK_DEFAULT_AUDIO_TYPE,
-                                                 JackPortIsOutput | JackPortIsTerminal, 0);
+                                                          options.count("loop"),
+                                                          options.readahead));
+
+                // by default, one output port for each channel of the widest stimulus
+                size_t nports = options.nchannels;
+                if (nports == 0) {
+                        nports = 1;
+                        for (size_t i = 0; i < _stimuli.size(); ++i)
+                                nports = std::max(nports, _stimuli[i].nchannels());
+                }
+                for (size_t i = 0; i < _stimuli.size(); ++i) {
+                        if (_stimuli[i].nchannels() > nports)
+                                LOG << "WARNING: " << _stimuli[i].name() << " has "
+                                    << _stimuli[i].nchannels() << " channels; only the first "
+                                    << nports << " will be played";
+                }
+                // with more than one channel, ports are numbered from 1
+                for (size_t i = 0; i < nports; ++i) {
+                        std::ostringstream suffix;
+                        if (nports > 1) suffix << "_" << i + 1;
+                        ports_out.push_back(client->register_port("out" + suffix.str(),
+                                                                  JACK_DEFAULT_AUDIO_TYPE,
+                                                                  JackPortIsOutput | JackPortIsTerminal,
+                                                                  0));
+                }
+                buffers_out.resize(nports);
+                if (nports > 1)
+                        LOG << "output channels: " << nports;
                 port_trigout = client->register_port("trig_out",JACK_DEFAULT_MIDI_TYPE,
                                                      JackPortIsOutput | JackPortIsTerminal, 0);
+                if (options.count("trig") && options.count("detect")) {
+                        LOG << "ERROR: --trig and --detect can't be used together";
+                        throw Exit(-1);
+                }
                 if (options.count("trig")) {
                         LOG << "triggering playback from trig_in";
                         port_trigin = client->register_port("trig_in", JACK_DEFAULT_MIDI_TYPE,
@@ -317,6 +504,12 @@ main(int argc, char **argv)
                                                             0);
                 }
                 
+                if (options.count("detect")) {
+                        port_detect = client->register_port("detect_in", JACK_DEFAULT_AUDIO_TYPE,
+                                                            JackPortIsInput | JackPortIsTerminal, 0);
+                        init_detector(client->sampling_rate());
+                }
+
                 if (options.count("pulse")) {
                         port_pulse = client->register_port("pulse_out", JACK_DEFAULT_AUDIO_TYPE, 
                                                            JackPortIsOutput | JackPortIsTerminal, 0);
@@ -330,18 +523,35 @@ main(int argc, char **argv)
                 client->set_shutdown_callback(jack_shutdown);
                 client->set_xrun_callback(jack_xrun);
                 client->set_process_callback(process);
+                if (port_detect)
+                        jack_set_latency_callback(client->client(), jack_latency, 0);
                 client->activate();
                 // set this after starting the client so it will only be called
                 // when the buffer size *changes*
                 client->set_buffer_size_callback(jack_bufsize);
 
-                client->connect_ports("out", options.output_ports.begin(), options.output_ports.end());
+                if (nports == 1) {
+                        client->connect_ports("out", options.output_ports.begin(), options.output_ports.end());
+                }
+                else {
+                        // connect outputs to destinations in order
+                        if (options.output_ports.size() > ports_out.size()) {
+                                LOG << "ERROR: more output connections than output ports";
+                                throw Exit(-1);
+                        }
+                        for (size_t i = 0; i < options.output_ports.size(); ++i)
+                                client->connect_port(jack_port_name(ports_out[i]), options.output_ports[i]);
+                }
                 client->connect_ports("trig_out", options.trigout_ports.begin(), options.trigout_ports.end());
                 client->connect_ports(options.trigin_ports.begin(), options.trigin_ports.end(), "trig_in");
+                client->connect_ports(options.detect_ports.begin(), options.detect_ports.end(), "detect_in");
                 client->connect_ports("pulse_out", options.pulse_ports.begin(), options.pulse_ports.end());
 
                 // wait for stimuli to finish playing
                 queue->join();
+                if (cache && !options.cache_dir.empty())
+                        LOG << "stimulus cache: " << cache->hits() << " hits, "
+                            << cache->misses() << " misses";
                 // wait for midi buffers to clear
                 sleep(1);
                 client->deactivate();
@@ -371,15 +581,21 @@ jstim_options::jstim_options(string const &program_name)
                 ("name,n",    po::value<string>(&client_name)->default_value(_program_name),
                  "set client name")
                 ("out,o",     po::value<vector<string> >(&output_ports),
-                 "add connection to output audio port")
+                 "add connection to output audio port (in order, if there are several)")
+                ("channels",  po::value<size_t>(&nchannels)->default_value(0),
+                 "set number of output ports (default the most channels in any stimulus)")
                 ("event,e",   po::value<vector<string> >(&trigout_ports),
                  "add connection to output event port")
                 ("chan,c",    po::value<midi::data_type>(&trigout_chan)->default_value(0),
                  "set MIDI channel for output messages (0-16)")
                 ("trig,t",    po::value<vector<string> >(&trigin_ports)->multitoken()->zero_tokens(),
                  "add connection to input trigger port")
+                ("detect,d",  po::value<vector<string> >(&detect_ports)->multitoken()->zero_tokens(),
+                 "trigger playback by detecting signals on detect_in, and add connections to it")
                 ("pulse,p", po::value<vector <string> >(&pulse_ports)->multitoken()->zero_tokens(), 
-                 "add port that emits a short pulse at the beginning and end of each stimulus, and optionally specify connection to this port");  
+                 "add port that emits a short pulse at the beginning and end of each stimulus, and optionally specify connection to this port")
+                ("profile",   po::value<float>(),
+                 "log process callback timing every N seconds");
 
         // tropts is a group of options
         po::options_description opts("Stimulus options");
@@ -390,24 +606,51 @@ jstim_options::jstim_options(string const &program_name)
                 ("gap,g",     po::value<float>(&min_gap_sec)->default_value(2.0),
                  "minimum gap between sound (s)")
                 ("interval,i",po::value<float>(&min_interval_sec)->default_value(0.0),
-                 "minimum interval between stimulus start times (s)");
-
-        cmd_opts.add(jillopts).add(opts);
+                 "minimum interval between stimulus start times (s)")
+                ("stream",    po::value<float>(&stream_min_sec)->implicit_value(0.0),
+                 "stream stimuli longer than N seconds from disk (default all) instead of loading them")
+                ("cache-dir", po::value<string>(&cache_dir),
+                 "store resampled stimuli in this directory for later sessions")
+                ("cache-size", po::value<float>(&cache_size_mb)->default_value(0),
+                 "unload least recently used stimuli to keep memory use under N MB (0 for no limit)")
+                ("readahead", po::value<size_t>(&readahead)->default_value(4),
+                 "set number of stimuli to keep loaded ahead of playback (at least 2)")
+                ("preload",   "load and resample all stimuli before starting playback")
+                ("threads",   po::value<size_t>(&nthreads)->default_value(0),
+                 "set number of threads for preloading stimuli (default number of processors)");
+
+        po::options_description detectopts("Detection options");
+        detectopts.add_options()
+                ("detect-thresh", po::value<float>(&detect_thresh)->default_value(0.01),
+                 "set threshold for signal crossings (linear scale)")
+                ("detect-rate", po::value<float>(&detect_rate)->default_value(20),
+                 "set crossing rate to detect a signal (s^-1)")
+                ("detect-window", po::value<float>(&detect_window_ms)->default_value(500),
+                 "set integration window for detecting a signal (ms)")
+                ("detect-close", po::value<float>(&detect_close_ms)->default_value(500),
+                 "set integration window for detecting the end of a signal (ms)")
+                ("detect-period", po::value<float>(&detect_period_ms)->default_value(1),
+                 "set analysis period size for detection (ms)");
+
+        cmd_opts.add(jillopts).add(opts).add(detectopts);
         cmd_opts.add_options()
                 ("stim", po::value<vector<string> >(&stimuli)->multitoken(), "stimulus file");
         pos_opts.add("stim", -1);
-        visible_opts.add(jillopts).add(opts);
+        visible_opts.add(jillopts).add(opts).add(detectopts);
 }
 
 void
 jstim_options::print_usage()
 {
         std::cout << "Usage: " << _program_name << " [options] [stimfile [nreps]] [stim [nreps]] ...\n"
+                  << "Stimuli can be files or specs for synthesized stimuli, e.g. tone:freq=1000,dur=0.5\n"
                   << visible_opts << std::endl
                   << "Ports:\n"
                   << " * out:       sampled output of the presented stimulus\n"
+                  << "              (out_1, out_2, ... for multichannel stimuli)\n"
                   << " * trig_out:  event port reporting stimulus onset/offsets\n"
-                  << " * trig_in:   (optional) event port for triggering playback"
+                  << " * trig_in:   (optional) event port for triggering playback\n"
+                  << " * detect_in: (optional) audio port for triggering playback by detection"
                   << std::endl;
 }
 
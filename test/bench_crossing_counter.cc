@@ -0,0 +1,158 @@
+/*
+ * Benchmark for dsp::crossing_counter. Compares the vectorized push() with
+ * the scalar loop it replaced, for varying analysis period sizes and numbers
+ * of channels, each with its own counter. Reports the processing time per
+ * sample and the proportion of the period budget used at 20 kHz, with and
+ * without writing the counter state, and checks that the return values and
+ * state are identical.
+ *
+ * bench_crossing_counter [period_size] [nperiods]
+ */
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <time.h>
+#include <boost/shared_ptr.hpp>
+
+#include "jill/types.hh"
+#include "jill/dsp/crossing_counter.hh"
+
+using namespace std;
+using namespace jill;
+
+static const nframes_t fs = 20000;
+
+static double
+now()
+{
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * the scalar implementation of crossing_counter::push, which keeps the
+ * position of each crossing in the current period to locate the onset
+ */
+struct scalar_counter {
+        dsp::running_counter<int> counter;
+        sample_t thresh;
+        size_t period_size;
+        size_t period_nsamples;
+        int max_crossings;
+        long time;
+        long period_start;
+        vector<long> crossings;
+
+        scalar_counter(sample_t t, size_t psize, size_t pcount)
+                : counter(pcount), thresh(t), period_size(psize), period_nsamples(0),
+                  max_crossings(pcount * psize / 2), time(0), period_start(1) {
+                crossings.reserve(psize);
+        }
+
+        int push(sample_t const * samples, size_t size, int count_thresh, sample_t * state) {
+                int ret = -1;
+                sample_t last = *samples;
+                if (state)
+                        state[0] = float(counter.running_count()) / max_crossings;
+                for (size_t i = 1; i < size; ++i) {
+                        if (period_nsamples == 0)
+                                period_start = time + i;
+                        if (last < thresh && samples[i] >= thresh)
+                                crossings.push_back(time + i);
+                        last = samples[i];
+                        period_nsamples += 1;
+                        if (period_nsamples >= period_size) {
+                                int ncrossings = crossings.size();
+                                counter.push(ncrossings);
+                                int running = counter.running_count();
+                                if (counter.full() && ret < 0) {
+                                        if (count_thresh > 0 && running > count_thresh) {
+                                                int k = count_thresh + 1 - (running - ncrossings);
+                                                long pos = (k > 0) ? crossings[k-1] : period_start;
+                                                ret = max(pos - time, 0L);
+                                        }
+                                        else if (count_thresh < 0 && running < -count_thresh)
+                                                ret = i;
+                                }
+                                period_nsamples = 0;
+                                crossings.clear();
+                        }
+                        if (state)
+                                state[i] = float(counter.running_count()) / max_crossings;
+                }
+                time += size;
+                return ret;
+        }
+};
+
+/* push all channels for nperiods; returns the elapsed time */
+template <typename Counter>
+static double
+run(vector<boost::shared_ptr<Counter> > & counters, vector<sample_t> const & in,
+    sample_t * state, vector<int> & ret, nframes_t period_size, size_t nperiods)
+{
+        size_t nchannels = counters.size();
+        double start = now();
+        for (size_t p = 0; p < nperiods; ++p) {
+                for (size_t c = 0; c < nchannels; ++c) {
+                        size_t offset = (c * nperiods + p) * period_size;
+                        ret[c * nperiods + p] = counters[c]->push(&in[offset], period_size, 20,
+                                                                  (state) ? state + offset : 0);
+                }
+        }
+        return now() - start;
+}
+
+int main(int argc, char ** argv)
+{
+        nframes_t period_size = (argc > 1) ? atoi(argv[1]) : 1024;
+        size_t nperiods = (argc > 2) ? atoi(argv[2]) : 100;
+        size_t const analysis[] = { 16, 64, 256, 1024 };
+        size_t const channels[] = { 1, 16, 128 };
+
+        cout << "period=" << period_size << ", budget=" << 1e6 * period_size / fs << " us"
+             << ", kernel=" << dsp::crossings_isa() << endl;
+        cout << "  per  chans  state    scalar(ns/samp) load(%)    simd(ns/samp) load(%)   speedup  match" << endl;
+        for (size_t ai = 0; ai < sizeof(analysis) / sizeof(size_t); ++ai) {
+                for (size_t ci = 0; ci < sizeof(channels) / sizeof(size_t); ++ci) {
+                        size_t nchannels = channels[ci];
+                        size_t nsamples = nchannels * nperiods * period_size;
+                        vector<sample_t> in(nsamples), sa(nsamples), sb(nsamples);
+                        srand(nchannels);
+                        for (size_t i = 0; i < nsamples; ++i)
+                                in[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+                        double budget = double(nperiods) * period_size / fs;
+
+                        for (int with_state = 0; with_state < 2; ++with_state) {
+                                vector<boost::shared_ptr<scalar_counter> > a;
+                                vector<boost::shared_ptr<dsp::crossing_counter<sample_t> > > b;
+                                for (size_t c = 0; c < nchannels; ++c) {
+                                        a.push_back(boost::shared_ptr<scalar_counter>(
+                                                            new scalar_counter(0.5f, analysis[ai], 10)));
+                                        b.push_back(boost::shared_ptr<dsp::crossing_counter<sample_t> >(
+                                                            new dsp::crossing_counter<sample_t>(0.5f, analysis[ai], 10)));
+                                }
+                                vector<int> ra(nchannels * nperiods), rb(ra.size());
+                                double t_scalar = run(a, in, (with_state) ? &sa[0] : 0, ra,
+                                                      period_size, nperiods);
+                                double t_simd = run(b, in, (with_state) ? &sb[0] : 0, rb,
+                                                    period_size, nperiods);
+                                bool match = (ra == rb) && (!with_state || sa == sb);
+                                cout << setw(5) << analysis[ai]
+                                     << setw(7) << nchannels
+                                     << setw(7) << ((with_state) ? "yes" : "no")
+                                     << fixed << setprecision(2)
+                                     << setw(19) << 1e9 * t_scalar / nsamples
+                                     << setw(8) << 100 * t_scalar / budget
+                                     << setw(17) << 1e9 * t_simd / nsamples
+                                     << setw(8) << 100 * t_simd / budget
+                                     << setw(10) << t_scalar / t_simd
+                                     << setw(7) << ((match) ? "yes" : "NO")
+                                     << endl;
+                        }
+                }
+        }
+}
@@ -0,0 +1,217 @@
+/*
+ * Benchmark for digital_filter. Compares the direct form implementation with
+ * cascaded second-order sections for Butterworth low-pass filters of varying
+ * order, with varying numbers of channels. Reports the processing time per
+ * sample and the proportion of the period budget used at 20 kHz, along with
+ * the maximum difference between the two implementations (which indicates
+ * numerical problems in the direct form). A second table compares filtering
+ * each channel separately with filtering channels in lockstep using
+ * dsp::sos_lockstep, for a 4th-order band-pass filter. The last table compares
+ * direct and FFT convolution for FIR filters of varying length.
+ *
+ * bench_filter [period_size] [nperiods]
+ */
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <time.h>
+
+#include "jill/logging.hh"
+#include "jill/logger.hh"
+#include "jill/digital_filter.hh"
+#include "jill/dsp/sos_lockstep.hh"
+
+using namespace std;
+using namespace jill;
+
+typedef digital_filter::sample_t sample_t;
+typedef digital_filter::COEF_t COEF_t;
+typedef digital_filter::nframes_t nframes_t;
+
+static const nframes_t fs = 20000;
+
+static double
+now()
+{
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* filter all channels for nperiods; returns the elapsed time */
+static double
+run(digital_filter & filter, vector<sample_t> const & in,
+    vector<sample_t> & out, nframes_t period_size, size_t nperiods)
+{
+        size_t nchannels = filter.nchannels();
+        double start = now();
+        for (size_t p = 0; p < nperiods; ++p) {
+                for (size_t c = 0; c < nchannels; ++c) {
+                        size_t offset = (c * nperiods + p) * period_size;
+                        filter.filter_buf(&in[offset], &out[offset], c, period_size);
+                }
+        }
+        return now() - start;
+}
+
+/* filter all channels for nperiods in lockstep */
+static double
+run_lockstep(dsp::sos_lockstep & filter, vector<sample_t> const & in,
+             vector<sample_t> & out, nframes_t period_size, size_t nperiods)
+{
+        size_t nchannels = filter.nchannels();
+        vector<sample_t const *> pin(nchannels);
+        vector<sample_t *> pout(nchannels);
+        double start = now();
+        for (size_t p = 0; p < nperiods; ++p) {
+                for (size_t c = 0; c < nchannels; ++c) {
+                        size_t offset = (c * nperiods + p) * period_size;
+                        pin[c] = &in[offset];
+                        pout[c] = &out[offset];
+                }
+                filter.process(&pin[0], &pout[0], period_size);
+        }
+        return now() - start;
+}
+
+static void
+bench_lockstep(nframes_t period_size, size_t nperiods)
+{
+        size_t const channels[] = { 4, 16, 64, 128 };
+        dsp::sos_lockstep::isa_type best = dsp::sos_lockstep::best_isa();
+        vector<COEF_t> Wc(1, 500);
+        Wc.push_back(5000);
+
+        cout << endl << "band-pass, order 4" << endl;
+        cout << "chans     isa  channel(ns/samp) load(%)  lockstep(ns/samp) load(%)   speedup   maxdiff" << endl;
+        for (size_t ci = 0; ci < sizeof(channels) / sizeof(size_t); ++ci) {
+                size_t nchannels = channels[ci];
+                size_t nsamples = nchannels * nperiods * period_size;
+                vector<sample_t> in(nsamples), a(nsamples), b(nsamples);
+                srand(nchannels);
+                for (size_t i = 0; i < nsamples; ++i)
+                        in[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+
+                digital_filter filter;
+                filter.butter(4, Wc, "band-pass", fs);
+                for (size_t c = 0; c < nchannels; ++c)
+                        filter.add_channel();
+                double t_channel = run(filter, in, a, period_size, nperiods);
+                double budget = double(nperiods) * period_size / fs;
+
+                for (int isa = dsp::sos_lockstep::SCALAR; isa <= best; ++isa) {
+                        dsp::sos_lockstep lockstep(filter.sections(), nchannels,
+                                                   dsp::sos_lockstep::isa_type(isa));
+                        double t_lockstep = run_lockstep(lockstep, in, b, period_size, nperiods);
+                        double maxdiff = 0;
+                        for (size_t i = 0; i < nsamples; ++i)
+                                maxdiff = max(maxdiff, (double)fabs(a[i] - b[i]));
+                        cout << setw(5) << nchannels
+                             << setw(8) << dsp::sos_lockstep::isa_name(lockstep.isa())
+                             << fixed << setprecision(2)
+                             << setw(18) << 1e9 * t_channel / nsamples
+                             << setw(8) << 100 * t_channel / budget
+                             << setw(19) << 1e9 * t_lockstep / nsamples
+                             << setw(8) << 100 * t_lockstep / budget
+                             << setw(10) << t_channel / t_lockstep
+                             << setw(10) << scientific << setprecision(1) << maxdiff
+                             << endl;
+                }
+        }
+}
+
+static void
+bench_fir(nframes_t period_size, size_t nperiods)
+{
+        size_t const ntaps[] = { 16, 32, 64, 128, 256, 1024, 4096 };
+        const size_t nchannels = 8;
+        size_t nsamples = nchannels * nperiods * period_size;
+        vector<sample_t> in(nsamples), a(nsamples), b(nsamples);
+        srand(1);
+        for (size_t i = 0; i < nsamples; ++i)
+                in[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        double budget = double(nperiods) * period_size / fs;
+
+        cout << endl << "FIR, " << nchannels << " channels" << endl;
+        cout << " taps      direct(ns/samp) load(%)      fft(ns/samp) load(%)   speedup   maxdiff" << endl;
+        for (size_t ti = 0; ti < sizeof(ntaps) / sizeof(size_t); ++ti) {
+                vector<COEF_t> taps(ntaps[ti]);
+                for (size_t i = 0; i < taps.size(); ++i)
+                        taps[i] = (2.0 * rand() / RAND_MAX - 1.0) / taps.size();
+                digital_filter direct, fft;
+                direct.set_fft_threshold(0);
+                direct.custom_coef(taps, vector<COEF_t>());
+                fft.set_fft_threshold(1);
+                fft.set_period_size(period_size);
+                fft.custom_coef(taps, vector<COEF_t>());
+                for (size_t c = 0; c < nchannels; ++c) {
+                        direct.add_channel();
+                        fft.add_channel();
+                }
+                double t_direct = run(direct, in, a, period_size, nperiods);
+                double t_fft = run(fft, in, b, period_size, nperiods);
+                double maxdiff = 0;
+                for (size_t i = 0; i < nsamples; ++i)
+                        maxdiff = max(maxdiff, (double)fabs(a[i] - b[i]));
+                cout << setw(5) << taps.size()
+                     << fixed << setprecision(2)
+                     << setw(21) << 1e9 * t_direct / nsamples
+                     << setw(8) << 100 * t_direct / budget
+                     << setw(18) << 1e9 * t_fft / nsamples
+                     << setw(8) << 100 * t_fft / budget
+                     << setw(10) << t_direct / t_fft
+                     << setw(10) << scientific << setprecision(1) << maxdiff
+                     << endl;
+        }
+}
+
+int main(int argc, char ** argv)
+{
+        nframes_t period_size = (argc > 1) ? atoi(argv[1]) : 1024;
+        size_t nperiods = (argc > 2) ? atoi(argv[2]) : 20;
+        size_t const channels[] = { 1, 8, 32, 128 };
+
+        logger::instance().set_sourcename("bench_filter");
+        cout << "period=" << period_size << ", budget=" << 1e6 * period_size / fs << " us" << endl;
+        cout << "order  chans     direct(ns/samp) load(%)     sos(ns/samp) load(%)   speedup   maxdiff" << endl;
+        for (int order = 2; order <= 12; order += 2) {
+                for (size_t ci = 0; ci < sizeof(channels) / sizeof(size_t); ++ci) {
+                        size_t nchannels = channels[ci];
+                        size_t nsamples = nchannels * nperiods * period_size;
+                        vector<sample_t> in(nsamples), a(nsamples), b(nsamples);
+                        srand(order);
+                        for (size_t i = 0; i < nsamples; ++i)
+                                in[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+
+                        digital_filter sos, direct;
+                        sos.butter(order, vector<COEF_t>(1, 500), "low-pass", fs);
+                        direct.custom_coef(sos.coef_in(), sos.coef_out());
+                        for (size_t c = 0; c < nchannels; ++c) {
+                                sos.add_channel();
+                                direct.add_channel();
+                        }
+
+                        double t_direct = run(direct, in, a, period_size, nperiods);
+                        double t_sos = run(sos, in, b, period_size, nperiods);
+                        double maxdiff = 0;
+                        for (size_t i = 0; i < nsamples; ++i)
+                                maxdiff = max(maxdiff, (double)fabs(a[i] - b[i]));
+
+                        // time for one period of all channels, relative to the period length
+                        double budget = double(nperiods) * period_size / fs;
+                        cout << setw(5) << order << setw(7) << nchannels
+                             << fixed << setprecision(2)
+                             << setw(20) << 1e9 * t_direct / nsamples
+                             << setw(8) << 100 * t_direct / budget
+                             << setw(17) << 1e9 * t_sos / nsamples
+                             << setw(8) << 100 * t_sos / budget
+                             << setw(10) << t_direct / t_sos
+                             << setw(10) << scientific << setprecision(1) << maxdiff
+                             << endl;
+                }
+        }
+        bench_lockstep(period_size, nperiods);
+        bench_fir(period_size, nperiods);
+}
@@ -0,0 +1,95 @@
+/*
+ * Benchmark for the logger. Measures throughput (messages per second,
+ * including the time to write all pending messages) and the latency seen by
+ * the caller, with the logger in synchronous and asynchronous mode.
+ *
+ * Log messages are written to stdout and results to stderr, so run as:
+ *
+ * bench_logger [nmessages] [nthreads] > /dev/null
+ */
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <time.h>
+#include <pthread.h>
+
+#include "jill/logging.hh"
+#include "jill/logger.hh"
+
+using namespace std;
+using namespace jill;
+
+static double
+now()
+{
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct worker_t {
+        size_t nmessages;
+        vector<double> latency;         // in us
+};
+
+static void *
+worker(void * arg)
+{
+        worker_t * w = static_cast<worker_t *>(arg);
+        w->latency.resize(w->nmessages);
+        for (size_t i = 0; i < w->nmessages; ++i) {
+                double start = now();
+                LOG << "created entry /jrecord_" << i << " (dataset=pcm_" << i % 16 << ")";
+                w->latency[i] = (now() - start) * 1e6;
+        }
+        return 0;
+}
+
+static void
+run(bool async, size_t nmessages, size_t nthreads)
+{
+        logger::instance().set_async(async);
+
+        vector<worker_t> workers(nthreads);
+        vector<pthread_t> threads(nthreads);
+        double start = now();
+        for (size_t i = 0; i < nthreads; ++i) {
+                workers[i].nmessages = nmessages / nthreads;
+                pthread_create(&threads[i], NULL, worker, &workers[i]);
+        }
+        for (size_t i = 0; i < nthreads; ++i)
+                pthread_join(threads[i], NULL);
+        double logged = now() - start;
+        logger::instance().flush();
+        double elapsed = now() - start;
+
+        vector<double> latency;
+        for (size_t i = 0; i < nthreads; ++i)
+                latency.insert(latency.end(), workers[i].latency.begin(), workers[i].latency.end());
+        sort(latency.begin(), latency.end());
+        size_t n = latency.size();
+
+        fprintf(stderr, "%-6s threads=%zu msgs=%zu: %9.0f msg/s (callers done in %.3f s); "
+                "latency (us): median=%.2f p99=%.2f p99.9=%.2f max=%.2f\n",
+                async ? "async" : "sync", nthreads, n, n / elapsed, logged,
+                latency[n / 2], latency[n * 99 / 100], latency[n * 999 / 1000], latency[n - 1]);
+}
+
+int main(int argc, char ** argv)
+{
+        size_t nmessages = (argc > 1) ? atoi(argv[1]) : 100000;
+        size_t nthreads = (argc > 2) ? atoi(argv[2]) : 1;
+
+        // warm up the logger
+        logger::instance().set_sourcename("bench_logger");
+        run(false, 1000, 1);
+
+        run(false, nmessages, nthreads);
+        run(true, nmessages, nthreads);
+        if (nthreads == 1) {
+                run(false, nmessages, 4);
+                run(true, nmessages, 4);
+        }
+}
@@ -0,0 +1,379 @@
+/*
+ * Benchmark for the recording stack. A producer thread emulates the JACK
+ * process callback in jrecord: it wakes up once per period (using absolute
+ * deadlines on the monotonic clock), pushes a block for each channel to a
+ * buffered_data_writer or triggered_data_writer, and signals the writer
+ * thread. The writer thread passes the data to a null sink or an arf_writer.
+ *
+ * For each combination of backend, mode, period size, ringbuffer size, and
+ * compression level, the benchmark searches for the highest channel count that
+ * runs for the full duration without dropping any data, and reports the
+ * latency between the end of each period and the time its data were written,
+ * and the fill level of the ringbuffer.
+ *
+ * Example:
+ * bench_recording --backend null arf --period 64 1024 --buffer 0.5 2 --duration 10
+ */
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include "jill/types.hh"
+#include "jill/midi.hh"
+#include "jill/data_source.hh"
+#include "jill/data_writer.hh"
+#include "jill/file/arf_writer.hh"
+#include "jill/dsp/buffered_data_writer.hh"
+#include "jill/dsp/triggered_data_writer.hh"
+
+using namespace std;
+using namespace jill;
+namespace po = boost::program_options;
+
+static const nframes_t sampling_rate = 20000;
+
+static double
+now()
+{
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+template <typename T>
+static T
+percentile(vector<T> & v, double p)
+{
+        if (v.empty()) return T();
+        size_t i = min(v.size() - 1, size_t(p * v.size()));
+        nth_element(v.begin(), v.begin() + i, v.end());
+        return v[i];
+}
+
+/* data_source whose clock is tied to the start of the trial */
+class bench_source : public data_source {
+public:
+        bench_source() : _start(now()) {}
+        /** reset the clock to frame 0 */
+        void restart() { _start = now(); }
+        char const * name() const { return "bench_recording"; }
+        nframes_t sampling_rate() const { return ::sampling_rate; }
+        nframes_t frame() const { return frame(time()); }
+        nframes_t frame(utime_t t) const { return t * ::sampling_rate / 1000000; }
+        utime_t time(nframes_t f) const { return utime_t(f) * 1000000 / ::sampling_rate; }
+        utime_t time() const { return utime_t((now() - _start) * 1e6); }
+
+        /** the wall-clock time when the block starting at frame was pushed */
+        double pushed(nframes_t frame, nframes_t period_size) const {
+                return _start + double(frame + period_size) / ::sampling_rate;
+        }
+
+        double _start;
+};
+
+/*
+ * Decorator that measures the latency of each block and passes it on to
+ * another data_writer, if one is supplied.
+ */
+class bench_writer : public data_writer {
+public:
+        bench_writer(bench_source const & source, nframes_t period_size,
+                     boost::shared_ptr<data_writer> writer)
+                : _source(source), _period_size(period_size), _writer(writer), _entry(false) {}
+
+        bool ready() const { return (_writer) ? _writer->ready() : _entry; }
+        void new_entry(nframes_t frame) {
+                if (_writer) _writer->new_entry(frame);
+                _entry = true;
+        }
+        void close_entry() {
+                if (_writer) _writer->close_entry();
+                _entry = false;
+        }
+        void xrun() {
+                if (_writer) _writer->xrun();
+        }
+        void write(data_block_t const * data, nframes_t start, nframes_t stop) {
+                if (!ready()) new_entry(data->time);
+                if (_writer) _writer->write(data, start, stop);
+                if (data->dtype == SAMPLED) {
+                        latency.push_back((now() - _source.pushed(data->time, _period_size)) * 1000);
+                }
+        }
+        void flush() { if (_writer) _writer->flush(); }
+
+        bench_source const & _source;
+        nframes_t const _period_size;
+        boost::shared_ptr<data_writer> _writer;
+        bool _entry;
+
+        vector<double> latency;         // ms
+};
+
+struct trial_t {
+        // parameters
+        string backend;
+        bool triggered;
+        nframes_t period_size;
+        float buffer_s;
+        int compression;
+        size_t nchannels;
+        float duration;
+        string output;
+
+        // results
+        size_t nperiods;
+        size_t dropped;                 // blocks that didn't fit in the buffer
+        size_t late;                    // periods where the producer missed its deadline
+        vector<double> latency;         // ms
+        vector<double> fill;            // proportion of buffer
+};
+
+struct producer_t {
+        trial_t * trial;
+        bench_source * source;
+        dsp::buffered_data_writer * writer;
+};
+
+static void *
+producer(void * arg)
+{
+        producer_t * p = static_cast<producer_t *>(arg);
+        trial_t & t = *p->trial;
+
+        // emulate the JACK process thread; this may fail without privileges
+        sched_param param;
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+        vector<string> ids(t.nchannels);
+        for (size_t c = 0; c < t.nchannels; ++c) {
+                ostringstream os;
+                os << "pcm_" << setw(3) << setfill('0') << c;
+                ids[c] = os.str();
+        }
+        vector<sample_t> samples(t.period_size);
+        for (nframes_t i = 0; i < t.period_size; ++i)
+                samples[i] = sample_t(i % 64) / 64;
+        size_t const sz_data = t.period_size * sizeof(sample_t);
+
+        // in triggered mode, record for 1 s out of every 2 s. The first onset
+        // is at 0.5 s so that there's pretrigger data.
+        midi::data_type const onset[] = { midi::note_on, 0, 64 };
+        midi::data_type const offset[] = { midi::note_off, 0, 0 };
+        nframes_t const trig_cycle = 2 * sampling_rate;
+
+        t.nperiods = size_t(t.duration * sampling_rate / t.period_size);
+        t.fill.reserve(t.nperiods);
+        long const period_ns = long(1e9 * t.period_size / sampling_rate);
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        p->source->restart();
+
+        for (size_t i = 0; i < t.nperiods; ++i) {
+                deadline.tv_nsec += period_ns;
+                while (deadline.tv_nsec >= 1000000000L) {
+                        deadline.tv_nsec -= 1000000000L;
+                        deadline.tv_sec += 1;
+                }
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0);
+                if (now() - (deadline.tv_sec + deadline.tv_nsec * 1e-9) > 0.5e-3)
+                        t.late += 1;
+
+                nframes_t time = i * t.period_size;
+                if (t.triggered) {
+                        // offsets of the next onset and offset from the start of the period
+                        nframes_t phase = time % trig_cycle;
+                        nframes_t on = (trig_cycle + sampling_rate / 2 - phase) % trig_cycle;
+                        nframes_t off = (trig_cycle + sampling_rate * 3 / 2 - phase) % trig_cycle;
+                        if (on < t.period_size)
+                                p->writer->push(time + on, EVENT, "trig_in", sizeof(onset), onset);
+                        if (off < t.period_size)
+                                p->writer->push(time + off, EVENT, "trig_in", sizeof(offset), offset);
+                }
+                for (size_t c = 0; c < t.nchannels; ++c) {
+                        // check for space the same way block_ringbuffer does, so
+                        // that drops are counted exactly
+                        data_block_t hdr = { time, SAMPLED, ids[c].size(), sz_data, 1 };
+                        if (hdr.size() > p->writer->buffer_capacity() - p->writer->buffer_fill()) {
+                                t.dropped += 1;
+                                p->writer->xrun();
+                                continue;
+                        }
+                        p->writer->push(time, SAMPLED, ids[c].c_str(), sz_data, &samples[0]);
+                }
+                p->writer->data_ready();
+                t.fill.push_back(double(p->writer->buffer_fill()) / p->writer->buffer_capacity());
+        }
+        return 0;
+}
+
+static void
+run_trial(trial_t & t)
+{
+        t.nperiods = t.dropped = t.late = 0;
+        t.latency.clear();
+        t.fill.clear();
+
+        bench_source source;
+        boost::shared_ptr<data_writer> backend;
+        if (t.backend == "arf") {
+                map<string,string> attrs;
+                backend.reset(new file::arf_writer(t.output, source, attrs, t.compression));
+        }
+        boost::shared_ptr<bench_writer> sink(new bench_writer(source, t.period_size, backend));
+
+        boost::shared_ptr<dsp::buffered_data_writer> writer;
+        if (t.triggered)
+                writer.reset(new dsp::triggered_data_writer(sink, "trig_in", sampling_rate / 10,
+                                                             sampling_rate / 10));
+        else
+                writer.reset(new dsp::buffered_data_writer(sink));
+        size_t bytes = size_t(t.buffer_s * sampling_rate * t.nchannels * sizeof(sample_t));
+        writer->request_buffer_size(bytes);
+        writer->start();
+
+        producer_t p = { &t, &source, writer.get() };
+        pthread_t thread;
+        pthread_create(&thread, NULL, producer, &p);
+        pthread_join(thread, NULL);
+        writer->stop();
+        writer->join();
+        writer.reset();
+
+        t.latency.swap(sink->latency);
+        if (t.backend == "arf")
+                boost::filesystem::remove(t.output);
+}
+
+static void
+report(trial_t & t)
+{
+        cout << setw(4) << t.nchannels << " ch: "
+             << "dropped=" << t.dropped << "/" << t.nperiods * t.nchannels
+             << " late=" << t.late
+             << fixed << setprecision(2)
+             << " latency(ms) p50=" << percentile(t.latency, 0.5)
+             << " p99=" << percentile(t.latency, 0.99)
+             << " max=" << percentile(t.latency, 1.0)
+             << setprecision(1)
+             << " fill(%) p50=" << 100 * percentile(t.fill, 0.5)
+             << " p99=" << 100 * percentile(t.fill, 0.99)
+             << " max=" << 100 * percentile(t.fill, 1.0)
+             << endl;
+}
+
+/*
+ * Find the highest channel count that doesn't drop data, by doubling from 1
+ * and then bisecting between the last good and first bad counts.
+ */
+static size_t
+search(trial_t & t, size_t max_channels)
+{
+        size_t good = 0, bad = max_channels + 1;
+        for (t.nchannels = 1; t.nchannels <= max_channels; t.nchannels *= 2) {
+                run_trial(t);
+                report(t);
+                if (t.dropped > 0) {
+                        bad = t.nchannels;
+                        break;
+                }
+                good = t.nchannels;
+        }
+        while (bad - good > 1 && good < max_channels) {
+                t.nchannels = (good + bad) / 2;
+                run_trial(t);
+                report(t);
+                if (t.dropped > 0)
+                        bad = t.nchannels;
+                else
+                        good = t.nchannels;
+        }
+        return good;
+}
+
+int main(int argc, char ** argv)
+{
+        vector<string> backends, modes;
+        vector<nframes_t> periods;
+        vector<float> buffers;
+        vector<int> compressions;
+        float duration;
+        size_t max_channels;
+        string output;
+
+        po::options_description opts("Options");
+        opts.add_options()
+                ("help,h", "print help message")
+                ("backend", po::value<vector<string> >(&backends)->multitoken(),
+                 "writer backends to test (null, arf)")
+                ("mode", po::value<vector<string> >(&modes)->multitoken(),
+                 "recording modes to test (continuous, triggered)")
+                ("period", po::value<vector<nframes_t> >(&periods)->multitoken(),
+                 "period sizes to test (frames)")
+                ("buffer", po::value<vector<float> >(&buffers)->multitoken(),
+                 "ringbuffer sizes to test (s)")
+                ("compression", po::value<vector<int> >(&compressions)->multitoken(),
+                 "compression levels to test (arf backend only)")
+                ("duration", po::value<float>(&duration)->default_value(10),
+                 "duration of each trial (s)")
+                ("max-channels", po::value<size_t>(&max_channels)->default_value(512),
+                 "maximum number of channels to test")
+                ("output", po::value<string>(&output)->default_value("bench_recording.arf"),
+                 "temporary file for the arf backend");
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, opts), vm);
+        po::notify(vm);
+        if (vm.count("help")) {
+                cout << "Usage: " << argv[0] << " [options]\n" << opts;
+                return 0;
+        }
+        if (backends.empty()) backends.push_back("null");
+        if (modes.empty()) modes.push_back("continuous");
+        if (periods.empty()) periods.push_back(1024);
+        if (buffers.empty()) buffers.push_back(2.0);
+        if (compressions.empty()) compressions.push_back(0);
+
+        vector<string> summary;
+        trial_t t;
+        t.duration = duration;
+        t.output = output;
+        for (size_t b = 0; b < backends.size(); ++b)
+        for (size_t m = 0; m < modes.size(); ++m)
+        for (size_t p = 0; p < periods.size(); ++p)
+        for (size_t r = 0; r < buffers.size(); ++r)
+        for (size_t c = 0; c < compressions.size(); ++c) {
+                if (backends[b] != "arf" && c > 0) continue;
+                t.backend = backends[b];
+                t.triggered = (modes[m] == "triggered");
+                t.period_size = periods[p];
+                t.buffer_s = buffers[r];
+                t.compression = (t.backend == "arf") ? compressions[c] : 0;
+
+                ostringstream label;
+                label << "backend=" << t.backend << " mode=" << modes[m]
+                      << " period=" << t.period_size << " buffer=" << t.buffer_s << "s"
+                      << " compression=" << t.compression;
+                cout << "== " << label.str() << endl;
+                size_t n = search(t, max_channels);
+                ostringstream result;
+                result << label.str() << ": max channels = " << n;
+                if (n == max_channels) result << " (limit)";
+                summary.push_back(result.str());
+        }
+
+        cout << "== summary (" << duration << " s trials, " << sampling_rate << " Hz)" << endl;
+        for (size_t i = 0; i < summary.size(); ++i)
+                cout << summary[i] << endl;
+}
@@ -1,8 +1,12 @@
 #include <iostream>
 #include <cassert>
-
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 
 #include "jill/dsp/crossing_trigger.hh"
+#include "jill/dsp/crossing_trigger_bank.hh"
 
 using namespace std;
 using namespace jill;
@@ -27,23 +31,264 @@ void test_counter(size_t size)
         assert(!counter.full());
 }
 
-void test_crossing_counter(size_t thresh, size_t period_size, size_t period_count, size_t nblocks)
+/* the compile-time counter gives the same sums as the runtime one */
+template <size_t N>
+void test_static_counter()
+{
+        dsp::running_counter<int> ref(N);
+        dsp::static_running_counter<int, N> counter;
+        for (size_t i = 0; i < 5 * N; ++i) {
+                int x = rand() % 100;
+                ref.push(x);
+                counter.push(x);
+                assert(counter.full() == ref.full());
+                assert(counter.running_count() == ref.running_count());
+        }
+        counter.reset();
+        assert(!counter.full());
+        assert(counter.running_count() == 0);
+}
+
+/* each window of the multi-window counter matches a separate counter */
+void test_multi_counter()
+{
+        const size_t windows[] = { 1, 5, 16, 37, 64 };
+        const size_t nwindows = sizeof(windows) / sizeof(size_t);
+        dsp::multi_running_counter<int> counter(windows, windows + nwindows);
+        vector<boost::shared_ptr<dsp::running_counter<int> > > refs;
+        for (size_t k = 0; k < nwindows; ++k)
+                refs.push_back(boost::shared_ptr<dsp::running_counter<int> >(
+                                       new dsp::running_counter<int>(windows[k])));
+        assert(counter.nwindows() == nwindows);
+        for (size_t trial = 0; trial < 2; ++trial) {
+                for (size_t i = 0; i < 300; ++i) {
+                        int x = rand() % 100;
+                        counter.push(x);
+                        for (size_t k = 0; k < nwindows; ++k) {
+                                refs[k]->push(x);
+                                assert(counter.full(k) == refs[k]->full());
+                                assert(counter.running_count(k) == refs[k]->running_count());
+                        }
+                }
+                counter.reset();
+                for (size_t k = 0; k < nwindows; ++k) {
+                        refs[k]->reset();
+                        assert(!counter.full(k));
+                        assert(counter.running_count(k) == 0);
+                }
+        }
+}
+
+/*
+ * The scalar implementation of crossing_counter::push, for comparison. Keeps
+ * the position of every crossing in the current period (counting from the
+ * start of the first block) to locate the one that crossed the threshold.
+ */
+struct reference_counter {
+        dsp::running_counter<int> counter;
+        float thresh;
+        size_t period_size;
+        size_t period_nsamples;
+        int max_crossings;
+        long time;                      // position of the current block
+        long period_start;              // first sample of the current period
+        vector<long> crossings;         // crossings in the current period
+
+        reference_counter(float t, size_t psize, size_t pcount)
+                : counter(pcount), thresh(t), period_size(psize), period_nsamples(0),
+                  max_crossings(pcount * psize / 2), time(0), period_start(1) {}
+
+        int push(float const * samples, size_t size, int count_thresh, float * state) {
+                int ret = -1;
+                float last = *samples;
+                state[0] = float(counter.running_count()) / max_crossings;
+                for (size_t i = 1; i < size; ++i) {
+                        if (period_nsamples == 0)
+                                period_start = time + i;
+                        if (last < thresh && samples[i] >= thresh)
+                                crossings.push_back(time + i);
+                        last = samples[i];
+                        period_nsamples += 1;
+                        if (period_nsamples >= period_size) {
+                                int ncrossings = crossings.size();
+                                counter.push(ncrossings);
+                                int running = counter.running_count();
+                                if (counter.full() && ret < 0) {
+                                        if (count_thresh > 0 && running > count_thresh) {
+                                                int k = count_thresh + 1 - (running - ncrossings);
+                                                long pos = (k > 0) ? crossings[k-1] : period_start;
+                                                ret = max(pos - time, 0L);
+                                        }
+                                        else if (count_thresh < 0 && running < -count_thresh)
+                                                ret = i;
+                                }
+                                period_nsamples = 0;
+                                crossings.clear();
+                        }
+                        state[i] = float(counter.running_count()) / max_crossings;
+                }
+                time += size;
+                return ret;
+        }
+};
+
+void test_count_crossings()
+{
+        float x[] = { 0, 1, 0, 1, 1, -1, 2, NAN, 2, 0, 0.5, 0.5 };
+        assert(dsp::count_crossings(x, 0, 0.5f) == 0);
+        assert(dsp::count_crossings(x, 1, 0.5f) == 0);
+        assert(dsp::count_crossings(x, 2, 0.5f) == 1);
+        assert(dsp::count_crossings(x, 12, 0.5f) == 4);
+        assert(dsp::find_crossing(x, 12, 0.5f, 1) == 1);
+        assert(dsp::find_crossing(x, 12, 0.5f, 3) == 6);
+        assert(dsp::find_crossing(x, 12, 0.5f, 4) == 10);
+        assert(dsp::find_crossing(x, 12, 0.5f, 5) == 12);
+        // long buffers use the vector kernels
+        vector<float> y(1003);
+        vector<double> z(y.size());
+        size_t expected = 0;
+        for (size_t i = 0; i < y.size(); ++i) {
+                y[i] = z[i] = rand() % 3;
+                if (i > 0 && y[i-1] < 1 && y[i] >= 1) expected += 1;
+        }
+        for (size_t offset = 0; offset < 20; ++offset) {
+                size_t n = dsp::count_crossings<float>(&y[offset], y.size() - offset, 1.0f);
+                assert(dsp::count_crossings(&y[offset], y.size() - offset, 1.0f) == n);
+                assert(dsp::count_crossings(&z[offset], z.size() - offset, 1.0) == n);
+        }
+        assert(dsp::count_crossings(&y[0], y.size(), 1.0f) == expected);
+}
+
+/* the counter gives the same results and state as the scalar implementation */
+void test_crossing_counter(float thresh, size_t period_size, size_t period_count, size_t nblocks)
 {
         dsp::crossing_counter<float> counter(thresh, period_size, period_count);
+        reference_counter reference(thresh, period_size, period_count);
         assert(counter.count() == 0);
         assert(counter.thresh() == thresh);
 
+        const int count_thresh = period_count * period_size / 8;
         for (size_t block = 0; block < nblocks; ++block) {
-                // generate a chunk of data
-                // push it to counter
-                // verify return value
+                // blocks of varying size, with bursts of high-frequency noise
+                size_t size = 2 + rand() % (3 * period_size);
+                float amplitude = (block / 4) % 2 ? 1.0f : 0.1f;
+                vector<float> x(size), s1(size), s2(size);
+                for (size_t i = 0; i < size; ++i)
+                        x[i] = amplitude * (2.0f * rand() / RAND_MAX - 1.0f);
+                if (block % 7 == 3) x[size / 2] = NAN;
+                int sign = (block % 2) ? 1 : -1;
+                int r1 = counter.push(&x[0], size, sign * count_thresh, &s1[0]);
+                int r2 = reference.push(&x[0], size, sign * count_thresh, &s2[0]);
+                assert(r1 == r2);
+                assert(s1 == s2);
+                assert(counter.count() == reference.counter.running_count());
         }
 }
 
+/* each channel of a bank behaves like its own crossing_trigger */
+void test_trigger_bank(size_t nchannels, size_t period_size, size_t nblocks)
+{
+        typedef boost::shared_ptr<dsp::crossing_trigger<float> > trigger_ptr;
+        dsp::crossing_trigger_bank<float> bank(nchannels, 0.1f, 10, 4, 0.1f, 4, 8, period_size);
+        vector<trigger_ptr> triggers;
+        for (size_t c = 0; c < nchannels; ++c)
+                triggers.push_back(trigger_ptr(new dsp::crossing_trigger<float>(0.1f, 10, 4, 0.1f, 4,
+                                                                                8, period_size)));
+        assert(bank.nchannels() == nchannels);
+        size_t changes = 0;
+        for (size_t block = 0; block < nblocks; ++block) {
+                size_t size = 2 + rand() % (3 * period_size);
+                size_t nopen = 0;
+                for (size_t c = 0; c < nchannels; ++c) {
+                        // each channel has bursts of noise with a different period
+                        float amplitude = ((block / (c + 2)) % 2) ? 1.0f : 0.01f;
+                        vector<float> x(size), s1(size), s2(size);
+                        for (size_t i = 0; i < size; ++i)
+                                x[i] = amplitude * (2.0f * rand() / RAND_MAX - 1.0f);
+                        int r1 = bank.push(c, &x[0], size, &s1[0]);
+                        int r2 = triggers[c]->push(&x[0], size, &s2[0]);
+                        assert(r1 == r2);
+                        assert(s1 == s2);
+                        assert(bank.open(c) == triggers[c]->open());
+                        changes += (r1 >= 0);
+                        nopen += bank.open(c);
+                }
+                assert(bank.nopen() == nopen);
+        }
+        assert(changes > 0);
+}
+
+/*
+ * The gate opens at the crossing that takes the count over threshold, not at
+ * the end of the period. Feeds a sinusoidal burst in blocks of varying size
+ * and compares the onset with the crossings counted in the signal. The first
+ * sample of each block is never counted, so the expected crossings are
+ * located in the same way. The gate closes at the end of a period after the
+ * burst is over.
+ */
+void test_trigger_timing(size_t period_size, size_t onset, size_t duration)
+{
+        const int ocount = 10, owindow = 256 / period_size + 1;
+        dsp::crossing_trigger<float> trigger(0.1f, ocount, owindow, 0.1f, 4, 8, period_size);
+        const size_t nsamples = onset + duration + 20 * period_size;
+        vector<float> x(nsamples, 0.0f);
+        for (size_t t = onset; t < onset + duration; ++t)
+                x[t] = sin(2 * M_PI * (t - onset) / 7.3 - 0.5);
+
+        long opened = -1, closed = -1, expected = -1;
+        int ncrossings = 0;
+        size_t t = 0;
+        while (t + 2 < nsamples) {
+                size_t size = min(nsamples - t, period_size / 2 + rand() % (3 * period_size));
+                for (size_t i = 1; i < size && expected < 0; ++i) {
+                        if (x[t+i-1] < 0.1f && x[t+i] >= 0.1f && ++ncrossings == ocount + 1)
+                                expected = t + i;
+                }
+                int offset = trigger.push(&x[t], size);
+                if (offset >= 0 && opened < 0) {
+                        opened = t + offset;
+                        // detection can lag the crossing by up to a period
+                        assert(expected >= 0 && expected <= opened);
+                        assert(opened == max(expected, long(t)));
+                        assert(opened - expected < long(2 * period_size));
+                }
+                else if (offset >= 0) {
+                        closed = t + offset;
+                        assert(closed > long(onset + duration));
+                        assert(closed - long(onset + duration) < long(10 * period_size));
+                }
+                t += size;
+        }
+        assert(opened >= 0 && closed > opened);
+        assert(!trigger.open());
+}
+
 int main(int, char**)
 {
 
         test_counter(10);
+        test_counter(16);
+        test_static_counter<1>();
+        test_static_counter<10>();
+        test_static_counter<16>();
+        test_multi_counter();
+        cout << "running_counter ok" << endl;
+        test_count_crossings();
+        cout << "count_crossings (" << dsp::crossings_isa() << ") ok" << endl;
+        test_crossing_counter(0.1f, 1, 10, 100);
+        test_crossing_counter(0.1f, 16, 10, 200);
+        test_crossing_counter(0.0f, 64, 4, 200);
+        test_crossing_counter(0.2f, 100, 20, 200);
+        cout << "crossing_counter ok" << endl;
+        test_trigger_bank(1, 64, 200);
+        test_trigger_bank(5, 16, 400);
+        cout << "crossing_trigger_bank ok" << endl;
+        for (size_t i = 0; i < 50; ++i) {
+                test_trigger_timing(32, 1000 + rand() % 1000, 2000);
+                test_trigger_timing(64, 1000 + rand() % 1000, 5000);
+                test_trigger_timing(100, 2000 + rand() % 1000, 3000);
+        }
+        cout << "crossing_trigger timing ok" << endl;
 
 }
 
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "jill/digital_filter.hh"
+#include "jill/dsp/polyphase_decimator.hh"
+#include "jill/dsp/block_ringbuffer.hh"
+
+using namespace std;
+using namespace jill;
+
+const nframes_t fs = 48000;
+
+vector<sample_t>
+noise(size_t n)
+{
+        vector<sample_t> x(n);
+        for (size_t i = 0; i < n; ++i)
+                x[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        return x;
+}
+
+/* magnitude of the frequency response of an FIR filter at frequency f */
+double
+gain(vector<double> const & taps, double f)
+{
+        double re = 0, im = 0;
+        for (size_t i = 0; i < taps.size(); ++i) {
+                re += taps[i] * cos(2 * M_PI * f * i / fs);
+                im -= taps[i] * sin(2 * M_PI * f * i / fs);
+        }
+        return sqrt(re * re + im * im);
+}
+
+/* the windowed-sinc design has unit gain in the pass band and attenuates the stop band */
+void test_firwin(char const * window, double ripple, double min_atten_db)
+{
+        digital_filter f;
+        f.firwin(129, 4000, fs, window);
+        vector<double> const & taps = f.coef_in();
+        assert(taps.size() == 129);
+        for (size_t i = 0; i < taps.size(); ++i)
+                assert(fabs(taps[i] - taps[taps.size() - 1 - i]) < 1e-12);
+        assert(fabs(gain(taps, 0) - 1.0) < 1e-9);
+        assert(fabs(gain(taps, 1000) - 1.0) < ripple);
+        assert(20 * log10(gain(taps, 8000)) < -min_atten_db);
+}
+
+/* same output as filtering at the full rate and keeping every Mth sample */
+void test_decimator(nframes_t factor, size_t ntaps, nframes_t period, nframes_t max_period)
+{
+        digital_filter reference;
+        reference.firwin(ntaps, 0.4 * fs / factor, fs);
+        dsp::polyphase_decimator dec(factor, reference.coef_in(), max_period);
+        assert(dec.factor() == factor);
+        assert(dec.ntaps() == ntaps);
+        dsp::polyphase_decimator::channel_t c0 = dec.add_channel();
+        dsp::polyphase_decimator::channel_t c1 = dec.add_channel();
+        digital_filter::channel_t rc = reference.add_channel();
+
+        const size_t nsamples = period * 17;
+        vector<sample_t> in = noise(nsamples), filtered(nsamples);
+        reference.filter_buf(&in[0], &filtered[0], rc, nsamples);
+
+        vector<sample_t> out0, out1, buf(dec.max_output(period));
+        for (size_t i = 0; i < nsamples; i += period) {
+                nframes_t offset;
+                nframes_t n = dec.process(&in[i], &buf[0], c0, period, &offset);
+                assert(n <= dec.max_output(period));
+                // the offset locates the first output in the input block
+                assert((i + offset) % factor == 0);
+                assert(n == 0 || (i + offset) / factor == out0.size());
+                out0.insert(out0.end(), buf.begin(), buf.begin() + n);
+                n = dec.process(&in[i], &buf[0], c1, period);
+                out1.insert(out1.end(), buf.begin(), buf.begin() + n);
+        }
+        assert(out0 == out1);
+        assert(out0.size() == (nsamples + factor - 1) / factor);
+        for (size_t i = 0; i < out0.size(); ++i)
+                assert(fabs(out0[i] - filtered[i * factor]) < 1e-5);
+
+        // after a reset the output repeats
+        dec.reset();
+        vector<sample_t> again(dec.max_output(period));
+        nframes_t n = dec.process(&in[0], &again[0], c1, period);
+        assert(equal(again.begin(), again.begin() + n, out0.begin()));
+}
+
+/* blocks record the decimation factor and span the right number of frames */
+void test_ringbuffer()
+{
+        dsp::block_ringbuffer buf(4096);
+        vector<sample_t> data(32, 1.0f);
+        assert(buf.push(100, SAMPLED, "pcm_000", 32 * sizeof(sample_t), &data[0], 4));
+        assert(buf.push(228, SAMPLED, "pcm_001", 32 * sizeof(sample_t), &data[0]));
+        assert(buf.push(230, EVENT, "evt_000", 3, "abc"));
+
+        data_block_t const * b = buf.peek();
+        assert(b && b->decimation == 4 && b->nframes() == 32 && b->duration() == 128);
+        assert(b->id() == "pcm_000");
+        buf.release();
+        b = buf.peek();
+        assert(b && b->decimation == 1 && b->duration() == 32);
+        buf.release();
+        b = buf.peek();
+        assert(b && b->dtype == EVENT && b->duration() == 1);
+        buf.release();
+        assert(buf.peek() == 0);
+}
+
+int main(int, char**)
+{
+        srand(1);
+        test_firwin("hamming", 0.01, 40);
+        test_firwin("hann", 0.01, 40);
+        test_firwin("blackman", 0.01, 70);
+        test_firwin("rectangular", 0.1, 15);
+        cout << "firwin ok" << endl;
+
+        test_decimator(1, 17, 64, 64);
+        test_decimator(2, 33, 64, 64);
+        test_decimator(4, 65, 128, 128);
+        test_decimator(3, 49, 64, 64);
+        test_decimator(5, 81, 100, 64);
+        test_decimator(8, 257, 128, 32);
+        cout << "decimator ok" << endl;
+
+        test_ringbuffer();
+        cout << "ringbuffer ok" << endl;
+}
@@ -0,0 +1,215 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <string>
+
+#include "jill/digital_filter.hh"
+
+using namespace std;
+using namespace jill;
+
+typedef digital_filter::sample_t sample_t;
+typedef digital_filter::COEF_t COEF_t;
+
+typedef digital_filter::nframes_t nframes_t;
+
+static const nframes_t fs = 20000;
+static const nframes_t period = 256;
+
+vector<COEF_t>
+cutoffs(string const & type)
+{
+        vector<COEF_t> Wc(1, 1000);
+        if (type == "band-pass" || type == "band-stop")
+                Wc.push_back(3000);
+        return Wc;
+}
+
+vector<sample_t>
+noise(size_t n)
+{
+        vector<sample_t> x(n);
+        srand(1);
+        for (size_t i = 0; i < n; ++i)
+                x[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        return x;
+}
+
+vector<sample_t>
+run(digital_filter & filter, vector<sample_t> const & in, nframes_t nframes=period,
+    digital_filter::channel_t channel=0)
+{
+        vector<sample_t> out(in.size());
+        if (filter.nchannels() <= channel)
+                filter.add_channel();
+        for (size_t i = 0; i < in.size(); i += nframes)
+                filter.filter_buf(&in[i], &out[i], channel, nframes);
+        return out;
+}
+
+/* second-order sections should give the same output as the direct form */
+void test_sos_matches_direct(int order, string const & type)
+{
+        digital_filter sos, direct;
+        sos.butter(order, cutoffs(type), type, fs);
+        assert(sos.is_sos());
+        assert(sos.sections().size() == size_t((type == "low-pass" || type == "high-pass") ?
+                                               (order + 1) / 2 : order));
+        direct.custom_coef(sos.coef_in(), sos.coef_out());
+        assert(!direct.is_sos());
+
+        vector<sample_t> in = noise(period * 40);
+        vector<sample_t> a = run(sos, in);
+        vector<sample_t> b = run(direct, in);
+        for (size_t i = 0; i < in.size(); ++i)
+                assert(fabs(a[i] - b[i]) < 1e-3);
+}
+
+/* check the gain at DC from the step response */
+void test_dc_gain(int order, string const & type, double expected)
+{
+        digital_filter filter;
+        filter.butter(order, cutoffs(type), type, fs);
+        vector<sample_t> in(period * 40, 1.0f);
+        vector<sample_t> out = run(filter, in);
+        assert(fabs(out.back() - expected) < 1e-4);
+}
+
+/* high order filters are stable with second-order sections */
+void test_stable(int order)
+{
+        digital_filter filter;
+        vector<COEF_t> Wc(1, 100);
+        filter.butter(order, Wc, "low-pass", fs);
+        vector<sample_t> in = noise(period * 100);
+        vector<sample_t> out = run(filter, in);
+        for (size_t i = 0; i < out.size(); ++i)
+                assert(fabs(out[i]) < 2.0);
+}
+
+/* periods can be longer than the old 10000-sample limit */
+void test_long_period(bool sos)
+{
+        digital_filter a, b;
+        a.butter(4, cutoffs("band-pass"), "band-pass", fs);
+        if (!sos)
+                a.custom_coef(a.coef_in(), a.coef_out());
+        b.custom_coef(a.coef_in(), a.coef_out());
+        assert(a.is_sos() == sos);
+        vector<sample_t> in = noise(period * 100);
+        vector<sample_t> x = run(a, in, in.size());
+        vector<sample_t> y = run(b, in, period);
+        for (size_t i = 0; i < in.size(); ++i)
+                assert(fabs(x[i] - y[i]) < 1e-4);
+}
+
+/* channels have independent state, and can be reset individually */
+void test_channels()
+{
+        digital_filter filter;
+        digital_filter::channel_t c0 = filter.add_channel();
+        digital_filter::channel_t c1 = filter.add_channel();
+        assert(c0 == 0 && c1 == 1 && filter.nchannels() == 2);
+        // changing the coefficients keeps the handles
+        filter.butter(4, cutoffs("low-pass"), "low-pass", fs);
+        assert(filter.nchannels() == 2);
+        assert(filter.state_len() == 4);
+
+        vector<sample_t> in = noise(period);
+        vector<sample_t> zeros(period, 0), y0(period), y1(period), y2(period);
+        filter.filter_buf(&in[0], &y0[0], c0, period);
+        filter.filter_buf(&zeros[0], &y1[0], c1, period);
+        assert(y1 == zeros);
+
+        filter.reset(c1);
+        filter.filter_buf(&in[0], &y1[0], c1, period);
+        assert(y0 == y1);
+        // channel 0 still has state, channel 1 doesn't after a reset
+        filter.reset(c1);
+        filter.filter_buf(&in[0], &y1[0], c1, period);
+        filter.filter_buf(&in[0], &y2[0], c0, period);
+        assert(y1 == y0 && y2 != y0);
+        filter.reset();
+        filter.filter_buf(&in[0], &y2[0], c0, period);
+        assert(y2 == y0);
+}
+
+/* coefficients published with hot swaps take effect at the next update */
+void test_hot_swap()
+{
+        vector<sample_t> in = noise(period * 4), out(period), ref(period);
+        digital_filter filter, reference;
+        digital_filter::channel_t c0 = filter.add_channel();
+        digital_filter::channel_t c1 = filter.add_channel();
+        reference.add_channel();
+        filter.butter(4, cutoffs("low-pass"), "low-pass", fs);
+        reference.butter(4, cutoffs("low-pass"), "low-pass", fs);
+        filter.enable_hot_swap();
+        assert(!filter.update());
+
+        // the state is carried over when the structure doesn't change
+        filter.butter(4, cutoffs("low-pass"), "low-pass", fs);
+        assert(filter.swap_pending());
+        filter.filter_buf(&in[0], &out[0], c0, period);
+        reference.filter_buf(&in[0], &ref[0], 0, period);
+        assert(out == ref);
+        assert(filter.update());
+        assert(!filter.swap_pending());
+        filter.filter_buf(&in[period], &out[0], c0, period);
+        reference.filter_buf(&in[period], &ref[0], 0, period);
+        assert(out == ref);
+
+        // only the last of several changes is used; new structure starts from zero
+        filter.butter(2, cutoffs("high-pass"), "high-pass", fs);
+        filter.butter(3, cutoffs("band-pass"), "band-pass", fs);
+        reference.butter(3, cutoffs("band-pass"), "band-pass", fs);
+        assert(filter.update());
+        filter.filter_buf(&in[0], &out[0], c1, period);
+        reference.filter_buf(&in[0], &ref[0], 0, period);
+        assert(out == ref);
+        assert(filter.state_len() == 6);
+        filter.collect();
+}
+
+/* with a crossfade, the output ramps from the old filter to the new one */
+void test_crossfade()
+{
+        const nframes_t crossfade = period + period / 2;
+        vector<sample_t> in(period, 1.0f), out(period);
+        digital_filter filter;
+        filter.add_channel();
+        filter.custom_coef(vector<COEF_t>(1, 1.0), vector<COEF_t>());
+        filter.enable_hot_swap(crossfade);
+        filter.custom_coef(vector<COEF_t>(1, 0.0), vector<COEF_t>());
+        assert(filter.update());
+        for (nframes_t i = 0; i < 3 * period; i += period) {
+                filter.update();
+                filter.filter_buf(&in[0], &out[0], 0, period);
+                for (nframes_t j = 0; j < period; ++j) {
+                        double expected = (i + j < crossfade) ? 1.0 - double(i + j) / crossfade : 0.0;
+                        assert(fabs(out[j] - expected) < 1e-6);
+                }
+        }
+}
+
+int main(int, char**)
+{
+        char const * types[] = { "low-pass", "high-pass", "band-pass", "band-stop" };
+        for (int t = 0; t < 4; ++t) {
+                for (int order = 1; order <= 4; ++order)
+                        test_sos_matches_direct(order, types[t]);
+        }
+        test_dc_gain(4, "low-pass", 1.0);
+        test_dc_gain(5, "low-pass", 1.0);
+        test_dc_gain(4, "high-pass", 0.0);
+        test_dc_gain(4, "band-pass", 0.0);
+        test_dc_gain(4, "band-stop", 1.0);
+        test_stable(12);
+        test_long_period(true);
+        test_long_period(false);
+        test_channels();
+        test_hot_swap();
+        test_crossfade();
+}
@@ -0,0 +1,168 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <complex>
+
+#include "jill/digital_filter.hh"
+#include "jill/dsp/fft.hh"
+#include "jill/dsp/fft_convolver.hh"
+
+using namespace std;
+using namespace jill;
+
+typedef dsp::fft::value_type value_type;
+typedef dsp::fft::complex_type complex_type;
+
+vector<value_type>
+random_taps(size_t n)
+{
+        vector<value_type> taps(n);
+        for (size_t i = 0; i < n; ++i)
+                taps[i] = (2.0 * rand() / RAND_MAX - 1.0) / n;
+        return taps;
+}
+
+vector<sample_t>
+noise(size_t n)
+{
+        vector<sample_t> x(n);
+        for (size_t i = 0; i < n; ++i)
+                x[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        return x;
+}
+
+/* compare with a direct DFT, and check the round trip */
+void test_fft(size_t n)
+{
+        dsp::fft fft(n);
+        assert(fft.nbins() == n / 2 + 1);
+        vector<value_type> x(n), y(n);
+        for (size_t i = 0; i < n; ++i)
+                x[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        vector<complex_type> X(fft.nbins());
+        fft.forward(&x[0], &X[0]);
+        for (size_t k = 0; k < fft.nbins(); ++k) {
+                complex_type expected = 0;
+                for (size_t i = 0; i < n; ++i)
+                        expected += x[i] * polar(1.0, -2 * M_PI * k * i / n);
+                assert(abs(X[k] - expected) < 1e-9 * n);
+        }
+        fft.inverse(&X[0], &y[0]);
+        for (size_t i = 0; i < n; ++i)
+                assert(fabs(x[i] - y[i]) < 1e-12);
+}
+
+/* the convolver gives the same output as direct convolution */
+void test_convolver(size_t ntaps, nframes_t block_size, nframes_t period)
+{
+        vector<value_type> taps = random_taps(ntaps);
+        dsp::fft_convolver conv(taps, block_size);
+        assert(conv.npartitions() == max<size_t>((ntaps + block_size - 1) / block_size, 1));
+        dsp::fft_convolver::channel_t c0 = conv.add_channel();
+        dsp::fft_convolver::channel_t c1 = conv.add_channel();
+
+        const size_t nsamples = period * 12;
+        vector<sample_t> in = noise(nsamples), out0(nsamples), out1(nsamples);
+        for (size_t i = 0; i < nsamples; i += period) {
+                conv.process(&in[i], &out0[i], c0, period);
+                conv.process(&in[i], &out1[i], c1, period);
+        }
+        assert(out0 == out1);
+        for (size_t n = 0; n < nsamples; ++n) {
+                double expected = 0;
+                for (size_t i = 0; i < ntaps && i <= n; ++i)
+                        expected += taps[i] * in[n - i];
+                assert(fabs(out0[n] - expected) < 1e-5);
+        }
+
+        // after a reset the output repeats
+        vector<sample_t> again(period);
+        conv.reset(c1);
+        conv.process(&in[0], &again[0], c1, period);
+        assert(equal(again.begin(), again.end(), out0.begin()));
+}
+
+/* digital_filter switches to FFT convolution for long FIR filters */
+void test_digital_filter(size_t ntaps)
+{
+        const nframes_t period = 128;
+        vector<value_type> taps = random_taps(ntaps);
+        digital_filter fft_filter, direct;
+        fft_filter.add_channel();
+        direct.add_channel();
+        fft_filter.set_fft_threshold(100);
+        fft_filter.custom_coef(taps, vector<value_type>());
+        assert(!fft_filter.is_fft());
+        fft_filter.set_period_size(period);
+        assert(fft_filter.is_fft() == (ntaps >= 100));
+
+        direct.set_fft_threshold(0);
+        direct.set_period_size(period);
+        direct.custom_coef(taps, vector<value_type>(1, 1.0));
+        assert(!direct.is_fft());
+
+        vector<sample_t> in = noise(period * 20), a(in.size()), b(in.size());
+        for (size_t i = 0; i < in.size(); i += period) {
+                fft_filter.filter_buf(&in[i], &a[i], 0, period);
+                direct.filter_buf(&in[i], &b[i], 0, period);
+        }
+        for (size_t i = 0; i < in.size(); ++i)
+                assert(fabs(a[i] - b[i]) < 1e-5);
+}
+
+/*
+ * blocks that aren't a multiple of the period are filtered in the direct
+ * form, starting from zero state, and the convolver starts over afterwards
+ */
+void test_partial_blocks(size_t ntaps)
+{
+        const nframes_t period = 128;
+        vector<value_type> taps = random_taps(ntaps);
+        digital_filter fft_filter, direct;
+        fft_filter.add_channel();
+        direct.add_channel();
+        fft_filter.set_fft_threshold(100);
+        fft_filter.set_period_size(period);
+        fft_filter.custom_coef(taps, vector<value_type>());
+        assert(fft_filter.is_fft());
+        direct.set_fft_threshold(0);
+        direct.custom_coef(taps, vector<value_type>(1, 1.0));
+
+        vector<sample_t> in = noise(period * 4), a(in.size()), b(in.size());
+        fft_filter.filter_buf(&in[0], &a[0], 0, period);
+        fft_filter.filter_buf(&in[period], &a[period], 0, 100);
+        fft_filter.filter_buf(&in[2 * period], &a[2 * period], 0, 2 * period);
+        // each segment matches a filter that starts from zero state
+        direct.filter_buf(&in[0], &b[0], 0, period);
+        direct.reset();
+        direct.filter_buf(&in[period], &b[period], 0, 100);
+        direct.reset();
+        direct.filter_buf(&in[2 * period], &b[2 * period], 0, 2 * period);
+        for (size_t i = 0; i < in.size(); ++i)
+                assert(fabs(a[i] - b[i]) < 1e-5);
+}
+
+int main(int, char**)
+{
+        srand(1);
+        test_fft(4);
+        test_fft(8);
+        test_fft(64);
+        test_fft(1024);
+        cout << "fft (" << dsp::fft::implementation() << ") ok" << endl;
+
+        test_convolver(1, 64, 64);
+        test_convolver(64, 64, 64);
+        test_convolver(100, 64, 64);
+        test_convolver(1000, 256, 256);
+        test_convolver(1025, 256, 1024);
+        test_convolver(3000, 1024, 1024);
+        cout << "convolver ok" << endl;
+
+        test_digital_filter(50);
+        test_digital_filter(500);
+        test_partial_blocks(500);
+        cout << "digital_filter ok" << endl;
+}
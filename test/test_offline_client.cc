@@ -0,0 +1,130 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <boost/bind.hpp>
+
+#include "jill/offline_client.hh"
+#include "jill/dsp/crossing_trigger.hh"
+
+using namespace std;
+using namespace jill;
+
+static const nframes_t sampling_rate = 20000;
+static const nframes_t period_size = 128;
+
+/* checks the clock and copies the input to the output */
+int
+copy_process(offline_client * client, nframes_t nframes, nframes_t time, nframes_t * expected)
+{
+        assert(nframes == period_size);
+        assert(time == *expected);
+        assert(client->frame() == time);
+        assert(client->time() == client->time(time));
+        sample_t * out = client->samples("out");
+        for (nframes_t i = 0; i < nframes; ++i)
+                assert(out[i] == 0);
+        copy(client->samples(0), client->samples(0) + nframes, out);
+        *expected += nframes;
+        return 0;
+}
+
+/* stops after a number of periods */
+int
+stop_process(offline_client *, nframes_t, nframes_t, int * remaining)
+{
+        return --(*remaining) <= 0;
+}
+
+/* stores input samples */
+int
+store_process(offline_client * client, nframes_t nframes, nframes_t, vector<sample_t> * store)
+{
+        store->insert(store->end(), client->samples(0), client->samples(0) + nframes);
+        return 0;
+}
+
+/* counts gate openings and closings */
+int
+trigger_process(offline_client * client, nframes_t nframes, nframes_t,
+                dsp::crossing_trigger<sample_t> * trigger, int * changes)
+{
+        if (trigger->push(client->samples(0), nframes) > -1)
+                *changes += 1;
+        return 0;
+}
+
+void test_clock()
+{
+        offline_client client("test", sampling_rate, period_size);
+        assert(client.sampling_rate() == sampling_rate);
+        assert(client.buffer_size() == period_size);
+        assert(client.frame() == 0);
+        assert(client.time(sampling_rate) == 1000000);
+        assert(client.frame(utime_t(1000000)) == sampling_rate);
+
+        client.add_input("in", offline::sine(sampling_rate, 1000, 0.5));
+        client.add_output("out");
+        assert(client.nchannels() == 2);
+        assert(client.is_input(0) && !client.is_input(1));
+        assert(client.samples("nonexistent") == 0);
+
+        nframes_t expected = 0;
+        client.set_process_callback(boost::bind(copy_process, _1, _2, _3, &expected));
+        assert(client.run(100) == 100);
+        assert(client.frame() == 100 * period_size);
+        assert(expected == client.frame());
+        // the last period of output contains the sine wave
+        sample_t * out = client.samples(1);
+        for (nframes_t i = 0; i < period_size; ++i) {
+                double t = 99 * period_size + i;
+                assert(fabs(out[i] - 0.5 * sin(2 * M_PI * 1000 * t / sampling_rate)) < 1e-5);
+        }
+
+        int remaining = 5;
+        client.set_process_callback(boost::bind(stop_process, _1, _2, _3, &remaining));
+        assert(client.run(100) == 5);
+        assert(client.frame() == 105 * period_size);
+}
+
+void test_deterministic()
+{
+        vector<sample_t> a, b;
+        {
+                offline_client client("a", sampling_rate, period_size);
+                client.add_input("in", offline::noise(1.0, 1234));
+                client.set_process_callback(boost::bind(store_process, _1, _2, _3, &a));
+                client.run(50);
+        }
+        {
+                offline_client client("b", sampling_rate, period_size);
+                client.add_input("in", offline::noise(1.0, 1234));
+                client.set_process_callback(boost::bind(store_process, _1, _2, _3, &b));
+                client.run(50);
+        }
+        assert(a.size() == 50 * period_size);
+        assert(a == b);
+        for (size_t i = 0; i < a.size(); ++i)
+                assert(a[i] >= -1.0 && a[i] < 1.0);
+}
+
+void test_bursts()
+{
+        // 1 s of data, with 100 ms bursts every 250 ms
+        offline_client client("bursts", sampling_rate, period_size);
+        client.add_input("in", offline::bursts(sampling_rate, 2000, 0.5,
+                                               sampling_rate / 10, sampling_rate * 3 / 20));
+        dsp::crossing_trigger<sample_t> trigger(0.2, 20, 4, 0.1, 5, 10, period_size);
+        int changes = 0;
+        client.set_process_callback(boost::bind(trigger_process, _1, _2, _3, &trigger, &changes));
+        client.run(sampling_rate / period_size);
+        // four bursts, each opening and closing the gate
+        assert(changes == 8);
+}
+
+int main(int, char**)
+{
+        test_clock();
+        test_deterministic();
+        test_bursts();
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <pthread.h>
+
+#include "jill/rt_logger.hh"
+
+using namespace std;
+using namespace jill;
+
+rt_logger::record_t
+make_record(char const * fmt, rt_arg const * args, size_t nargs)
+{
+        rt_logger::record_t rec;
+        rec.time = 0;
+        rec.fmt = fmt;
+        rec.nargs = nargs;
+        for (size_t i = 0; i < nargs; ++i) {
+                rec.types[i] = args[i].type;
+                rec.values[i] = args[i].value;
+        }
+        return rec;
+}
+
+void test_format()
+{
+        rt_arg args[] = { -7, 42u, 0.5, "stim" };
+        assert(rt_logger::format(make_record("no arguments", args, 0)) == "no arguments");
+        assert(rt_logger::format(make_record("x={}", args, 1)) == "x=-7");
+        assert(rt_logger::format(make_record("{}, {}, {}, {}", args, 4)) == "-7, 42, 0.5, stim");
+        // extra placeholders are left alone
+        assert(rt_logger::format(make_record("{} {}", args, 1)) == "-7 {}");
+        // extra arguments are ignored
+        assert(rt_logger::format(make_record("{}", args, 2)) == "-7");
+}
+
+/*
+ * Overfilling the ring drops the messages that don't fit. The background
+ * thread may empty the ring while it's being filled, so this is retried
+ * until it happens without interruption.
+ */
+void test_log(size_t capacity)
+{
+        rt_logger & logger = rt_logger::instance();
+        logger.register_thread(capacity);
+        const size_t size = logger.capacity();
+        assert(size >= capacity);
+        const size_t nmessages = size * 10;
+        bool tested = false;
+        for (int attempt = 0; attempt < 10 && !tested; ++attempt) {
+                logger.flush();
+                unsigned long written = logger.written();
+                unsigned long dropped = logger.dropped();
+                for (size_t i = 0; i < nmessages; ++i) {
+                        RTLOG("test message {} of {}", i, nmessages);
+                }
+                if (logger.written() != written) continue;
+                assert(logger.dropped() - dropped == nmessages - size);
+                logger.flush();
+                assert(logger.written() - written == size);
+                tested = true;
+        }
+        assert(tested);
+        RTLOG("after flush: {}", "ok");
+        logger.flush();
+}
+
+void * log_unregistered(void *)
+{
+        RTLOG("from an unregistered thread");
+        return 0;
+}
+
+/* messages from unregistered threads are dropped */
+void test_unregistered()
+{
+        rt_logger & logger = rt_logger::instance();
+        logger.flush();
+        unsigned long written = logger.written();
+        unsigned long dropped = logger.dropped();
+        pthread_t id;
+        assert(pthread_create(&id, 0, log_unregistered, 0) == 0);
+        pthread_join(id, 0);
+        logger.flush();
+        assert(logger.dropped() - dropped == 1);
+        assert(logger.written() == written);
+}
+
+int main(int, char**)
+{
+        test_format();
+        test_log(16);
+        test_unregistered();
+        cout << "rt_logger ok" << endl;
+}
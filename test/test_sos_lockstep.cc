@@ -0,0 +1,107 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <string>
+
+#include "jill/digital_filter.hh"
+#include "jill/dsp/sos_lockstep.hh"
+
+using namespace std;
+using namespace jill;
+using dsp::sos_lockstep;
+
+typedef digital_filter::COEF_t COEF_t;
+
+static const nframes_t fs = 20000;
+// not a multiple of the chunk size used by the kernel
+static const nframes_t period = 300;
+static const size_t nperiods = 20;
+
+/* lockstep filtering should match filtering each channel with digital_filter */
+void test_matches_digital_filter(sos_lockstep::isa_type isa, size_t nchannels)
+{
+        digital_filter ref;
+        vector<COEF_t> Wc(1, 500);
+        Wc.push_back(3000);
+        ref.butter(4, Wc, "band-pass", fs);
+        for (size_t c = 0; c < nchannels; ++c)
+                ref.add_channel();
+        sos_lockstep filter(ref.sections(), nchannels, isa);
+        assert(filter.isa() == isa);
+        assert(filter.nchannels() == nchannels);
+
+        srand(nchannels);
+        vector<vector<sample_t> > in(nchannels, vector<sample_t>(period * nperiods));
+        vector<vector<sample_t> > a(in), b(in);
+        for (size_t c = 0; c < nchannels; ++c) {
+                for (size_t i = 0; i < in[c].size(); ++i)
+                        in[c][i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        }
+        vector<sample_t const *> pin(nchannels);
+        vector<sample_t *> pout(nchannels);
+        for (size_t p = 0; p < nperiods; ++p) {
+                size_t offset = p * period;
+                for (size_t c = 0; c < nchannels; ++c) {
+                        ref.filter_buf(&in[c][offset], &a[c][offset], c, period);
+                        pin[c] = &in[c][offset];
+                        pout[c] = &b[c][offset];
+                }
+                filter.process(&pin[0], &pout[0], period);
+        }
+        for (size_t c = 0; c < nchannels; ++c) {
+                for (size_t i = 0; i < a[c].size(); ++i)
+                        assert(fabs(a[c][i] - b[c][i]) < 1e-5);
+        }
+}
+
+/* null inputs are zero, null outputs are skipped, and filtering can be in place */
+void test_pointers(sos_lockstep::isa_type isa)
+{
+        digital_filter ref;
+        ref.butter(2, vector<COEF_t>(1, 1000), "high-pass", fs);
+        const size_t nchannels = 19;
+        sos_lockstep filter(ref.sections(), nchannels, isa);
+
+        vector<vector<sample_t> > buf(nchannels, vector<sample_t>(period, 1.0f));
+        vector<sample_t const *> pin(nchannels);
+        vector<sample_t *> pout(nchannels);
+        for (size_t c = 0; c < nchannels; ++c) {
+                pin[c] = (c % 3 == 0) ? 0 : &buf[c][0];
+                pout[c] = (c % 5 == 0) ? 0 : &buf[c][0];
+        }
+        filter.process(&pin[0], &pout[0], period);
+        for (size_t c = 0; c < nchannels; ++c) {
+                if (pout[c] == 0)
+                        assert(buf[c][0] == 1.0f);
+                else if (pin[c] == 0)
+                        assert(buf[c][0] == 0 && buf[c][period - 1] == 0);
+                else
+                        // high-pass step response decays
+                        assert(buf[c][0] > 0.5f && fabs(buf[c][period - 1]) < 1e-3);
+        }
+
+        // after a reset the filter gives the same output for the same input
+        vector<sample_t> x(period, 1.0f), y1(period), y2(period);
+        vector<sample_t const *> xin(nchannels, &x[0]);
+        vector<sample_t *> yout(nchannels, &y1[0]);
+        filter.reset();
+        filter.process(&xin[0], &yout[0], period);
+        yout.assign(nchannels, &y2[0]);
+        filter.reset();
+        filter.process(&xin[0], &yout[0], period);
+        assert(y1 == y2);
+}
+
+int main(int, char**)
+{
+        size_t const nchannels[] = { 1, 3, 4, 5, 16, 21, 64 };
+        sos_lockstep::isa_type best = sos_lockstep::best_isa();
+        for (int isa = sos_lockstep::SCALAR; isa <= best; ++isa) {
+                cout << "testing " << sos_lockstep::isa_name(sos_lockstep::isa_type(isa)) << endl;
+                for (size_t i = 0; i < sizeof(nchannels) / sizeof(size_t); ++i)
+                        test_matches_digital_filter(sos_lockstep::isa_type(isa), nchannels[i]);
+                test_pointers(sos_lockstep::isa_type(isa));
+        }
+}
@@ -0,0 +1,186 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <stdexcept>
+#include <time.h>
+
+#include "jill/dsp/spectral_trigger.hh"
+
+using namespace std;
+using namespace jill;
+
+static const nframes_t fs = 48000;
+static const size_t nfft = 512;
+static const size_t hop = 256;
+
+float
+uniform()
+{
+        return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+/*
+ * noise with an RMS amplitude of noise, and a tone burst starting at onset.
+ * The noise is white or lowpass filtered (like cage noise).
+ */
+vector<sample_t>
+signal(size_t nsamples, size_t onset, size_t duration, double freq, float noise, float tone,
+       bool white)
+{
+        vector<sample_t> x(nsamples);
+        float s1 = 0, s2 = 0;
+        for (size_t i = 0; i < nsamples; ++i) {
+                if (white)
+                        x[i] = noise * 1.73f * uniform();
+                else {
+                        // two-pole lowpass with a corner around 200 Hz
+                        s1 = 0.97f * s1 + 0.03f * uniform();
+                        s2 = 0.97f * s2 + 0.03f * s1;
+                        x[i] = noise * 14 * s2;
+                }
+                if (i >= onset && i < onset + duration)
+                        x[i] += tone * sin(2 * M_PI * freq * (i - onset) / fs);
+        }
+        return x;
+}
+
+void test_power_spectrum()
+{
+        vector<dsp::fft::complex_type> in(21);
+        for (size_t i = 0; i < in.size(); ++i)
+                in[i] = dsp::fft::complex_type(uniform(), uniform());
+        for (size_t n = 0; n <= in.size(); ++n) {
+                vector<double> out(n + 1, -1);
+                dsp::power_spectrum(&in[0], &out[0], n);
+                for (size_t k = 0; k < n; ++k)
+                        assert(fabs(out[k] - norm(in[k])) < 1e-12);
+                assert(out[n] == -1);
+        }
+}
+
+void test_arguments()
+{
+        dsp::spectral_trigger t(fs, nfft, hop, 1000, 8000, dsp::spectral_trigger::BAND_RATIO,
+                                0.5, 4, 0.2, 8);
+        assert(t.band_first() == 11);   // 1031 Hz
+        assert(t.band_last() == 85);    // 7969 Hz
+        assert(dsp::spectral_trigger::parse_statistic("entropy") == dsp::spectral_trigger::TONALITY);
+        bool thrown = false;
+        try { dsp::spectral_trigger::parse_statistic("loudness"); }
+        catch (std::invalid_argument const &) { thrown = true; }
+        assert(thrown);
+        thrown = false;
+        try { dsp::spectral_trigger(fs, nfft, nfft + 1, 1000, 8000,
+                                    dsp::spectral_trigger::BAND_RATIO, 0.5, 4, 0.2, 8); }
+        catch (std::invalid_argument const &) { thrown = true; }
+        assert(thrown);
+        thrown = false;
+        try { dsp::spectral_trigger(fs, nfft, hop, 1000, 1050,
+                                    dsp::spectral_trigger::BAND_RATIO, 0.5, 4, 0.2, 8); }
+        catch (std::invalid_argument const &) { thrown = true; }
+        assert(thrown);
+}
+
+/*
+ * The gate opens during the burst and closes after it. The open window has to
+ * fill with burst frames, so the delay is at most nfft + owindow * hop, and the
+ * gate closes within nfft + cwindow * hop of the end. The results don't depend
+ * on the block size.
+ */
+void test_detection(dsp::spectral_trigger::statistic_type stat, double othresh, double cthresh,
+                    float noise, float tone, bool white)
+{
+        const size_t owindow = 4, cwindow = 8;
+        const size_t onset = 20000 + rand() % 5000, duration = 24000;
+        vector<sample_t> x = signal(96000, onset, duration, 3000, noise, tone, white);
+
+        long opened = -1, closed = -1;
+        vector<long> reference;
+        for (int pass = 0; pass < 2; ++pass) {
+                dsp::spectral_trigger t(fs, nfft, hop, 1000, 8000, stat, othresh, owindow,
+                                        cthresh, cwindow, 0.001);
+                vector<sample_t> stats(x.size());
+                vector<long> changes;
+                size_t i = 0;
+                while (i < x.size()) {
+                        size_t size = min(x.size() - i, (pass == 0) ? 1024 : size_t(1 + rand() % 700));
+                        int offset = t.push(&x[i], size, &stats[i]);
+                        if (offset >= 0)
+                                changes.push_back(i + offset);
+                        i += size;
+                }
+                for (size_t j = 0; j < stats.size(); ++j)
+                        assert(stats[j] >= 0 && stats[j] <= 1);
+                if (pass == 0) {
+                        reference = changes;
+                        assert(changes.size() == 2);
+                        opened = changes[0];
+                        closed = changes[1];
+                        assert(!t.open());
+                }
+                else
+                        assert(changes == reference);
+        }
+        assert(opened > long(onset));
+        assert(opened <= long(onset + nfft + owindow * hop));
+        assert(closed > long(onset + duration));
+        assert(closed <= long(onset + duration + nfft + cwindow * hop));
+}
+
+/* the gate stays closed for noise and silence */
+void test_noise(dsp::spectral_trigger::statistic_type stat, double othresh, bool white)
+{
+        dsp::spectral_trigger t(fs, nfft, hop, 1000, 8000, stat, othresh, 4, 0.1, 8, 0.001);
+        vector<sample_t> x = signal(96256, 0, 0, 0, 0.5, 0, white);
+        for (size_t i = 0; i < x.size(); i += 1024)
+                assert(t.push(&x[i], 1024) < 0);
+        vector<sample_t> quiet(1024, 0.0f);
+        for (size_t i = 0; i < 100; ++i)
+                assert(t.push(&quiet[0], 1024) < 0);
+        assert(t.last_statistic() == 0);
+}
+
+/* the processing time per sample, as a proportion of the period budget */
+void test_load(dsp::spectral_trigger::statistic_type stat, size_t nfft_, size_t hop_)
+{
+        const size_t period = 1024, nperiods = 2000;
+        dsp::spectral_trigger t(fs, nfft_, hop_, 1000, 8000, stat, 0.5, 4, 0.2, 8);
+        vector<sample_t> x = signal(period * 16, 0, period * 8, 3000, 0.1, 0.1, false);
+        timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (size_t p = 0; p < nperiods; ++p)
+                t.push(&x[(p % 16) * period], period);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+        double budget = double(nperiods) * period / fs;
+        cout << "  nfft=" << nfft_ << ", hop=" << hop_ << ", "
+             << ((stat == dsp::spectral_trigger::BAND_RATIO) ? "ratio" : "entropy")
+             << ": " << 1e9 * elapsed / (nperiods * period) << " ns/sample, load at 48 kHz = "
+             << 100 * elapsed / budget << "%" << endl;
+        assert(elapsed < budget);
+}
+
+int main(int, char**)
+{
+        srand(1);
+        test_power_spectrum();
+        test_arguments();
+        cout << "power spectrum ok" << endl;
+
+        for (int i = 0; i < 5; ++i) {
+                test_detection(dsp::spectral_trigger::BAND_RATIO, 0.5, 0.2, 0.1, 0.2, false);
+                test_detection(dsp::spectral_trigger::TONALITY, 0.3, 0.15, 0.05, 0.2, true);
+        }
+        cout << "detection ok" << endl;
+
+        test_noise(dsp::spectral_trigger::BAND_RATIO, 0.5, false);
+        test_noise(dsp::spectral_trigger::TONALITY, 0.3, true);
+        cout << "noise ok" << endl;
+
+        cout << "processing load (" << dsp::fft::implementation() << "):" << endl;
+        test_load(dsp::spectral_trigger::BAND_RATIO, 512, 256);
+        test_load(dsp::spectral_trigger::TONALITY, 512, 256);
+        test_load(dsp::spectral_trigger::TONALITY, 1024, 128);
+}
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <limits>
+
+#include "jill/dsp/crossings.hh"
+#include "jill/dsp/spike_detector.hh"
+
+using namespace std;
+using namespace jill;
+
+float
+uniform()
+{
+        return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+/* gaussian noise with standard deviation sigma (Box-Muller) */
+float
+noise(float sigma)
+{
+        double u1 = (rand() + 1.0) / (RAND_MAX + 2.0), u2 = double(rand()) / RAND_MAX;
+        return sigma * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/* the vector kernels give the same results as the scalar loop */
+void test_find_outside()
+{
+        const float inf = numeric_limits<float>::infinity();
+        float x[] = { 0, 0.5, -0.5, NAN, 2, -2 };
+        assert(dsp::find_outside(x, 6, -1.0f, 1.0f) == 4);
+        assert(dsp::find_outside(x, 6, -1.0f, inf) == 5);
+        assert(dsp::find_outside(x, 4, -1.0f, 1.0f) == 4);
+        assert(dsp::find_outside(x, 0, -1.0f, 1.0f) == 0);
+        vector<float> y(1003);
+        for (size_t i = 0; i < y.size(); ++i)
+                y[i] = uniform();
+        for (size_t trial = 0; trial < 200; ++trial) {
+                size_t offset = rand() % 20;
+                float lo = -1.0f + 0.01f * (rand() % 10), hi = 1.0f - 0.01f * (rand() % 10);
+                size_t a = dsp::find_outside<float>(&y[offset], y.size() - offset, lo, hi);
+                size_t b = dsp::find_outside(&y[offset], y.size() - offset, lo, hi);
+                assert(a == b);
+        }
+}
+
+/*
+ * Spikes with a known shape are added to noise at known times. Each one is
+ * detected once, with the peak at the right time and the right waveform,
+ * regardless of how the data are split into blocks. Spikes in the
+ * refractory period are ignored.
+ */
+void test_detection(dsp::spike_detector::polarity_type polarity, size_t nchannels,
+                    size_t max_period)
+{
+        const size_t nsamples = 200000, pre = 8, post = 24, align = 12, refractory = 30;
+        const float sigma = 0.05f;
+        const float shape[] = { -0.2f, -0.6f, -1.0f, -0.7f, -0.3f, 0.1f, 0.3f, 0.2f, 0.1f };
+        const size_t peak_offset = 2;
+        const float sign = (polarity == dsp::spike_detector::POSITIVE) ? -1.0f : 1.0f;
+
+        dsp::spike_detector detector(nchannels, max_period, 6.0, polarity, pre, post, align,
+                                     refractory, 2048, 4);
+        assert(detector.snippet_size() == pre + post);
+        for (size_t c = 0; c < nchannels; ++c)
+                assert(detector.threshold(c) == numeric_limits<float>::infinity());
+
+        vector<vector<float> > data(nchannels, vector<float>(nsamples));
+        vector<vector<long> > expected(nchannels);
+        for (size_t c = 0; c < nchannels; ++c) {
+                for (size_t i = 0; i < nsamples; ++i)
+                        data[c][i] = noise(sigma);
+                // spikes at irregular intervals, with some inside the
+                // refractory period of the previous one
+                long t = 20000 + 100 * c;
+                long last = -1000;
+                while (t < long(nsamples) - 100) {
+                        for (size_t j = 0; j < sizeof(shape) / sizeof(float); ++j)
+                                data[c][t + j] += sign * shape[j];
+                        long peak = t + peak_offset;
+                        if (peak - last >= long(refractory))
+                                expected[c].push_back(peak);
+                        last = (peak - last >= long(refractory)) ? peak : last;
+                        t += (rand() % 4 == 0) ? 20 : 200 + rand() % 2000;
+                }
+        }
+
+        vector<vector<long> > found(nchannels);
+        size_t i = 0;
+        while (i < nsamples) {
+                size_t size = min(nsamples - i, size_t(1 + rand() % max_period));
+                for (size_t c = 0; c < nchannels; ++c) {
+                        size_t n = detector.push(c, &data[c][i], size);
+                        dsp::spike_detector::spike_type const * spikes = detector.spikes(c);
+                        for (size_t k = 0; k < n; ++k) {
+                                assert(spikes[k].channel == c);
+                                assert(spikes[k].ready < size);
+                                long peak = long(i + spikes[k].ready) - long(spikes[k].lag);
+                                assert(k == 0 || spikes[k].ready >= spikes[k-1].ready);
+                                // waveform is aligned to the peak
+                                for (size_t j = 0; j < pre + post; ++j)
+                                        assert(spikes[k].waveform[j] == data[c][peak - pre + j]);
+                                found[c].push_back(peak);
+                        }
+                }
+                i += size;
+        }
+        for (size_t c = 0; c < nchannels; ++c) {
+                assert(fabs(detector.noise(c) - sigma) < 0.15 * sigma);
+                assert(found[c] == expected[c]);
+        }
+}
+
+/* no detections before the noise estimate, or in silence */
+void test_quiet()
+{
+        dsp::spike_detector detector(1, 256, 4.0, dsp::spike_detector::BOTH, 8, 24, 12, 30);
+        vector<float> x(256, 0.0f);
+        for (size_t i = 0; i < 100; ++i)
+                assert(detector.push(0, &x[0], x.size()) == 0);
+        assert(detector.noise(0) == 0);
+        x[100] = 1.0f;
+        assert(detector.push(0, &x[0], x.size()) == 0);
+}
+
+int main(int, char**)
+{
+        srand(1);
+        test_find_outside();
+        cout << "find_outside (" << dsp::crossings_isa() << ") ok" << endl;
+        test_quiet();
+        test_detection(dsp::spike_detector::NEGATIVE, 1, 64);
+        test_detection(dsp::spike_detector::NEGATIVE, 4, 1024);
+        test_detection(dsp::spike_detector::POSITIVE, 2, 256);
+        test_detection(dsp::spike_detector::BOTH, 3, 128);
+        cout << "spike_detector ok" << endl;
+}
@@ -0,0 +1,133 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "jill/util/readahead_stimqueue.hh"
+
+using namespace jill;
+using namespace std;
+
+/* an in-memory stimulus whose samples all equal its index */
+class test_stimulus : public stimulus_t {
+public:
+        test_stimulus(int index, nframes_t nframes)
+                : _index(index), _nframes(nframes) {
+                sprintf(_name, "stim_%d", index);
+        }
+        char const * name() const { return _name; }
+        nframes_t nframes() const { return _nframes; }
+        nframes_t samplerate() const { return 48000; }
+        sample_t const * buffer() const { return (_samples.empty()) ? 0 : &_samples[0]; }
+        void load_samples(nframes_t) {
+                if (!_samples.empty()) return;
+                // loading takes a variable amount of time
+                if (rand() % 4 == 0) usleep(50);
+                _samples.assign(_nframes, sample_t(_index));
+        }
+        int index() const { return _index; }
+private:
+        int _index;
+        nframes_t _nframes;
+        char _name[32];
+        std::vector<sample_t> _samples;
+};
+
+boost::ptr_vector<test_stimulus> _stimuli;
+
+/*
+ * Simulates a process callback playing stimuli shorter than the period with
+ * no gaps between them, so the queue has to supply several stimuli per
+ * period. Checks that the stimuli come out in order and that their samples
+ * are intact, and returns the number of periods where the queue was empty.
+ */
+size_t
+play(util::stimqueue & queue, vector<stimulus_t *> const & list, nframes_t period_size,
+     useconds_t period_us)
+{
+        size_t underruns = 0;
+        size_t next = 0;
+        nframes_t stim_offset = 0;
+        vector<sample_t> out(period_size);
+        while (next < list.size()) {
+                usleep(period_us);
+                nframes_t offset = 0;
+                while (offset < period_size && next < list.size()) {
+                        stimulus_t const * stim = queue.head();
+                        if (stim == 0) {
+                                underruns += 1;
+                                break;
+                        }
+                        assert(stim == list[next]);
+                        assert(queue.head() == stim);
+                        nframes_t n = std::min(stim->nframes() - stim_offset, period_size - offset);
+                        assert(stim->read(&out[offset], stim_offset, n) == n);
+                        for (nframes_t i = 0; i < n; ++i)
+                                assert(out[offset + i] == static_cast<test_stimulus const *>(stim)->index());
+                        offset += n;
+                        stim_offset += n;
+                        if (stim_offset == stim->nframes()) {
+                                queue.release();
+                                stim_offset = 0;
+                                next += 1;
+                        }
+                }
+        }
+        return underruns;
+}
+
+void
+test_back_to_back(size_t depth)
+{
+        const nframes_t period_size = 64;
+        vector<stimulus_t *> list;
+        for (size_t i = 0; i < 2000; ++i) {
+                // some stimuli repeat, and some are played twice in a row
+                size_t k = rand() % _stimuli.size();
+                list.push_back(&_stimuli[k]);
+                if (rand() % 10 == 0)
+                        list.push_back(&_stimuli[k]);
+        }
+        util::readahead_stimqueue queue(list.begin(), list.end(), 48000, false, depth);
+        assert(queue.depth() == depth);
+        // wait for the queue to fill up
+        while (queue.ready() < depth)
+                usleep(1000);
+        size_t underruns = play(queue, list, period_size, 1333);
+        cout << "depth " << depth << ": " << list.size() << " stimuli, "
+             << underruns << " underruns" << endl;
+        queue.join();
+        assert(queue.head() == 0);
+}
+
+/* a looping queue keeps going until it's stopped */
+void
+test_loop()
+{
+        vector<stimulus_t *> list;
+        for (size_t i = 0; i < 5; ++i)
+                list.push_back(&_stimuli[i]);
+        util::readahead_stimqueue queue(list.begin(), list.end(), 48000, true, 3);
+        vector<stimulus_t *> expected;
+        for (size_t i = 0; i < 23; ++i)
+                expected.push_back(list[i % list.size()]);
+        play(queue, expected, 64, 100);
+        queue.stop();
+        queue.join();
+}
+
+int
+main(int, char**)
+{
+        srand(1);
+        for (int i = 0; i < 50; ++i)
+                _stimuli.push_back(new test_stimulus(i, 1 + rand() % 48));
+        test_back_to_back(2);
+        test_back_to_back(16);
+        test_loop();
+        cout << "readahead_stimqueue ok" << endl;
+}
@@ -6,11 +6,16 @@
 
 #include <iostream>
 #include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lambda/lambda.hpp>
 #include <vector>
 #include <string>
 
 #include "jill/util/readahead_stimqueue.hh"
+#include "jill/util/load_stimuli.hh"
 #include "jill/file/stimfile.hh"
+#include "jill/file/stimstream.hh"
+#include "jill/file/stimcache.hh"
 
 size_t srates[] = {10000, 20000, 40000, 80000, 0};
 
@@ -43,6 +48,150 @@ test_stimfile(file::stimfile & f)
         }
 }
 
+/*
+ * The streamed samples match the loaded ones when read in blocks of random
+ * size, over repeated presentations, and after a presentation is cut short.
+ */
+void
+test_stimstream(char const * path)
+{
+        size_t i = 0;
+        do {
+                file::stimfile f(path);
+                file::stimstream s(path, 16384);
+                f.load_samples(srates[i]);
+                s.load_samples(srates[i]);
+                assert(s.buffer() == 0);
+                assert(s.samplerate() == f.samplerate());
+                assert(s.nframes() == f.nframes());
+                const bool resampled = (srates[i] > 0);
+                vector<sample_t> buf(f.nframes());
+                for (int rep = 0; rep < 3; ++rep) {
+                        nframes_t stop = (rep == 1) ? f.nframes() / 3 : f.nframes();
+                        nframes_t offset = 0;
+                        while (offset < stop) {
+                                nframes_t n = std::min(stop - offset, nframes_t(1 + rand() % 1024));
+                                nframes_t got = s.read(&buf[offset], offset, n);
+                                if (got == 0) usleep(100);
+                                offset += got;
+                        }
+                        for (nframes_t j = 0; j < stop; ++j) {
+                                if (resampled)
+                                        assert(fabs(buf[j] - f.buffer()[j]) < 1e-4);
+                                else
+                                        assert(buf[j] == f.buffer()[j]);
+                        }
+                }
+        } while (srates[i++] > 0);
+}
+
+/*
+ * Channels are deinterleaved into aligned arrays, and read() copies each
+ * channel.
+ */
+void
+test_channels(char const * path)
+{
+        SF_INFO info;
+        SNDFILE * sf = sf_open(path, SFM_READ, &info);
+        assert(sf != 0);
+        vector<sample_t> frames(info.frames * info.channels);
+        assert(sf_readf_float(sf, &frames[0], info.frames) == info.frames);
+        sf_close(sf);
+
+        file::stimfile f(path);
+        assert(f.nchannels() == size_t(info.channels));
+        assert(f.channel(0) == 0);
+        size_t i = 0;
+        do {
+                f.load_samples(srates[i]);
+                assert(f.channel(0) == f.buffer());
+                assert(f.channel(f.nchannels()) == 0);
+                vector<sample_t> buf(f.nframes());
+                for (size_t c = 0; c < f.nchannels(); ++c) {
+                        sample_t const * chan = f.channel(c);
+                        assert(chan != 0);
+                        assert(reinterpret_cast<size_t>(chan) % 16 == 0);
+                        if (srates[i] == 0) {
+                                for (nframes_t j = 0; j < f.nframes(); ++j)
+                                        assert(chan[j] == frames[j * info.channels + c]);
+                        }
+                        assert(f.read(&buf[0], 0, f.nframes(), c) == f.nframes());
+                        assert(equal(buf.begin(), buf.end(), chan));
+                }
+        } while (srates[i++] > 0);
+}
+
+/* a rate that requires resampling */
+nframes_t
+other_rate(stimulus_t const & stim)
+{
+        return (stim.samplerate() == 30000) ? 32000 : 30000;
+}
+
+/*
+ * Stimuli are unloaded to stay within the memory budget, except for the two
+ * most recently used, and resampled stimuli are mapped from the disk cache in
+ * later sessions.
+ */
+void
+test_stimcache(int argc, char **argv)
+{
+        char dir[] = "/tmp/test_stimcacheXXXXXX";
+        assert(mkdtemp(dir) != 0);
+        vector<vector<sample_t> > expected;
+        {
+                file::stimcache cache(dir, 1);
+                boost::ptr_vector<file::stimfile> stims;
+                for (int i = 1; i < argc; ++i) {
+                        stims.push_back(new file::stimfile(argv[i], &cache));
+                        file::stimfile & f = stims.back();
+                        f.load_samples(other_rate(f));
+                        expected.push_back(vector<sample_t>(f.buffer(), f.buffer() + f.nframes()));
+                        for (int j = 0; j < i; ++j)
+                                assert((stims[j].buffer() != 0) == (j + 2 >= i));
+                }
+                assert(cache.hits() == 0);
+                assert(cache.misses() == size_t(argc - 1));
+        }
+        {
+                file::stimcache cache(dir);
+                for (int i = 1; i < argc; ++i) {
+                        file::stimfile f(argv[i], &cache);
+                        f.load_samples(other_rate(f));
+                        assert(cache.hits() == size_t(i));
+                        assert(f.nframes() == expected[i-1].size());
+                        assert(equal(expected[i-1].begin(), expected[i-1].end(), f.buffer()));
+                }
+                assert(cache.bytes() == 0);
+        }
+        boost::filesystem::remove_all(dir);
+}
+
+/* loading in parallel gives the same samples as loading one at a time */
+void
+test_load_stimuli(int argc, char **argv)
+{
+        boost::ptr_vector<file::stimfile> serial, parallel;
+        vector<stimulus_t *> stims;
+        for (int i = 1; i < argc; ++i) {
+                serial.push_back(new file::stimfile(argv[i]));
+                serial.back().load_samples(other_rate(serial.back()));
+                parallel.push_back(new file::stimfile(argv[i]));
+                stims.push_back(&parallel.back());
+        }
+        size_t calls = 0;
+        util::load_stimuli(stims, 30000, 3, (boost::lambda::var(calls) += 1));
+        assert(calls > 0);
+        for (size_t i = 0; i < serial.size(); ++i) {
+                assert(parallel[i].buffer() != 0);
+                if (serial[i].samplerate() != 30000) continue;
+                assert(parallel[i].nframes() == serial[i].nframes());
+                assert(equal(serial[i].buffer(), serial[i].buffer() + serial[i].nframes(),
+                             parallel[i].buffer()));
+        }
+}
+
 int
 load_stimset(int argc, char **argv)
 {
@@ -78,6 +227,19 @@ test_stimqueue(util::stimqueue & q, int count)
 
 int main(int argc, char **argv)
 {
+        for (int i = 1; i < argc; ++i)
+                test_channels(argv[i]);
+        cout << "stimfile channels ok" << endl;
+        for (int i = 1; i < argc; ++i) {
+                file::stimfile f(argv[i]);
+                if (f.nchannels() == 1)
+                        test_stimstream(argv[i]);
+        }
+        cout << "stimstream ok" << endl;
+        test_stimcache(argc, argv);
+        cout << "stimcache ok" << endl;
+        test_load_stimuli(argc, argv);
+        cout << "load_stimuli ok" << endl;
         int count = load_stimset(argc, argv);
         std::random_shuffle(_stimlist.begin(), _stimlist.end());
         util::readahead_stimqueue queue(_stimlist.begin(), _stimlist.end(), 30000);
@@ -0,0 +1,169 @@
+#include <cstdlib>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <boost/scoped_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "jill/util/synth_stimulus.hh"
+
+using namespace jill;
+using namespace std;
+using util::synth_stimulus;
+
+typedef boost::scoped_ptr<synth_stimulus> stim_ptr;
+
+/* read a stimulus in blocks of random size */
+vector<sample_t>
+read_all(stimulus_t const & stim)
+{
+        vector<sample_t> out(stim.nframes() + 100, -9);
+        nframes_t offset = 0;
+        while (offset < stim.nframes()) {
+                nframes_t n = stim.read(&out[offset], offset, 1 + rand() % 1500);
+                assert(n > 0);
+                offset += n;
+        }
+        assert(stim.read(&out[offset], offset, 100) == 0);
+        assert(out[offset] == -9);
+        out.resize(offset);
+        return out;
+}
+
+bool
+throws(char const * spec)
+{
+        try {
+                delete synth_stimulus::create(spec);
+        }
+        catch (std::invalid_argument const & e) {
+                return true;
+        }
+        return false;
+}
+
+void
+test_parse()
+{
+        assert(synth_stimulus::is_spec("tone:freq=1000,dur=0.5"));
+        assert(synth_stimulus::is_spec("noise:dur=1"));
+        assert(!synth_stimulus::is_spec("song.wav"));
+        assert(!synth_stimulus::is_spec("/data/tones:1/a.wav"));
+
+        assert(throws("tone:dur=0.5"));                 // missing freq
+        assert(throws("tone:freq=1000"));               // missing dur
+        assert(throws("tone:freq=1000,dur=0.5,fm=3"));  // unknown parameter
+        assert(throws("tone:freq=1k,dur=0.5"));
+        assert(throws("tone:freq=,dur=0.5"));
+        assert(throws("tone:freq=1000,dur=0"));
+        assert(throws("am:freq=1000,mod=10,depth=2,dur=1"));
+        assert(throws("chirp:dur=1"));
+
+        stim_ptr s(synth_stimulus::create("tone:freq=1000,dur=0.5"));
+        assert(string(s->name()) == "tone:freq=1000,dur=0.5");
+        assert(s->buffer() == 0);
+        assert(s->nchannels() == 1);
+        s->load_samples(44100);
+        assert(s->samplerate() == 44100);
+        assert(s->nframes() == 22050);
+        assert(s->duration() == 0.5);
+        s->load_samples(0);
+        assert(s->samplerate() == synth_stimulus::default_samplerate);
+}
+
+/* the oscillators match the exact phase, and the ramps and amplitude are applied */
+void
+test_oscillators()
+{
+        const double sr = 44100;
+        stim_ptr tone(synth_stimulus::create("tone:freq=1234.5,dur=2.5,amp=0.5,ramp=0.01"));
+        stim_ptr sweep(synth_stimulus::create("sweep:f0=100,f1=15000,dur=3,ramp=0"));
+        stim_ptr am(synth_stimulus::create("am:freq=2000,mod=7,depth=0.5,dur=1,ramp=0"));
+        tone->load_samples(sr);
+        sweep->load_samples(sr);
+        am->load_samples(sr);
+
+        vector<sample_t> x = read_all(*tone);
+        const nframes_t R = 441;
+        for (nframes_t n = 0; n < x.size(); ++n) {
+                double g = 1;
+                if (n < R) g = pow(sin(M_PI / 2 * n / R), 2);
+                else if (n >= x.size() - R) g = pow(sin(M_PI / 2 * (x.size() - 1 - n) / R), 2);
+                double ref = 0.5 * g * sin(2 * M_PI * 1234.5 * n / sr);
+                assert(fabs(x[n] - ref) < 1e-4);
+        }
+        assert(x.front() == 0 && x.back() == 0);
+
+        x = read_all(*sweep);
+        const double N = sweep->nframes();
+        for (nframes_t n = 0; n < x.size(); ++n) {
+                double ref = sin(2 * M_PI * (100 * n / sr + (15000 - 100) * n * double(n) / (2 * sr * N)));
+                assert(fabs(x[n] - ref) < 1e-3);
+        }
+
+        x = read_all(*am);
+        for (nframes_t n = 0; n < x.size(); ++n) {
+                double ref = sin(2 * M_PI * 2000 * n / sr) * (1 + 0.5 * sin(2 * M_PI * 7 * n / sr)) / 1.5;
+                assert(fabs(x[n] - ref) < 1e-4);
+        }
+}
+
+/* noise is uniform, the same on every presentation, and depends on the seed */
+void
+test_noise()
+{
+        stim_ptr a(synth_stimulus::create("noise:dur=2,ramp=0"));
+        stim_ptr b(synth_stimulus::create("noise:dur=2,ramp=0,seed=1"));
+        stim_ptr c(synth_stimulus::create("noise:dur=2,ramp=0,seed=2"));
+        vector<sample_t> x = read_all(*a);
+        assert(x == read_all(*a));
+        vector<sample_t> y = read_all(*b), z = read_all(*c);
+        assert(y != z);
+        // a different seed isn't the same sequence shifted
+        assert(!equal(y.begin() + 1, y.end(), z.begin()));
+
+        double sum = 0, ss = 0;
+        for (size_t i = 0; i < x.size(); ++i) {
+                assert(x[i] >= -1 && x[i] < 1);
+                sum += x[i];
+                ss += x[i] * x[i];
+        }
+        double mean = sum / x.size();
+        double rms = sqrt(ss / x.size());
+        cout << "noise mean=" << mean << ", rms=" << rms << endl;
+        assert(fabs(mean) < 0.01);
+        assert(fabs(rms - 1 / sqrt(3.0)) < 0.01);
+}
+
+/* compare to the cost of copying from a buffer */
+void
+benchmark()
+{
+        using namespace boost::posix_time;
+        const nframes_t period = 1024;
+        const int nperiods = 10000;
+        vector<sample_t> out(period);
+        char const * specs[] = { "tone:freq=1000,dur=300", "sweep:f0=100,f1=10000,dur=300",
+                                 "am:freq=1000,mod=10,dur=300", "noise:dur=300", 0 };
+        for (char const ** spec = specs; *spec; ++spec) {
+                stim_ptr s(synth_stimulus::create(*spec));
+                ptime start = microsec_clock::universal_time();
+                for (int i = 0; i < nperiods; ++i)
+                        s->read(&out[0], i * period, period);
+                time_duration elapsed = microsec_clock::universal_time() - start;
+                cout << *spec << ": " << elapsed.total_microseconds() * 1000.0 / (nperiods * period)
+                     << " ns/sample" << endl;
+        }
+}
+
+int
+main(int, char**)
+{
+        test_parse();
+        test_oscillators();
+        test_noise();
+        cout << "synth_stimulus ok" << endl;
+        benchmark();
+}